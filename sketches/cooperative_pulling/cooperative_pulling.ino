@@ -90,13 +90,209 @@ unsigned long Report_interval = 200;
 int MEASURED_GRAMS;
 int STRAINGAUGE_VALUE;
 
+// Binary state stream: 'b<hz>' pushes a state frame <hz> times per second, 'b0' stops. Frame
+// layout (little-endian), matching LeverFrameFormat in serial_lever.hpp:
+// sync 0xA5 0x5A | type u8 | reserved u8 | sequence u16 | micros u32 |
+// strain gauge, calculated pwm, actual pwm, potentiometer f32 x 4 | crc16 over type..potentiometer
+#define FRAME_SYNC0 0xA5
+#define FRAME_SYNC1 0x5A
+#define FRAME_TYPE_STATE 1
+#define FRAME_TYPE_EDGE 2
+#define FRAME_TYPE_PROFILE 3
+#define FRAME_SIZE 28
+
+int Stream_rate = 0;
+elapsedMicros SinceFrame;
+uint16_t frame_sequence = 0;
+
+// Pull detection: 'e<rising> <falling>' sets potentiometer thresholds, checked every Read_interval;
+// equal thresholds turn it off. If rising > falling the lever is pulled when the reading goes above
+// rising and released when it goes below falling, otherwise the other way around. Each crossing sends
+// a frame laid out like a state frame, with type FRAME_TYPE_EDGE, the reserved byte 1 for a pull and
+// 0 for a release, and its own sequence number.
+long Edge_rising = 0;
+long Edge_falling = 0;
+bool Edge_is_high = false;
+uint16_t edge_sequence = 0;
+
+// Force profiles: 'c' clears the profile (stopping it if running), 'l<reverse> <grams> <ramp ms> <hold ms>'
+// appends a segment, 'm' runs it. Each segment sets the direction, ramps linearly from the current grams to
+// <grams> over <ramp ms>, then holds for <hold ms>; the force is updated every Profile_step_us. The end of
+// a run sends a frame laid out like a state frame, with type FRAME_TYPE_PROFILE, the reserved byte 1 if the
+// profile completed and 0 if it was cleared, and its own sequence number.
+#define MAX_PROFILE_SEGMENTS 8
+
+struct ProfileSegment {
+  long reverse;
+  long grams;
+  long ramp_ms;
+  long hold_ms;
+};
+
+ProfileSegment Profile[MAX_PROFILE_SEGMENTS];
+int Profile_size = 0;
+int Profile_segment = -1; // running segment, or -1
+float Profile_start_grams = 0;
+elapsedMillis SinceSegment;
+elapsedMicros SinceProfileStep;
+unsigned long Profile_step_us = 1000;
+uint16_t profile_sequence = 0;
+
+// Baud rate negotiation: 'h<rate>' answers "baud: <rate>" at the current rate and then switches to <rate> if it
+// is in Supported_bauds, or answers with the current rate otherwise. Asking for the current rate confirms it; a
+// switch away from DEFAULT_BAUD that is not confirmed within Baud_confirm_ms goes back to DEFAULT_BAUD, as does a
+// confirmed rate once no command has arrived for Baud_idle_ms, e.g. because the host exited without restoring
+// the default. Either way the host can always reach the lever again. Matches default_baud_rate(),
+// baud_confirm_window_ms() and baud_idle_timeout_ms() in serial_lever.hpp.
+#define DEFAULT_BAUD 9600
+const long Supported_bauds[] = {2000000, 1000000, 500000, 230400, 115200, 57600, 38400, 19200, 9600};
+long Baud_rate = DEFAULT_BAUD;
+bool Baud_confirmed = true;
+elapsedMillis SinceBaudSwitch;
+unsigned long Baud_confirm_ms = 500;
+elapsedMillis SinceCommand;
+unsigned long Baud_idle_ms = 3000;
+// Bytes that start a command. Bytes sent at another rate arrive garbled, and do not count as traffic.
+const char Command_bytes[] = "xoPfzpgbethclmus";
+
+uint16_t crc16_ccitt(const uint8_t* data, int size) {
+  uint16_t crc = 0xFFFF;
+  for (int i = 0; i < size; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+float calculate_pwm_from_strain(float strain) {
+  return Strain_COEF[0]*pow(strain, 6) + Strain_COEF[1]*pow(strain, 5) + Strain_COEF[2]*pow(strain, 4) + Strain_COEF[3]*pow(strain, 3) + Strain_COEF[4]*pow(strain, 2) + Strain_COEF[5]*strain + Strain_COEF[6];
+}
+
+void send_frame(uint8_t type, uint8_t flags, uint16_t sequence, int pot) {
+  uint8_t frame[FRAME_SIZE];
+  float strain = myRA.getAverage();
+  float values[4] = {strain, calculate_pwm_from_strain(strain), (float)PWM_VALUE, (float)pot};
+  uint32_t t = micros();
+
+  frame[0] = FRAME_SYNC0;
+  frame[1] = FRAME_SYNC1;
+  frame[2] = type;
+  frame[3] = flags;
+  memcpy(frame + 4, &sequence, 2);
+  memcpy(frame + 6, &t, 4);
+  memcpy(frame + 10, values, 16);
+  uint16_t crc = crc16_ccitt(frame + 2, FRAME_SIZE - 4);
+  memcpy(frame + 26, &crc, 2);
+
+  Serial.write(frame, FRAME_SIZE);
+}
+
+void send_state_frame() {
+  send_frame(FRAME_TYPE_STATE, 0, frame_sequence, analogRead(POT_PIN));
+  frame_sequence++;
+}
+
+void detect_edge(int pot) {
+  bool above_rising = Edge_rising > Edge_falling ? pot > Edge_rising : pot < Edge_rising;
+  bool below_falling = Edge_rising > Edge_falling ? pot < Edge_falling : pot > Edge_falling;
+  if (Edge_is_high && below_falling) {
+    Edge_is_high = false;
+    send_frame(FRAME_TYPE_EDGE, 0, edge_sequence, pot);
+    edge_sequence++;
+  } else if (!Edge_is_high && above_rising) {
+    Edge_is_high = true;
+    send_frame(FRAME_TYPE_EDGE, 1, edge_sequence, pot);
+    edge_sequence++;
+  }
+}
+
+void set_profile_direction(long reverse) {
+  DIRECTION = reverse ? 0 : 1;
+  digitalWrite(DIRECTION_PIN, DIRECTION);
+}
+
+void set_profile_grams(float grams) {
+  command_grams = grams;
+  PWM_VALUE = PWM_COEF[0]*grams + PWM_COEF[1] + PWM_COEF[2];
+  analogWrite(PWM_PIN, PWM_VALUE);
+}
+
+void start_profile_segment(int i) {
+  Profile_segment = i;
+  Profile_start_grams = command_grams;
+  SinceSegment = 0;
+  set_profile_direction(Profile[i].reverse);
+}
+
+void finish_profile(uint8_t completed) {
+  Profile_segment = -1;
+  send_frame(FRAME_TYPE_PROFILE, completed, profile_sequence, analogRead(POT_PIN));
+  profile_sequence++;
+}
+
+void step_profile() {
+  ProfileSegment& seg = Profile[Profile_segment];
+  unsigned long t = SinceSegment;
+  float f = seg.ramp_ms > 0 ? min(1.0f, (float)t / seg.ramp_ms) : 1.0f;
+  set_profile_grams(Profile_start_grams + (seg.grams - Profile_start_grams) * f);
+  if (t >= (unsigned long)(seg.ramp_ms + seg.hold_ms)) {
+    if (Profile_segment + 1 < Profile_size) {
+      start_profile_segment(Profile_segment + 1);
+    } else {
+      finish_profile(1);
+    }
+  }
+}
+
+bool supports_baud(long rate) {
+  for (unsigned int i = 0; i < sizeof(Supported_bauds) / sizeof(Supported_bauds[0]); i++) {
+    if (Supported_bauds[i] == rate) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void switch_baud(long rate) {
+  Serial.flush();
+  Serial.end();
+  Serial.begin(rate);
+  Baud_rate = rate;
+  Baud_confirmed = rate == DEFAULT_BAUD;
+  SinceBaudSwitch = 0;
+  SinceCommand = 0;
+}
+
 void loop() {
 
+if(!Baud_confirmed && SinceBaudSwitch >= Baud_confirm_ms) {
+  switch_baud(DEFAULT_BAUD);
+}
+
+if(Baud_rate != DEFAULT_BAUD && SinceCommand >= Baud_idle_ms) {
+  switch_baud(DEFAULT_BAUD);
+}
+
 if(SinceRead >= Read_interval) {
   myRA.addValue(analogRead(STRAINGAUGE_PIN));
+  if (Edge_rising != Edge_falling) {
+    detect_edge(analogRead(POT_PIN));
+  }
   SinceRead = 0;
 }
 
+if(Profile_segment >= 0 && SinceProfileStep >= Profile_step_us) {
+  SinceProfileStep = 0;
+  step_profile();
+}
+
+if(Stream_rate > 0 && SinceFrame >= 1000000 / Stream_rate) {
+  SinceFrame = 0;
+  send_state_frame();
+}
+
 //if(SinceReport >= Report_interval) {
 //  Serial.println(myRA.getAverage());
 //  SinceReport = 0;
@@ -105,6 +301,9 @@ if(SinceRead >= Read_interval) {
 
 while (Serial.available() > 0) {
   incomingByte = Serial.read();
+  if(incomingByte > 0 && strchr(Command_bytes, incomingByte)) {
+    SinceCommand = 0;
+  }
   if(incomingByte == 'x') {
     ENABLE = 1;
     Serial.println("enabled");
@@ -120,6 +319,11 @@ while (Serial.available() > 0) {
     DIRECTION = 1;
     Serial.println("forward");
   }
+  if(incomingByte == 'z') {
+    DIRECTION = 0;
+    digitalWrite(DIRECTION_PIN, DIRECTION);
+    Serial.println("reverse");
+  }
 //  if(incomingByte == 'r') {
 //    DIRECTION = 0;
 //    Serial.println("reverse");
@@ -161,6 +365,83 @@ while (Serial.available() > 0) {
     }
   }
 
+  if(incomingByte == 'b') {
+    Stream_rate = max(Serial.parseInt(), 0);
+    SinceFrame = 0;
+    Serial.print("stream rate: ");
+    Serial.println(Stream_rate);
+  }
+
+  if(incomingByte == 'e') {
+    long rising = Serial.parseInt();
+    long falling = Serial.parseInt();
+    // The host re-sends its thresholds periodically; only start over when they change.
+    if (rising != Edge_rising || falling != Edge_falling) {
+      Edge_rising = rising;
+      Edge_falling = falling;
+      Edge_is_high = false;
+    }
+    Serial.print("edge thresholds: ");
+    Serial.print(Edge_rising);
+    Serial.print(' ');
+    Serial.println(Edge_falling);
+  }
+
+  // Clock read: the host relates micros() to its own clock from the round trip of this command.
+  if(incomingByte == 't') {
+    uint32_t t = micros();
+    Serial.print("clock: ");
+    Serial.println(t);
+  }
+
+  if(incomingByte == 'h') {
+    long rate = Serial.parseInt();
+    if (rate == Baud_rate) {
+      Baud_confirmed = true;
+      Serial.print("baud: ");
+      Serial.println(Baud_rate);
+    } else if (supports_baud(rate)) {
+      // Answer at the old rate, then switch; the host confirms at the new one.
+      Serial.print("baud: ");
+      Serial.println(rate);
+      switch_baud(rate);
+    } else {
+      Serial.print("baud: ");
+      Serial.println(Baud_rate);
+    }
+  }
+
+  if(incomingByte == 'c') {
+    if (Profile_segment >= 0) {
+      finish_profile(0);
+    }
+    Profile_size = 0;
+    Serial.print("profile segments: ");
+    Serial.println(Profile_size);
+  }
+
+  if(incomingByte == 'l') {
+    ProfileSegment seg;
+    seg.reverse = Serial.parseInt();
+    seg.grams = Serial.parseInt();
+    seg.ramp_ms = Serial.parseInt();
+    seg.hold_ms = Serial.parseInt();
+    if (Profile_segment < 0 && Profile_size < MAX_PROFILE_SEGMENTS) {
+      Profile[Profile_size++] = seg;
+    }
+    Serial.print("profile segments: ");
+    Serial.println(Profile_size);
+  }
+
+  if(incomingByte == 'm') {
+    if (Profile_size > 0) {
+      start_profile_segment(0);
+      SinceProfileStep = 0;
+    }
+    Serial.print("profile started: ");
+    Serial.println(Profile_size);
+  }
+
   if(incomingByte == 'u') {
     PWM_COEF[2] = Serial.parseFloat();
   }
@@ -171,7 +452,7 @@ while (Serial.available() > 0) {
       Serial.print(current_average);
       Serial.print('\t');
       Serial.print("calculated PWM: ");
-      calculated_pwm = Strain_COEF[0]*pow(current_average, 6) + Strain_COEF[1]*pow(current_average, 5) + Strain_COEF[2]*pow(current_average, 4) + Strain_COEF[3]*pow(current_average, 3) + Strain_COEF[4]*pow(current_average, 2) + Strain_COEF[5]*current_average + Strain_COEF[6];
+      calculated_pwm = calculate_pwm_from_strain(current_average);
       Serial.print(calculated_pwm);
       Serial.print('\t');
       Serial.print("acutal PWM: ");
@@ -198,7 +479,9 @@ if(incomingByte == 'r') {
   
 }
 
-  if (Serial.read() == '\n') { 
+  // Only consume the terminator; reading unconditionally would swallow the next pipelined command.
+  if (Serial.peek() == '\n') {
+    Serial.read();
 //    digitalWrite(DIRECTION_PIN, DIRECTION);
     analogWrite(PWM_PIN, PWM_VALUE);
 //    digitalWrite(ENABLE_PIN, ENABLE);
@@ -48,7 +48,10 @@ int App::run() {
   auto imgui_context = gui_res.value();
 
   auto* lever_sys = om::lever::get_global_lever_system();
-  om::lever::initialize(lever_sys, 2, levers.data());
+  levers.resize(om::total_num_levers(rig_descriptors));
+  om::lever::initialize(lever_sys, int(levers.size()), levers.data(), 0,
+                        om::num_levers_per_rig(rig_descriptors));
+  rigs = om::make_rigs(rig_descriptors, levers);
 
   glfwMakeContextCurrent(render_win.window);
   om::gfx::init_rendering();
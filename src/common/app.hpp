@@ -2,7 +2,8 @@
 
 #include "serial_lever.hpp"
 #include "lever_system.hpp"
-#include <array>
+#include "rig.hpp"
+#include <vector>
 
 namespace om {
 
@@ -16,7 +17,11 @@ struct App {
   int run();
 
   std::vector<om::PortDescriptor> ports;
-  std::array<om::lever::SerialLeverHandle, 2> levers{};
+  //  Set before `run`; by default, one rig with two levers and two pumps.
+  std::vector<om::RigDescriptor> rig_descriptors{om::RigDescriptor{}};
+  //  The levers of every rig, in rig order, and the rigs made from them; valid from `setup`.
+  std::vector<om::lever::SerialLeverHandle> levers;
+  std::vector<om::Rig> rigs;
   bool start_render{};
 };
 
@@ -1,5 +1,6 @@
 #include "audio.hpp"
 #include "ringbuffer.hpp"
+#include "slot_map.hpp"
 #include "common.hpp"
 #include "AudioFile/AudioFile.h"
 #include "portaudio.h"
@@ -11,6 +12,8 @@
 namespace om::audio {
 
 constexpr int max_num_buffer_output_channels = 4;
+//  Fixed so that the audio thread's buffer table never has to grow.
+constexpr int max_num_buffers = 4096;
 
 struct Buffer {
   std::unique_ptr<float[]> data;
@@ -20,7 +23,7 @@ struct Buffer {
 };
 
 struct PushBuffer {
-  uint32_t handle_id;
+  BufferHandle handle;
   Buffer* buffer;
 };
 
@@ -53,10 +56,10 @@ struct {
   double sample_rate{44.1e3};
   PaStream* stream{};
 
-  std::unordered_map<uint32_t, Buffer*> render_buffers;
-  std::unordered_map<uint32_t, std::unique_ptr<Buffer>> main_buffers;
+  //  Buffers known to the audio thread, indexed by the slot index of their handle.
+  PushBuffer render_buffers[max_num_buffers]{};
+  SlotMap<BufferHandle, std::unique_ptr<Buffer>> main_buffers;
   RingBuffer<PushBuffer, 1024> push_buffers;
-  uint32_t next_buffer_id{1};
 
   RingBuffer<PendingPlayingBuffer, 1024> pending_play;
   PlayingBuffers playing;
@@ -116,8 +119,8 @@ bool push_playing(PlayingBuffers* buffs, const PendingPlayingBuffer& pend) {
   if (buffs->num_playing_buffers == PlayingBuffers::max_num_playing_buffers) {
     return false;
   } else {
-    auto it = globals.render_buffers.find(pend.buffer.id);
-    if (it == globals.render_buffers.end()) {
+    const uint32_t slot = slot_map::slot_index(pend.buffer.id);
+    if (slot >= uint32_t(max_num_buffers) || globals.render_buffers[slot].handle != pend.buffer) {
       assert(false);
       return false;
     } else {
@@ -125,7 +128,7 @@ bool push_playing(PlayingBuffers* buffs, const PendingPlayingBuffer& pend) {
       for (int i = 0; i < max_num_buffer_output_channels; i++) {
         playing.gain[i] = pend.gain[i];
       }
-      playing.buffer = it->second;
+      playing.buffer = globals.render_buffers[slot].buffer;
       buffs->buffers[buffs->num_playing_buffers++] = playing;
       return true;
     }
@@ -136,18 +139,19 @@ int stream_callback(const void*, void* output_buffer,
                     unsigned long, const PaStreamCallbackTimeInfo*,
                     unsigned long, void*) {
   {
-    int num_buffs = globals.push_buffers.size();
-    for (int i = 0; i < num_buffs; i++) {
-      auto buff = globals.push_buffers.read();
-      globals.render_buffers[buff.handle_id] = buff.buffer;
+    auto buffs = globals.push_buffers.peek_read();
+    for (int i = 0; i < buffs.size(); i++) {
+      auto& buff = buffs[i];
+      globals.render_buffers[slot_map::slot_index(buff.handle.id)] = buff;
     }
+    globals.push_buffers.consume(buffs.size());
   }
   {
-    int num_buffs = globals.pending_play.size();
-    for (int i = 0; i < num_buffs; i++) {
-      auto pend = globals.pending_play.read();
-      push_playing(&globals.playing, pend);
+    auto pends = globals.pending_play.peek_read();
+    for (int i = 0; i < pends.size(); i++) {
+      push_playing(&globals.playing, pends[i]);
     }
+    globals.pending_play.consume(pends.size());
   }
 
   auto* out = static_cast<float*>(output_buffer);
@@ -192,7 +196,8 @@ void terminate_audio() {
 
 std::optional<BufferHandle> create_buffer(const float* data, double sr, int channels, int frames) {
   assert(channels > 0 && frames > 0);
-  if (!globals.pa_stream_started || globals.push_buffers.full()) {
+  if (!globals.pa_stream_started || globals.push_buffers.full() ||
+      globals.main_buffers.size() >= max_num_buffers) {
     return std::nullopt;
   }
 
@@ -203,14 +208,13 @@ std::optional<BufferHandle> create_buffer(const float* data, double sr, int chan
   buff.data = std::make_unique<float[]>(channels * frames);
   memcpy(buff.data.get(), data, channels * frames * sizeof(float));
 
-  BufferHandle result{globals.next_buffer_id++};
   auto res_buff = std::make_unique<Buffer>(std::move(buff));
   auto* buff_ptr = res_buff.get();
-  globals.main_buffers[result.id] = std::move(res_buff);
+  BufferHandle result = globals.main_buffers.insert(std::move(res_buff));
 
   PushBuffer push{};
   push.buffer = buff_ptr;
-  push.handle_id = result.id;
+  push.handle = result;
   globals.push_buffers.write(push);
   return result;
 }
@@ -256,15 +260,18 @@ namespace {
 
 bool play_buffer(BufferHandle buff, float gain_l, float gain_r) {
   assert(globals.pa_stream_started);
-  if (globals.pending_play.full()) {
+  auto dst = globals.pending_play.prepare_write(1);
+  if (dst.size() == 0) {
+    globals.pending_play.record_dropped();
     assert(false);
     return false;
   } else {
-    PendingPlayingBuffer pend{};
+    auto& pend = dst[0];
+    pend = {};
     pend.buffer = buff;
     pend.gain[0] = gain_l;
     pend.gain[1] = gain_r;
-    globals.pending_play.write(pend);
+    globals.pending_play.commit_write(1);
     return true;
   }
 }
@@ -279,6 +286,10 @@ bool play_buffer_channel_r(BufferHandle buff, float gain) {
 
 } //  anon
 
+RingBufferStats get_pending_play_stats() {
+  return globals.pending_play.stats();
+}
+
 bool play_buffer_both(BufferHandle buff, float gain) {
   return play_buffer(buff, gain, gain);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "identifier.hpp"
+#include "ringbuffer.hpp"
 #include <cstdint>
 #include <optional>
 
@@ -17,5 +18,6 @@ std::optional<BufferHandle> create_buffer(const float* data, double sr, int chan
 std::optional<BufferHandle> read_buffer(const char* file_path);
 bool play_buffer_both(BufferHandle buff, float gain);
 bool play_buffer_on_channel(BufferHandle buff, int channel, float gain);
+RingBufferStats get_pending_play_stats();
 
 }
\ No newline at end of file
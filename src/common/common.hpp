@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstddef>
+
 namespace om {
 
+//  Used to keep data written by different threads on separate cache lines.
+constexpr std::size_t cache_line_size = 64;
+
 template <typename T>
 T clamp(const T& v, const T& lo, const T& hi) {
   return v < lo ? lo : v > hi ? hi : v;
@@ -0,0 +1,121 @@
+#include "device_clock.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace om {
+
+namespace {
+
+//  Signed difference a - b between two readings of a wrapping 32-bit clock.
+int64_t device_delta_us(uint32_t a, uint32_t b) {
+  return int64_t(int32_t(a - b));
+}
+
+TimePoint::duration to_duration(double s) {
+  return std::chrono::duration_cast<TimePoint::duration>(Duration(s));
+}
+
+} //  anon
+
+void clear(DeviceClockSync* sync) {
+  *sync = {};
+}
+
+void add_exchange(DeviceClockSync* sync, const TimePoint& sent, const TimePoint& received,
+                  uint32_t device_time_us) {
+  assert(received >= sent);
+  if (sync->num_exchanges > 0) {
+    const int64_t delta = device_delta_us(device_time_us, sync->last_device_time_us);
+    if (delta < 0) {
+      clear(sync);
+    } else {
+      sync->last_device_us += delta;
+    }
+  }
+  if (sync->num_exchanges == 0) {
+    sync->host_t0 = sent;
+    sync->last_device_us = 0;
+  }
+  sync->last_device_time_us = device_time_us;
+
+  DeviceClockSync::Exchange exchange{};
+  exchange.device_us = sync->last_device_us;
+  exchange.round_trip_s = elapsed_time(sent, received);
+  exchange.host_s = elapsed_time(sync->host_t0, sent) + exchange.round_trip_s * 0.5;
+
+  sync->exchanges[sync->next_exchange] = exchange;
+  sync->next_exchange = (sync->next_exchange + 1) % DeviceClockSync::capacity;
+  sync->num_exchanges = std::min(sync->num_exchanges + 1, DeviceClockSync::capacity);
+}
+
+std::optional<DeviceClockEstimate> estimate(const DeviceClockSync& sync) {
+  const int n = sync.num_exchanges;
+  if (n == 0) {
+    return std::nullopt;
+  }
+
+  //  Exchanges delayed on either leg misplace the midpoint; keep those no slower than the median.
+  double round_trips[DeviceClockSync::capacity]{};
+  for (int i = 0; i < n; i++) {
+    round_trips[i] = sync.exchanges[i].round_trip_s;
+  }
+  std::nth_element(round_trips, round_trips + n / 2, round_trips + n);
+  const double max_round_trip = round_trips[n / 2];
+
+  const DeviceClockSync::Exchange* used[DeviceClockSync::capacity];
+  int num_used{};
+  double min_round_trip = max_round_trip;
+  for (int i = 0; i < n; i++) {
+    if (sync.exchanges[i].round_trip_s <= max_round_trip) {
+      used[num_used++] = &sync.exchanges[i];
+      min_round_trip = std::min(min_round_trip, sync.exchanges[i].round_trip_s);
+    }
+  }
+
+  //  Least squares fit of host time against device time, in seconds relative to their means.
+  double mean_x{};
+  double mean_y{};
+  for (int i = 0; i < num_used; i++) {
+    mean_x += double(used[i]->device_us) * 1e-6;
+    mean_y += used[i]->host_s;
+  }
+  mean_x /= double(num_used);
+  mean_y /= double(num_used);
+
+  double sxx{};
+  double sxy{};
+  for (int i = 0; i < num_used; i++) {
+    const double dx = double(used[i]->device_us) * 1e-6 - mean_x;
+    sxx += dx * dx;
+    sxy += dx * (used[i]->host_s - mean_y);
+  }
+  //  Until the exchanges span some time, assume the clocks run at the same rate.
+  const double rate = sxx > 1.0 ? sxy / sxx : 1.0;
+
+  double max_residual{};
+  for (int i = 0; i < num_used; i++) {
+    const double fit = mean_y + (double(used[i]->device_us) * 1e-6 - mean_x) * rate;
+    max_residual = std::max(max_residual, std::abs(used[i]->host_s - fit));
+  }
+
+  const int last = (sync.next_exchange + DeviceClockSync::capacity - 1) % DeviceClockSync::capacity;
+  const auto& last_exchange = sync.exchanges[last];
+  const double last_host_s = mean_y + (double(last_exchange.device_us) * 1e-6 - mean_x) * rate;
+
+  DeviceClockEstimate result{};
+  result.host_time = sync.host_t0 + to_duration(last_host_s);
+  result.device_time_us = sync.last_device_time_us;
+  result.rate = rate;
+  result.error_bound_s = min_round_trip * 0.5 + max_residual;
+  result.last_round_trip_s = last_exchange.round_trip_s;
+  result.num_exchanges = n;
+  return result;
+}
+
+TimePoint to_host_time(const DeviceClockEstimate& estimate, uint32_t device_time_us) {
+  const double dt = double(device_delta_us(device_time_us, estimate.device_time_us)) * 1e-6;
+  return estimate.host_time + to_duration(dt * estimate.rate);
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "time.hpp"
+#include <cstdint>
+#include <optional>
+
+namespace om {
+
+/*
+ * DeviceClockSync - Relates a device's 32-bit microsecond clock to host time from round-trip
+ * exchanges. For each exchange, the host records when it sent the request and when it read the
+ * reply, and the device reports its clock as it handles the request. As in NTP, the device time is
+ * taken to correspond to the midpoint of the round trip, give or take half the round trip.
+ *
+ * A line through the most recent exchanges, restricted to the faster half of them, gives the
+ * offset and the drift of the device clock.
+ */
+
+//  host time = host_time + (device time - device_time_us) * rate, for device times within ~35 minutes
+//  of `device_time_us`.
+struct DeviceClockEstimate {
+  TimePoint host_time;
+  uint32_t device_time_us;
+  //  Host seconds per device second.
+  double rate;
+  //  Half the shortest round trip in the fit plus the largest residual of the fit.
+  double error_bound_s;
+  double last_round_trip_s;
+  int num_exchanges;
+};
+
+struct DeviceClockSync {
+  static constexpr int capacity = 64;
+
+  struct Exchange {
+    //  Device time unwrapped to 64 bits, relative to the first exchange.
+    int64_t device_us;
+    //  Midpoint of the round trip, relative to `host_t0`.
+    double host_s;
+    double round_trip_s;
+  };
+
+  TimePoint host_t0{};
+  uint32_t last_device_time_us{};
+  int64_t last_device_us{};
+  Exchange exchanges[capacity]{};
+  int num_exchanges{};
+  int next_exchange{};
+};
+
+void clear(DeviceClockSync* sync);
+//  An exchange whose device time runs backwards, e.g. because the device was reset, starts over.
+void add_exchange(DeviceClockSync* sync, const TimePoint& sent, const TimePoint& received,
+                  uint32_t device_time_us);
+std::optional<DeviceClockEstimate> estimate(const DeviceClockSync& sync);
+
+TimePoint to_host_time(const DeviceClockEstimate& estimate, uint32_t device_time_us);
+
+}
@@ -1,6 +1,6 @@
 #include "juice_pump.hpp"
 #include "serial.hpp"
-#include "ringbuffer.hpp"
+#include "waitable_ringbuffer.hpp"
 #include <cassert>
 #include <thread>
 #include <mutex>
@@ -14,7 +14,9 @@ struct Config {
   static constexpr uint32_t serial_baud_rate = 19200;
   static constexpr uint32_t serial_timeout = 1000;
   static constexpr char serial_terminator = '\r';
-  static constexpr int max_num_pumps = 4;
+  static constexpr int max_num_pumps = 16;
+  //  Upper bound on how long the worker sleeps without commands, so that it notices termination.
+  static constexpr double worker_wait_timeout_s = 0.05;
 };
 
 enum class PumpCommandType {
@@ -221,7 +223,7 @@ struct {
   std::array<pump::PumpState, Config::max_num_pumps> desired_pump_state{};
   std::array<pump::PumpState, Config::max_num_pumps> canonical_pump_state{};
 
-  RingBuffer<PumpCommand, 1024> commands_to_pump;
+  WaitableRingBuffer<PumpCommand, 1024> commands_to_pump;
   std::vector<PumpCommand> pending_commands_to_pump;
 
   std::vector<PumpCommand> pending_commands_to_execute;
@@ -289,7 +291,7 @@ void worker(std::string port, int num_pumps) {
       pending_exec.clear();
     }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    global_data.commands_to_pump.wait_for_data(Config::worker_wait_timeout_s);
   }
 
   global_data.open_context = std::nullopt;
@@ -307,7 +309,7 @@ pump::PumpHandle pump::ith_pump(int i) {
 }
 
 void pump::initialize_pump_system(std::string port, int num_pumps) {
-  assert(num_pumps < Config::max_num_pumps);
+  assert(num_pumps <= Config::max_num_pumps);
 
   if (global_data.initialized) {
     terminate_pump_system();
@@ -386,6 +388,10 @@ void pump::submit_commands() {
   }
 }
 
+RingBufferStats pump::get_command_queue_stats() {
+  return global_data.commands_to_pump.stats();
+}
+
 pump::PumpState pump::read_desired_pump_state(PumpHandle pump) {
   assert(pump.index < uint32_t(Config::max_num_pumps));
   return global_data.desired_pump_state[pump.index];
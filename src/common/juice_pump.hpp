@@ -1,6 +1,7 @@
 #pragma once
 
 #include "identifier.hpp"
+#include "ringbuffer.hpp"
 #include <string>
 
 namespace om::pump {
@@ -45,5 +46,8 @@ void run_dispense_program(PumpHandle pump);
 void stop_dispense_program(PumpHandle pump);
 
 void submit_commands();
+//  A command counts as dropped each time `submit_commands` finds the queue full; it stays pending
+//  and is retried on the next call.
+RingBufferStats get_command_queue_stats();
 
 }
\ No newline at end of file
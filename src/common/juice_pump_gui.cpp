@@ -20,6 +20,12 @@ gui::JuicePumpGUIResult gui::render_juice_pump_gui(const JuicePumpGUIParams& par
 
   const auto enter_flag = ImGuiInputTextFlags_EnterReturnsTrue;
 
+  {
+    const auto queue_stats = om::pump::get_command_queue_stats();
+    ImGui::Text("CommandQueue: %d dropped | %d high water",
+                int(queue_stats.num_dropped), queue_stats.high_water_mark);
+  }
+
   if (om::pump::num_initialized_pumps() > 0) {
     bool allow_run = params.allow_automated_run;
     if (ImGui::Checkbox("AllowAutomatedRun", &allow_run)) {
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace om {
+
+/*
+ * LatencyHistogram - Fixed-size histogram of durations, in the manner of an HDR histogram.
+ * Durations below `sub_bucket_count` microseconds have a bucket each; above that, every power-of-two
+ * range is split into `sub_bucket_count / 2` equal buckets, so that a recorded value is known to
+ * within 1 / (sub_bucket_count / 2) of itself at any magnitude, up to `max_value_us`.
+ */
+
+struct LatencyHistogram {
+  static constexpr int sub_bucket_bits = 5;
+  static constexpr int sub_bucket_count = 1 << sub_bucket_bits;
+  static constexpr int sub_bucket_half_count = sub_bucket_count / 2;
+  static constexpr uint64_t max_value_us = 0xffffffffull;
+  static constexpr int num_buckets = (32 - sub_bucket_bits + 1) * sub_bucket_half_count + sub_bucket_half_count;
+
+  uint32_t counts[num_buckets];
+  uint64_t total_count;
+  uint64_t sum_us;
+  uint64_t min_us;
+  uint64_t max_us;
+};
+
+namespace detail {
+
+inline int highest_bit(uint64_t v) {
+  int result{};
+  while (v >>= 1) {
+    result++;
+  }
+  return result;
+}
+
+inline int latency_bucket_index(uint64_t us) {
+  constexpr int half_bits = LatencyHistogram::sub_bucket_bits - 1;
+  if (us < uint64_t(LatencyHistogram::sub_bucket_count)) {
+    return int(us);
+  }
+  const int shift = highest_bit(us) - half_bits;
+  return shift * LatencyHistogram::sub_bucket_half_count + int(us >> shift);
+}
+
+//  Smallest value recorded in bucket `index`.
+inline uint64_t latency_bucket_lower_bound(int index) {
+  if (index < LatencyHistogram::sub_bucket_count) {
+    return uint64_t(index);
+  }
+  const int shift = index / LatencyHistogram::sub_bucket_half_count - 1;
+  const uint64_t sub = uint64_t(index % LatencyHistogram::sub_bucket_half_count) +
+                       LatencyHistogram::sub_bucket_half_count;
+  return sub << shift;
+}
+
+}
+
+inline void clear(LatencyHistogram* hist) {
+  *hist = {};
+}
+
+inline void record(LatencyHistogram* hist, double seconds) {
+  const double us = std::max(0.0, seconds * 1e6);
+  const uint64_t value = us >= double(LatencyHistogram::max_value_us) ?
+    LatencyHistogram::max_value_us : uint64_t(us);
+  hist->counts[detail::latency_bucket_index(value)]++;
+  hist->min_us = hist->total_count == 0 ? value : std::min(hist->min_us, value);
+  hist->max_us = std::max(hist->max_us, value);
+  hist->sum_us += value;
+  hist->total_count++;
+}
+
+inline double mean_s(const LatencyHistogram& hist) {
+  return hist.total_count == 0 ? 0.0 : double(hist.sum_us) / double(hist.total_count) * 1e-6;
+}
+
+//  Smallest recorded duration that at least `percentile` percent of the recorded durations do not
+//  exceed, to the precision of its bucket.
+inline double percentile_s(const LatencyHistogram& hist, double percentile) {
+  if (hist.total_count == 0) {
+    return 0.0;
+  }
+  const double frac = std::min(100.0, std::max(0.0, percentile)) * 1e-2;
+  const uint64_t target = std::max(uint64_t(1), uint64_t(frac * double(hist.total_count) + 0.5));
+  uint64_t count{};
+  for (int i = 0; i < LatencyHistogram::num_buckets; i++) {
+    count += hist.counts[i];
+    if (count >= target) {
+      const uint64_t value = std::max(hist.min_us, std::min(
+        hist.max_us, detail::latency_bucket_lower_bound(i)));
+      return double(value) * 1e-6;
+    }
+  }
+  return double(hist.max_us) * 1e-6;
+}
+
+}
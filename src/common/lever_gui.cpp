@@ -40,6 +40,18 @@ gui::LeverGUIResult gui::render_lever_gui(const LeverGUIParams& params) {
     result.force_limit1 = force_lims[1];
   }
 
+  {
+    const auto queue_stats = om::lever::get_remote_queue_stats(lever_sys);
+    ImGui::Text("RemoteQueue: %d dropped | %d high water",
+                int(queue_stats.num_dropped), queue_stats.high_water_mark);
+  }
+
+  if (om::lever::is_recording(lever_sys)) {
+    const auto rec_stats = om::lever::get_recording_stats(lever_sys);
+    ImGui::Text("Recording: %d samples written | %d dropped%s", int(rec_stats.num_written),
+                int(rec_stats.num_dropped), rec_stats.write_failed ? " | WRITE FAILED" : "");
+  }
+
   for (int li = 0; li < params.num_levers; li++) {
     std::string tree_label{"Lever"};
     tree_label += std::to_string(li);
@@ -65,6 +77,9 @@ gui::LeverGUIResult gui::render_lever_gui(const LeverGUIParams& params) {
 
       if (open) {
         ImGui::Text("Connection is open.");
+      } else if (om::lever::is_reconnecting(lever_sys, lever)) {
+        ImGui::Text("Connection failed; reconnecting (attempt %d).",
+                    om::lever::get_num_reconnect_attempts(lever_sys, lever));
       } else {
         ImGui::Text("Connection is closed.");
       }
@@ -88,6 +103,53 @@ gui::LeverGUIResult gui::render_lever_gui(const LeverGUIParams& params) {
         ImGui::Text("Invalid direction.");
       }
 
+      if (ImGui::TreeNode("CommandLatency")) {
+        const auto latency = om::lever::get_command_latency_stats(lever_sys, lever);
+        for (int i = 0; i < om::lever::num_device_command_types(); i++) {
+          const auto& hist = latency.round_trip[i];
+          if (hist.total_count == 0 && latency.num_failed[i] == 0) {
+            continue;
+          }
+          ImGui::Text("%s: %d | p50 %0.2f ms | p99 %0.2f ms | max %0.2f ms | %d failed",
+                      om::lever::to_string(om::lever::DeviceCommandType(i)), int(hist.total_count),
+                      om::percentile_s(hist, 50.0) * 1e3, om::percentile_s(hist, 99.0) * 1e3,
+                      double(hist.max_us) * 1e-3, int(latency.num_failed[i]));
+        }
+        ImGui::TreePop();
+      }
+
+      {
+        auto dispatch = om::lever::get_command_dispatch_stats(lever_sys, lever);
+        ImGui::Text("Command dispatch: %d commands | last %0.3f ms | mean %0.3f ms | max %0.3f ms",
+                    int(dispatch.num_commands), dispatch.last_latency_s * 1e3,
+                    dispatch.mean_latency_s * 1e3, dispatch.max_latency_s * 1e3);
+        auto io = om::lever::get_io_stats(lever_sys, lever);
+        ImGui::Text("Serial: %d baud | %0.1f samples/s | %d samples | %d commands written",
+                    int(io.baud_rate), io.state_sample_rate_hz, int(io.num_state_samples),
+                    int(io.num_commands_written));
+        if (io.num_frames > 0) {
+          ImGui::Text("Frames: %d received | %d dropped | %d corrupt", int(io.num_frames),
+                      int(io.num_dropped_frames), int(io.num_corrupt_frames));
+        }
+        if (io.num_edge_frames > 0) {
+          ImGui::Text("Device pull edges: %d received | %d dropped", int(io.num_edge_frames),
+                      int(io.num_dropped_edge_frames));
+        }
+        if (auto clock = om::lever::get_clock_estimate(lever_sys, lever)) {
+          ImGui::Text("Device clock: %+0.1f ppm | +/- %0.3f ms | round trip %0.3f ms | %d exchanges",
+                      (clock.value().rate - 1.0) * 1e6, clock.value().error_bound_s * 1e3,
+                      clock.value().last_round_trip_s * 1e3, clock.value().num_exchanges);
+        }
+        if (auto sample = om::lever::get_latest_sample(lever_sys, lever)) {
+          ImGui::Text("Latest sample: %d | %d overwritten", int(sample.value().sequence),
+                      int(om::lever::get_num_overwritten_samples(lever_sys, lever)));
+        }
+        ImGui::Text("Skipped state updates: %d",
+                    int(om::lever::get_num_skipped_state_updates(lever_sys, lever)));
+        ImGui::Text("Dropped pull events: %d",
+                    int(om::lever::get_num_dropped_pull_events(lever_sys, lever)));
+      }
+
       int commanded_force = om::lever::get_commanded_force(lever_sys, lever);
       ImGui::SliderInt("SetForce", &commanded_force, force_lims[0], force_lims[1]);
       om::lever::set_force(lever_sys, lever, commanded_force);
@@ -99,7 +161,7 @@ gui::LeverGUIResult gui::render_lever_gui(const LeverGUIParams& params) {
         om::lever::set_direction(lever_sys, lever, new_dir);
       }
 
-      if (open) {
+      if (open || om::lever::is_reconnecting(lever_sys, lever)) {
         if (ImGui::Button("Terminate serial context")) {
           om::lever::close_connection(lever_sys, lever);
         }
@@ -2,6 +2,7 @@
 #include "./random.hpp"
 #include "./common.hpp"
 #include <cassert>
+#include <cmath>
 
 namespace om::lever {
 
@@ -33,6 +34,24 @@ PullDetectResult detect_pull(PullDetect* pd, const PullDetectParams& params) {
   return result;
 }
 
+float normalize_lever_position(float potentiometer_reading, const PullDetectConfig& config) {
+  float v{};
+  if (config.position_min != config.position_max) {
+    v = om::clamp(potentiometer_reading, config.position_min, config.position_max);
+    v = (v - config.position_min) / (config.position_max - config.position_min);
+  }
+  return config.invert_position ? 1.0f - v : v;
+}
+
+bool operator==(const PullDetectConfig& a, const PullDetectConfig& b) {
+  return a.enabled == b.enabled &&
+         a.position_min == b.position_min &&
+         a.position_max == b.position_max &&
+         a.invert_position == b.invert_position &&
+         a.rising_edge == b.rising_edge &&
+         a.falling_edge == b.falling_edge;
+}
+
 void start_automated_pull(AutomatedPull* pull, float current_force) {
   assert(pull->state == AutomatedPull::State::Idle && 
          pull->force_state == AutomatedPull::ForceTransitionState::Idle);
@@ -49,6 +68,16 @@ AutomatedPullResult update_automated_pull(AutomatedPull* pull, const AutomatedPu
     return result;
   }
 
+  if (params.run_on_device &&
+      pull->state == AutomatedPull::State::Forwards0 && !pull->state_last_time) {
+    result.run_profile = make_automated_pull_profile(pull->current_force, params);
+    pull->state = AutomatedPull::State::DeviceProfile;
+  }
+  if (pull->state == AutomatedPull::State::DeviceProfile) {
+    result.active = true;
+    return result;
+  }
+
   auto now_t = now();
   om::Duration dt{};
   if (pull->state_last_time) {
@@ -121,6 +150,13 @@ AutomatedPullResult update_automated_pull(AutomatedPull* pull, const AutomatedPu
       case AutomatedPull::State::Forwards1: {
         result.elapsed = true;
         pull->state = AutomatedPull::State::Idle;
+        break;
+      }
+      case AutomatedPull::State::Idle:
+      case AutomatedPull::State::DeviceProfile: {
+        //  Both returned early above.
+        assert(false);
+        break;
       }
     }
   }
@@ -131,7 +167,51 @@ AutomatedPullResult update_automated_pull(AutomatedPull* pull, const AutomatedPu
   return result;
 }
 
-om::lever::PullScheduleUpdateResult om::lever::update_pull_schedule(PullSchedule* pull) {
+void finish_automated_pull_profile(AutomatedPull* pull) {
+  assert(pull->state == AutomatedPull::State::DeviceProfile);
+  pull->state = AutomatedPull::State::Idle;
+  pull->force_state = AutomatedPull::ForceTransitionState::Idle;
+}
+
+void fall_back_from_automated_pull_profile(AutomatedPull* pull) {
+  assert(pull->state == AutomatedPull::State::DeviceProfile);
+  pull->state = AutomatedPull::State::Forwards0;
+  pull->force_state = AutomatedPull::ForceTransitionState::Transitioning;
+  pull->target_high = false;
+  //  A set start time keeps `update_automated_pull` from handing the pull to the device again.
+  pull->state_last_time = now();
+}
+
+//  The same sequence `update_automated_pull` steps through: forwards to the low force, reverse to
+//  the high force and back to the low force, then forwards to the high force, holding each force
+//  for the transition timeout. The device ramps from the force it last set, which need not be
+//  `current_force`, so the profile first steps to `current_force` without ramp or hold; each ramp
+//  then runs at `force_slope_g_s`.
+LeverForceProfile make_automated_pull_profile(float current_force, const AutomatedPullParams& params) {
+  const float slope = std::max(0.0f, params.force_slope_g_s);
+  const int hold_ms = int(std::round(params.force_transition_timeout_s * 1e3f));
+
+  LeverForceProfile result{};
+  float force = current_force;
+  auto add_segment = [&](SerialLeverDirection dir, float target, int hold) {
+    LeverForceSegment segment{};
+    segment.direction = dir;
+    segment.force = int(std::round(target));
+    segment.ramp_ms = slope > 0.0f ? int(std::ceil(std::abs(target - force) / slope * 1e3f)) : 0;
+    segment.hold_ms = hold;
+    result.segments[result.num_segments++] = segment;
+    force = target;
+  };
+
+  add_segment(SerialLeverDirection::Forward, current_force, 0);
+  add_segment(SerialLeverDirection::Forward, params.force_target_low, hold_ms);
+  add_segment(SerialLeverDirection::Reverse, params.force_target_high, hold_ms);
+  add_segment(SerialLeverDirection::Reverse, params.force_target_low, hold_ms);
+  add_segment(SerialLeverDirection::Forward, params.force_target_high, hold_ms);
+  return result;
+}
+
+PullScheduleUpdateResult update_pull_schedule(PullSchedule* pull) {
   om::lever::PullScheduleUpdateResult result{};
 
   auto curr_t = now();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "serial_lever.hpp"
 #include "time.hpp"
 #include <optional>
 
@@ -38,6 +39,18 @@ struct PullDetectParams {
   float current_position;
 };
 
+//  Settings for running `detect_pull` on raw lever states. The position passed to `detect_pull` is
+//  the potentiometer reading mapped from [position_min, position_max] to [0, 1], then inverted if
+//  `invert_position` is set.
+struct PullDetectConfig {
+  bool enabled;
+  float position_min;
+  float position_max;
+  bool invert_position;
+  float rising_edge;
+  float falling_edge;
+};
+
 struct PullDetectResult {
   bool pulled_lever;
   bool released_lever;
@@ -55,7 +68,9 @@ struct AutomatedPull {
     Forwards0,
     Reverse0,
     Reverse1,
-    Forwards1
+    Forwards1,
+    //  The whole sequence runs on the device as a force profile.
+    DeviceProfile
   };
 
   ForceTransitionState force_state;
@@ -71,6 +86,8 @@ struct AutomatedPullParams {
   float force_target_low{};
   float force_target_high{120.0f};
   float force_transition_timeout_s{0.125f};
+  //  Run the sequence on the device instead of setting the force from `update_automated_pull`.
+  bool run_on_device{true};
 };
 
 struct AutomatedPullResult {
@@ -78,12 +95,21 @@ struct AutomatedPullResult {
   bool active;
   std::optional<bool> set_direction;
   std::optional<float> set_force;
+  std::optional<LeverForceProfile> run_profile;
 };
 
 PullDetectResult detect_pull(PullDetect* pd, const PullDetectParams& params);
+float normalize_lever_position(float potentiometer_reading, const PullDetectConfig& config);
+bool operator==(const PullDetectConfig& a, const PullDetectConfig& b);
 
 void start_automated_pull(AutomatedPull* pull, float current_force);
 AutomatedPullResult update_automated_pull(AutomatedPull* pull, const AutomatedPullParams& params);
+//  Ends a pull that runs on the device, once its profile has completed.
+void finish_automated_pull_profile(AutomatedPull* pull);
+//  Restarts a pull whose profile failed on the device, e.g. because a reply to the upload was lost,
+//  so that `update_automated_pull` steps through it on the host instead.
+void fall_back_from_automated_pull_profile(AutomatedPull* pull);
+LeverForceProfile make_automated_pull_profile(float current_force, const AutomatedPullParams& params);
 
 PullScheduleUpdateResult update_pull_schedule(PullSchedule* pull);
 
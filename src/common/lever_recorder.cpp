@@ -0,0 +1,146 @@
+#include "lever_recorder.hpp"
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace om {
+
+namespace {
+
+using namespace lever;
+
+int64_t to_ns(const TimePoint& t) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+LeverRecordingHeader make_header() {
+  LeverRecordingHeader result{};
+  std::memcpy(result.magic, "OMLEVREC", sizeof(result.magic));
+  result.version = LeverRecorder::Config::version;
+  result.record_size = uint32_t(sizeof(LeverRecord));
+  return result;
+}
+
+//  Writes the pending records of the current recording; returns false if writing failed.
+bool drain(LeverRecorder* recorder, uint32_t recording_id, std::vector<LeverRecord>& batch) {
+  batch.clear();
+  recorder->records.drain([&batch, recording_id](LeverRecorder::PendingRecord& pending) {
+    if (pending.recording_id == recording_id) {
+      batch.push_back(pending.record);
+    }
+  });
+
+  if (batch.empty()) {
+    return true;
+  }
+  const size_t num_written = std::fwrite(batch.data(), sizeof(LeverRecord), batch.size(), recorder->file);
+  recorder->num_written += num_written;
+  return num_written == batch.size();
+}
+
+void writer(LeverRecorder* recorder, uint32_t recording_id) {
+  std::vector<LeverRecord> batch;
+  batch.reserve(LeverRecorder::Config::buffer_capacity);
+
+  bool ok{true};
+  while (recorder->keep_writing.load()) {
+    wait_for(&recorder->writer_wakeup, LeverRecorder::Config::flush_interval_s, [recorder]() {
+      return !recorder->keep_writing.load();
+    });
+    ok = ok && drain(recorder, recording_id, batch);
+  }
+
+  //  Write what was pushed before `stop` stopped accepting records.
+  ok = ok && drain(recorder, recording_id, batch);
+  ok = std::fflush(recorder->file) == 0 && ok;
+  if (!ok) {
+    recorder->write_failed.store(true);
+  }
+}
+
+} //  anon
+
+bool lever::start(LeverRecorder* recorder, const std::string& file_path, const TimePoint& t0) {
+  assert(!is_recording(*recorder));
+
+  recorder->file = std::fopen(file_path.c_str(), "wb");
+  if (!recorder->file) {
+    printf("Failed to open lever recording file: %s.\n", file_path.c_str());
+    return false;
+  }
+
+  const auto header = make_header();
+  if (std::fwrite(&header, sizeof(header), 1, recorder->file) != 1) {
+    std::fclose(recorder->file);
+    recorder->file = nullptr;
+    return false;
+  }
+
+  recorder->num_written.store(0);
+  recorder->num_dropped.store(0);
+  recorder->write_failed.store(false);
+  recorder->t0_ns.store(to_ns(t0));
+  const uint32_t recording_id = recorder->recording_id.load() + 1;
+  recorder->recording_id.store(recording_id);
+
+  recorder->keep_writing.store(true);
+  recorder->writer_thread = std::thread{[recorder, recording_id]() {
+    writer(recorder, recording_id);
+  }};
+  recorder->accepting.store(true);
+  return true;
+}
+
+void lever::stop(LeverRecorder* recorder) {
+  if (!is_recording(*recorder)) {
+    return;
+  }
+
+  recorder->accepting.store(false);
+  recorder->keep_writing.store(false);
+  notify(&recorder->writer_wakeup);
+  recorder->writer_thread.join();
+
+  if (std::fclose(recorder->file) != 0) {
+    recorder->write_failed.store(true);
+  }
+  recorder->file = nullptr;
+}
+
+bool lever::is_recording(const LeverRecorder& recorder) {
+  return recorder.file != nullptr;
+}
+
+LeverRecordingStats lever::get_stats(const LeverRecorder& recorder) {
+  LeverRecordingStats result{};
+  result.num_written = recorder.num_written.load();
+  result.num_dropped = recorder.num_dropped.load();
+  result.write_failed = recorder.write_failed.load();
+  return result;
+}
+
+void lever::push(LeverRecorder* recorder, int lever_index, const TimePoint& time,
+                 uint64_t sequence, const LeverState& state, int commanded_force,
+                 SerialLeverDirection commanded_direction) {
+  if (!recorder->accepting.load()) {
+    return;
+  }
+
+  LeverRecorder::PendingRecord pending{};
+  pending.recording_id = recorder->recording_id.load();
+  auto& record = pending.record;
+  record.time_ns = to_ns(time) - recorder->t0_ns.load();
+  record.sequence = sequence;
+  record.lever_index = uint16_t(lever_index);
+  record.commanded_direction = uint8_t(commanded_direction);
+  record.commanded_force = int32_t(commanded_force);
+  record.strain_gauge = state.strain_gauge;
+  record.calculated_pwm = state.calculated_pwm;
+  record.actual_pwm = state.actual_pwm;
+  record.potentiometer_reading = state.potentiometer_reading;
+  if (!recorder->records.maybe_write(pending)) {
+    recorder->num_dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "mpsc_queue.hpp"
+#include "serial_lever.hpp"
+#include "time.hpp"
+#include "wakeup.hpp"
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+namespace om::lever {
+
+/*
+ * Lever recording file format - A LeverRecordingHeader followed by LeverRecords, both packed and
+ * in host byte order (little-endian on every platform we run on). Records from all levers are
+ * interleaved in roughly the order the lever workers received them; order by `time_ns` within a
+ * lever if exact order matters.
+ */
+
+struct LeverRecordingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+};
+
+struct LeverRecord {
+  //  Time of receipt relative to the `t0` passed to `start`.
+  int64_t time_ns;
+  uint64_t sequence;
+  uint16_t lever_index;
+  uint8_t commanded_direction;
+  uint8_t reserved;
+  int32_t commanded_force;
+  float strain_gauge;
+  float calculated_pwm;
+  float actual_pwm;
+  float potentiometer_reading;
+};
+
+static_assert(sizeof(LeverRecordingHeader) == 16);
+static_assert(sizeof(LeverRecord) == 40);
+
+struct LeverRecordingStats {
+  uint64_t num_written;
+  //  Records that did not fit in the buffer because the writer thread fell behind.
+  uint64_t num_dropped;
+  bool write_failed;
+};
+
+/*
+ * LeverRecorder - Streams lever records to a file from a background thread. Each lever worker
+ * pushes records into a shared bounded queue without blocking or notifying; the writer thread
+ * wakes every `flush_interval_s` and writes whatever has accumulated.
+ */
+
+struct LeverRecorder {
+  struct Config {
+    static constexpr int buffer_capacity = 16384;
+    static constexpr double flush_interval_s = 0.1;
+    static constexpr uint32_t version = 1;
+  };
+
+  //  Records stay in the buffer if the worker pushes one just as recording stops. Tagging each
+  //  with the id of its recording lets the next recording discard them.
+  struct PendingRecord {
+    uint32_t recording_id;
+    LeverRecord record;
+  };
+
+  MPSCQueue<PendingRecord, Config::buffer_capacity> records;
+  std::atomic<uint64_t> num_dropped{};
+  std::atomic<uint32_t> recording_id{};
+  std::atomic<bool> accepting{};
+  //  `t0`, as nanoseconds since the clock's epoch.
+  std::atomic<int64_t> t0_ns{};
+
+  std::thread writer_thread;
+  std::atomic<bool> keep_writing{};
+  WakeupSignal writer_wakeup;
+  std::FILE* file{};
+  std::atomic<uint64_t> num_written{};
+  std::atomic<bool> write_failed{};
+};
+
+//  by owner.
+bool start(LeverRecorder* recorder, const std::string& file_path, const TimePoint& t0);
+void stop(LeverRecorder* recorder);
+bool is_recording(const LeverRecorder& recorder);
+LeverRecordingStats get_stats(const LeverRecorder& recorder);
+
+//  by producers. Does nothing unless recording.
+void push(LeverRecorder* recorder, int lever_index, const TimePoint& time, uint64_t sequence,
+          const LeverState& state, int commanded_force, SerialLeverDirection commanded_direction);
+
+}
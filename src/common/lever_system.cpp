@@ -1,47 +1,235 @@
 #include "lever_system.hpp"
+#include "lever_recorder.hpp"
+#include "line_buffer.hpp"
 #include "ringbuffer.hpp"
-#include "handshake.hpp"
+#include "sample_queue.hpp"
+#include "serial_port_watcher.hpp"
+#include "serial_reactor.hpp"
+#include "slot_map.hpp"
+#include "time.hpp"
+#include "triple_buffer.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <numeric>
 #include <thread>
 
 namespace om {
 
 namespace lever {
 
+struct Config {
+  //  The worker requests each open lever's state at most this often.
+  static constexpr double worker_poll_interval_s = 10e-3;
+  //  Force and direction are sent when they change, and re-sent at least this often in case the
+  //  device reset or missed a command.
+  static constexpr double command_refresh_interval_s = 1.0;
+  static constexpr double sample_rate_window_s = 1.0;
+  //  When set, levers push binary state frames at `state_stream_rate_hz` instead of being polled
+  //  with `s`. The text protocol stays in use for force and direction.
+  static constexpr bool use_binary_state_stream = false;
+  static constexpr int state_stream_rate_hz = 20;
+  //  When set, pull detection thresholds are sent to levers, which then report pull edges at their
+  //  own sampling rate. Levers that do not answer fall back to detection on the worker.
+  static constexpr bool use_device_pull_detection = true;
+  //  When set, the worker reads each lever's clock this often to relate it to host time.
+  static constexpr bool use_device_clock_sync = true;
+  static constexpr double clock_sync_interval_s = 0.5;
+  //  A lever is taken not to support edge thresholds or clock reads if it has never answered the
+  //  command, or has missed this many answers in a row; it is asked again at the next refresh.
+  static constexpr int max_num_consecutive_misses = 3;
+  //  When set, the worker asks each newly opened lever for these rates, fastest first, before
+  //  sending it anything else, and keeps the first one that works in both directions. Levers that
+  //  do not answer stay at `default_baud_rate()`; since a lever may still be starting up just after
+  //  the port opens, they are asked `max_num_baud_offer_timeouts` times before giving up.
+  static constexpr bool use_baud_negotiation = true;
+  static constexpr uint32_t negotiated_baud_rates[] = {2000000, 1000000, 500000, 230400, 115200};
+  static constexpr int max_num_baud_offer_timeouts = 2;
+  //  Time the device is given to switch rates before it is sent anything at the new one.
+  static constexpr double baud_switch_delay_s = 20e-3;
+  //  A port that fails is reopened after `initial_reconnect_delay_s`, and again after twice as long
+  //  each time that fails, up to `max_reconnect_delay_s`.
+  static constexpr double initial_reconnect_delay_s = 0.25;
+  static constexpr double max_reconnect_delay_s = 5.0;
+  //  Command latency histograms are handed to the ui thread at most this often.
+  static constexpr double latency_publish_interval_s = 0.5;
+  static constexpr int command_mailbox_capacity = 16;
+  //  A device that does not answer a command within this time is treated as having failed it.
+  static constexpr double response_timeout_s = double(default_read_write_timeout()) * 1e-3;
+  static constexpr int receive_buffer_capacity = 1024;
+  static constexpr int max_num_ready_devices = 16;
+  static constexpr int max_num_unsent_samples = 64;
+  static constexpr int sample_transfer_capacity = 256;
+  static constexpr int pull_event_capacity = 64;
+  //  About a minute of samples at the stream and poll rates in use.
+  static constexpr int sample_history_capacity = 8192;
+  //  At most one command of each type is in flight at a time.
+  static constexpr int max_num_in_flight_commands = num_device_command_types();
+  //  Levers are divided among workers so that each has at most this many, but there are no more
+  //  workers than cores left after `num_reserved_cores` for the ui, render and recorder threads.
+  static constexpr int max_num_levers_per_worker = 4;
+  static constexpr int num_reserved_cores = 2;
+};
+
+//  Force is re-sent at every refresh, which keeps a lever at a negotiated rate from timing out.
+static_assert(Config::command_refresh_interval_s * 1e3 < double(baud_idle_timeout_ms()));
+
 enum class SerialLeverError {
   None = 0,
   FailedToOpen = 1,
 };
 
+enum class BaudNegotiation {
+  Offering = 0,
+  Confirming,
+  Done,
+};
+
 enum class LeverMessageType {
   SetForceOrDirection = 0,
-  ShareState,
   OpenPort,
   ClosePort,
   PortStatus,
+  SetPullDetectConfig,
+  RunForceProfile,
 };
 
 struct LeverMessageData {
   SerialLeverHandle handle;
   LeverMessageType type;
-  std::optional<LeverState> state;
+  uint64_t sequence;
+  TimePoint sent_time;
   std::optional<int> force;
   std::optional<SerialLeverDirection> direction;
   std::string port;
   bool is_open;
   SerialLeverError error;
+  PullDetectConfig pull_detect_config;
+  LeverForceProfile force_profile;
+  uint64_t force_profile_run;
+};
+
+//  Most recent state of a lever, as last observed by the worker.
+struct LeverSnapshot {
+  std::optional<LeverState> state;
+  std::optional<int> force;
+  std::optional<SerialLeverDirection> direction;
+  bool is_open;
+  CommandDispatchStats dispatch_stats;
+  LeverIOStats io_stats;
+  std::optional<DeviceClockEstimate> clock_estimate;
+  uint64_t force_profile_run;
+  ForceProfileStatus force_profile_status;
+  bool reconnecting;
+  int num_reconnect_attempts;
+};
+
+//  A command written to a device whose response has not yet been read. The device answers
+//  commands in the order they were written.
+struct InFlightCommand {
+  DeviceCommandType type;
+  int force;
+  SerialLeverDirection direction;
+  int stream_rate_hz;
+  LeverEdgeThresholds edge_thresholds;
+  //  0 clears the device's profile, 1 to n add its segments, and n + 1 runs it.
+  int force_profile_step;
+  uint32_t baud_rate;
+  TimePoint sent_time;
+  TimePoint deadline;
+};
+
+//  Samples and device-reported pull events recorded by the worker since it last handed them to
+//  the ui thread.
+struct SampleOutbox {
+  LeverSample samples[Config::max_num_unsent_samples];
+  int size;
+  uint64_t next_sequence;
+  PullEvent pull_events[Config::max_num_unsent_samples];
+  int num_pull_events;
 };
 
 struct LeverSystem {
   struct RemoteInstance {
-    SerialContext serial_context;
+    //  Position in the array of handles passed to `initialize`.
+    int index{};
+    SerialPort port;
+    //  Set when a write failed part way, which leaves the device mid-command; the port is reopened.
+    bool write_failed{};
+    //  Port most recently requested by the ui thread, reopened by the worker if it fails.
+    std::string port_name;
+    //  Nonzero while an open request is with the port watcher.
+    uint64_t open_request_id{};
+    //  Set if the pending open was requested by the ui thread, which awaits its result.
+    bool answer_open{};
+    bool reconnecting{};
+    int num_reconnect_attempts{};
+    double reconnect_delay_s{};
+    TimePoint next_reconnect_time{};
+    uint32_t baud_rate{default_baud_rate()};
+    BaudNegotiation baud_negotiation{};
+    //  Index into `negotiated_baud_rates` of the rate being offered or confirmed.
+    int baud_candidate{};
+    int num_baud_offer_timeouts{};
+    //  Nothing is sent before this time, while the device switches rates.
+    TimePoint baud_settle_time{};
+    //  Bytes received but not yet split into complete text lines and binary frames.
+    LineBuffer<Config::receive_buffer_capacity> received;
+    InFlightCommand in_flight[Config::max_num_in_flight_commands];
+    int num_in_flight{};
+    //  Values most recently written to the device, or nullopt if they must be (re-)sent.
+    std::optional<int> sent_force;
+    std::optional<SerialLeverDirection> sent_direction;
+    std::optional<int> sent_stream_rate;
+    //  True once the device has acknowledged a non-zero stream rate.
+    bool streaming{};
+    TimePoint last_frame_time{};
+    std::optional<uint16_t> last_frame_sequence;
+    uint32_t device_time_us{};
+    //  Edge thresholds most recently written to the device, and those it last acknowledged.
+    std::optional<LeverEdgeThresholds> sent_edge_thresholds;
+    std::optional<LeverEdgeThresholds> device_edge_thresholds;
+    //  Set when the device stops answering the set-edge-thresholds command, until the next refresh,
+    //  at which it is asked again.
+    bool device_edges_unsupported{};
+    bool device_edges_answered{};
+    int num_edge_threshold_misses{};
+    std::optional<uint16_t> last_edge_sequence;
+    //  The profile of the most recent run request, and the one the device is known to hold.
+    LeverForceProfile force_profile{};
+    std::optional<LeverForceProfile> device_force_profile;
+    uint64_t force_profile_run{};
+    ForceProfileStatus force_profile_status{};
+    int force_profile_step{};
+    TimePoint force_profile_deadline{};
+    DeviceClockSync clock_sync{};
+    std::optional<DeviceClockEstimate> clock_estimate;
+    //  As for edge thresholds.
+    bool device_clock_unsupported{};
+    bool device_clock_answered{};
+    int num_clock_read_misses{};
+    TimePoint next_clock_time{};
+    CommandLatencyStats latency{};
+    bool need_publish_latency{};
+    TimePoint next_latency_publish_time{};
+    TimePoint next_refresh_time{};
+    TimePoint next_state_time{};
+    TimePoint sample_window_start{};
+    uint64_t num_samples_in_window{};
+    SampleOutbox sample_outbox{};
+    PullDetectConfig pull_detect_config{};
+    PullDetect pull_detect{};
     std::optional<LeverState> state;
     std::optional<int> force;
     std::optional<SerialLeverDirection> direction;
     int commanded_force{};
     SerialLeverDirection commanded_direction{SerialLeverDirection::Forward};
-    bool need_send_state{};
+    bool need_publish_snapshot{};
     std::optional<SerialLeverError> open_response;
+    CommandDispatchStats dispatch_stats{};
+    LeverIOStats io_stats{};
   };
 
   struct LocalInstance {
@@ -49,26 +237,70 @@ struct LeverSystem {
     std::optional<int> pending_canonical_force;
     std::optional<std::string> pending_open_port;
     std::optional<SerialLeverDirection> pending_canonical_direction;
+    std::optional<PullDetectConfig> pending_pull_detect_config;
+    PullDetectConfig pull_detect_config{};
+    std::optional<LeverForceProfile> pending_force_profile;
+    uint64_t force_profile_run{};
+    ForceProfileStatus force_profile_status{};
     bool pending_close_port{};
     int commanded_force{};
     SerialLeverDirection commanded_direction{SerialLeverDirection::Forward};
     std::optional<int> canonical_force;
     std::optional<SerialLeverDirection> canonical_direction;
     std::optional<LeverState> state;
-    Handshake<LeverMessageData> message;
+    CommandDispatchStats dispatch_stats{};
+    LeverIOStats io_stats{};
+    std::optional<DeviceClockEstimate> clock_estimate;
+    CommandLatencyStats latency{};
+    //  Published by the worker every `latency_publish_interval_s` while commands complete.
+    TripleBuffer<CommandLatencyStats> latest_latency;
+    //  Commands from the ui thread to the worker, in the order they were issued.
+    RingBuffer<LeverMessageData, Config::command_mailbox_capacity> commands;
+    uint64_t next_command_sequence{1};
+    //  Overwritten by the worker; the ui thread reads only the freshest snapshot.
+    TripleBuffer<LeverSnapshot> latest;
+    //  Every sample, in order. Drained by the ui thread into `history` on each update.
+    RingBuffer<LeverSample, Config::sample_transfer_capacity,
+               RingBufferStackStorage<LeverSample, Config::sample_transfer_capacity>,
+               RingBufferFullPolicy::OverwriteOldest> samples;
+    SampleQueue<LeverSample> history;
+    RingBuffer<PullEvent, Config::pull_event_capacity> pull_events;
 
+    //  Index of the worker that serves the lever.
+    int worker{};
     bool awaiting_open{};
     bool is_open{};
+    bool reconnecting{};
+    int num_reconnect_attempts{};
   };
 
-  std::thread worker_thread;
-  std::atomic<bool> keep_processing{};
+  //  A thread that serves a fixed subset of the levers, waiting on their ports with its own reactor,
+  //  so that a lever's input is handled as soon as it arrives regardless of the others.
+  struct Worker {
+    int index{};
+    std::thread thread;
+    SerialReactor reactor;
+    std::vector<SerialLeverHandle> levers;
+    //  Port status responses to the ui thread.
+    RingBuffer<LeverMessageData, 8> read_remote;
+    uint64_t next_open_request_id{1};
+    uint64_t num_device_changes{};
+    //  by ui thread
+    bool wake_pending{};
+  };
 
-  std::vector<std::unique_ptr<LocalInstance>> local_instances;
-  std::vector<std::unique_ptr<RemoteInstance>> remote_instances;
-  RingBuffer<LeverMessageData, 8> read_remote;
+  std::atomic<bool> keep_processing{};
+  std::vector<std::unique_ptr<Worker>> workers;
+  //  Opens ports off the workers, since an open can block for seconds on some drivers. Each worker
+  //  is one of its clients.
+  SerialPortWatcher port_watcher;
+  //  by ui thread
+  std::vector<PortDescriptor> serial_ports;
 
-  uint32_t instance_id{1};
+  //  Filled in lockstep, so that a lever's local and remote instances share a handle.
+  SlotMap<SerialLeverHandle, std::unique_ptr<LocalInstance>> local_instances;
+  SlotMap<SerialLeverHandle, std::unique_ptr<RemoteInstance>> remote_instances;
+  LeverRecorder recorder;
 };
 
 } //  lever
@@ -82,12 +314,8 @@ struct {
 } globals;
 
 LeverSystem::LocalInstance* find_local_instance(LeverSystem* sys, SerialLeverHandle handle) {
-  for (auto& inst : sys->local_instances) {
-    if (inst->handle == handle) {
-      return inst.get();
-    }
-  }
-  return nullptr;
+  auto* inst = sys->local_instances.find(handle);
+  return inst ? inst->get() : nullptr;
 }
 
 LeverMessageData make_set_force_and_direction_message(std::optional<int> force, std::optional<SerialLeverDirection> dir) {
@@ -105,6 +333,21 @@ LeverMessageData make_open_port_message(std::string&& port) {
   return result;
 }
 
+LeverMessageData make_set_pull_detect_config_message(const PullDetectConfig& config) {
+  LeverMessageData result{};
+  result.type = LeverMessageType::SetPullDetectConfig;
+  result.pull_detect_config = config;
+  return result;
+}
+
+LeverMessageData make_run_force_profile_message(const LeverForceProfile& profile, uint64_t run) {
+  LeverMessageData result{};
+  result.type = LeverMessageType::RunForceProfile;
+  result.force_profile = profile;
+  result.force_profile_run = run;
+  return result;
+}
+
 LeverMessageData make_close_port_message() {
   LeverMessageData result{};
   result.type = LeverMessageType::ClosePort;
@@ -121,19 +364,193 @@ LeverMessageData make_port_status_message(SerialLeverHandle handle,
   return result;
 }
 
-LeverMessageData make_share_state_message(const LeverSystem::RemoteInstance& remote,
-                                          SerialLeverHandle handle) {
-  LeverMessageData message{};
-  message.type = LeverMessageType::ShareState;
-  message.force = remote.force;
-  message.direction = remote.direction;
-  message.state = remote.state;
-  message.handle = handle;
-  message.is_open = is_open(remote.serial_context);
-  return message;
+LeverSnapshot make_snapshot(const LeverSystem::RemoteInstance& remote) {
+  LeverSnapshot result{};
+  result.state = remote.state;
+  result.force = remote.force;
+  result.direction = remote.direction;
+  result.is_open = is_open(remote.port);
+  result.dispatch_stats = remote.dispatch_stats;
+  result.io_stats = remote.io_stats;
+  result.clock_estimate = remote.clock_estimate;
+  result.force_profile_run = remote.force_profile_run;
+  result.force_profile_status = remote.force_profile_status;
+  result.reconnecting = remote.reconnecting;
+  result.num_reconnect_attempts = remote.num_reconnect_attempts;
+  return result;
+}
+
+bool is_force_profile_active(const LeverSystem::RemoteInstance& remote) {
+  return remote.force_profile_status == ForceProfileStatus::Loading ||
+         remote.force_profile_status == ForceProfileStatus::Running;
+}
+
+void reset_remote_instance(LeverSystem::Worker& worker, LeverSystem::RemoteInstance& remote) {
+  if (is_open(remote.port)) {
+    if (remote.baud_rate != default_baud_rate()) {
+      //  Return the device to the default rate, at which it is reopened.
+      char formatted[max_lever_command_size()];
+      int size = format_negotiate_baud_command(
+        default_baud_rate(), formatted, int(sizeof(formatted)));
+      (void) write_nonblocking(&remote.port, formatted, size);
+    }
+    remove_port(&worker.reactor, &remote.port);
+    close_serial_port(&remote.port);
+  }
+  auto stats = remote.dispatch_stats;
+  auto io_stats = remote.io_stats;
+  auto latency = remote.latency;
+  auto sample_outbox = remote.sample_outbox;
+  const int index = remote.index;
+  const auto pull_detect_config = remote.pull_detect_config;
+  const auto force_profile_run = remote.force_profile_run;
+  const bool force_profile_failed = is_force_profile_active(remote);
+  remote = {};
+  remote.index = index;
+  remote.pull_detect_config = pull_detect_config;
+  remote.force_profile_run = force_profile_run;
+  if (force_profile_failed) {
+    remote.force_profile_status = ForceProfileStatus::Failed;
+  }
+  remote.sample_outbox = sample_outbox;
+  remote.dispatch_stats = stats;
+  remote.io_stats = io_stats;
+  remote.io_stats.state_sample_rate_hz = 0.0;
+  remote.io_stats.baud_rate = 0;
+  remote.latency = latency;
+  remote.need_publish_latency = true;
+}
+
+void record_dispatch(LeverSystem::RemoteInstance& remote, const LeverMessageData& data) {
+  const double latency = elapsed_time(data.sent_time, now());
+  auto& stats = remote.dispatch_stats;
+  stats.num_commands++;
+  stats.last_sequence = data.sequence;
+  stats.last_latency_s = latency;
+  stats.max_latency_s = std::max(stats.max_latency_s, latency);
+  stats.mean_latency_s += (latency - stats.mean_latency_s) / double(stats.num_commands);
 }
 
-bool process_remote_message(LeverSystem::RemoteInstance& remote, LeverMessageData&& data) {
+bool submit_open_request(LeverSystem* system, LeverSystem::Worker& worker,
+                         LeverSystem::RemoteInstance& remote) {
+  assert(!remote.open_request_id && !is_open(remote.port));
+  SerialPortOpenRequest request{};
+  request.id = worker.next_open_request_id++;
+  request.port = remote.port_name;
+  request.baud = default_baud_rate();
+  if (!submit_open(&system->port_watcher, worker.index, std::move(request))) {
+    return false;
+  }
+  remote.open_request_id = worker.next_open_request_id - 1;
+  return true;
+}
+
+void schedule_reconnect(LeverSystem::RemoteInstance& remote, const TimePoint& t) {
+  remote.next_reconnect_time = t + std::chrono::duration_cast<TimePoint::duration>(
+    Duration(remote.reconnect_delay_s));
+  remote.reconnect_delay_s = std::min(remote.reconnect_delay_s * 2.0, Config::max_reconnect_delay_s);
+}
+
+//  Closes the failed port, keeping what is needed to reopen it and restore the commanded settings.
+void begin_reconnect(LeverSystem::Worker& worker, LeverSystem::RemoteInstance& remote,
+                     const TimePoint& t) {
+  auto port_name = std::move(remote.port_name);
+  const int commanded_force = remote.commanded_force;
+  const auto commanded_direction = remote.commanded_direction;
+  reset_remote_instance(worker, remote);
+  if (port_name.empty()) {
+    return;
+  }
+  remote.port_name = std::move(port_name);
+  remote.commanded_force = commanded_force;
+  remote.commanded_direction = commanded_direction;
+  remote.reconnecting = true;
+  remote.reconnect_delay_s = Config::initial_reconnect_delay_s;
+  schedule_reconnect(remote, t);
+}
+
+void step_reconnect(LeverSystem* system, LeverSystem::Worker& worker,
+                    LeverSystem::RemoteInstance& remote, const TimePoint& t) {
+  if (remote.reconnecting && !remote.open_request_id && t >= remote.next_reconnect_time) {
+    if (submit_open_request(system, worker, remote)) {
+      remote.num_reconnect_attempts++;
+      remote.need_publish_snapshot = true;
+    } else {
+      schedule_reconnect(remote, t);
+    }
+  }
+}
+
+void apply_open_result(LeverSystem::Worker& worker, LeverSystem::RemoteInstance& remote,
+                       std::optional<SerialPort>&& port) {
+  remote.open_request_id = 0;
+  bool opened{};
+  if (port) {
+    remote.port = std::move(port.value());
+    if (add_port(&worker.reactor, &remote.port, &remote)) {
+      opened = true;
+    } else {
+      close_serial_port(&remote.port);
+    }
+  }
+
+  const auto t = now();
+  if (opened) {
+    remote.io_stats.baud_rate = remote.baud_rate;
+    remote.sample_window_start = t;
+    if (remote.reconnecting) {
+      remote.io_stats.num_reconnections++;
+      remote.reconnecting = false;
+      remote.num_reconnect_attempts = 0;
+    }
+  } else if (remote.reconnecting) {
+    schedule_reconnect(remote, t);
+  }
+
+  if (remote.answer_open) {
+    remote.open_response = opened ? SerialLeverError::None : SerialLeverError::FailedToOpen;
+    remote.answer_open = false;
+  }
+  remote.need_publish_snapshot = true;
+}
+
+//  Results are matched to levers by request id; those of superseded requests are closed.
+void take_open_results(LeverSystem* system, LeverSystem::Worker& worker) {
+  while (auto result = take_open_result(&system->port_watcher, worker.index)) {
+    LeverSystem::RemoteInstance* target{};
+    for (auto handle : worker.levers) {
+      auto* remote = system->remote_instances.at(handle).get();
+      if (remote->open_request_id == result.value().id) {
+        target = remote;
+        break;
+      }
+    }
+    if (target) {
+      apply_open_result(worker, *target, std::move(result.value().port));
+    } else if (result.value().port) {
+      close_serial_port(&result.value().port.value());
+    }
+  }
+}
+
+//  A device was added or removed, perhaps the one a lever is waiting for; try again now.
+void retry_reconnects(LeverSystem* system, LeverSystem::Worker& worker, const TimePoint& t) {
+  const uint64_t num_changes = num_device_changes(system->port_watcher);
+  if (num_changes == worker.num_device_changes) {
+    return;
+  }
+  worker.num_device_changes = num_changes;
+  for (auto handle : worker.levers) {
+    auto* remote = system->remote_instances.at(handle).get();
+    if (remote->reconnecting && !remote->open_request_id) {
+      remote->reconnect_delay_s = Config::initial_reconnect_delay_s;
+      remote->next_reconnect_time = t;
+    }
+  }
+}
+
+bool process_remote_message(LeverSystem* system, LeverSystem::Worker& worker,
+                            LeverSystem::RemoteInstance& remote, LeverMessageData&& data) {
   switch (data.type) {
     case LeverMessageType::SetForceOrDirection: {
       if (data.force) {
@@ -147,25 +564,43 @@ bool process_remote_message(LeverSystem::RemoteInstance& remote, LeverMessageDat
 
     case LeverMessageType::OpenPort: {
       assert(!remote.open_response);
-      remote = {};
-      auto serial_res = om::make_context(
-        data.port, om::default_baud_rate(), om::default_read_write_timeout());
-#if 0
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      remote.open_response = SerialLeverError::FailedToOpen;
-#else
-      if (serial_res) {
-        remote.serial_context = std::move(serial_res.value());
-        remote.open_response = SerialLeverError::None;
+      //  Supersedes any pending open, whose result is then discarded.
+      reset_remote_instance(worker, remote);
+      remote.port_name = std::move(data.port);
+      if (submit_open_request(system, worker, remote)) {
+        remote.answer_open = true;
       } else {
         remote.open_response = SerialLeverError::FailedToOpen;
       }
-#endif
       return true;
     }
 
     case LeverMessageType::ClosePort: {
-      remote = {};
+      reset_remote_instance(worker, remote);
+      return true;
+    }
+
+    case LeverMessageType::SetPullDetectConfig: {
+      remote.pull_detect_config = data.pull_detect_config;
+      return false;
+    }
+
+    case LeverMessageType::RunForceProfile: {
+      auto& profile = data.force_profile;
+      assert(profile.num_segments > 0 && profile.num_segments <= max_lever_force_profile_segments());
+      remote.force_profile = profile;
+      remote.force_profile_run = data.force_profile_run;
+      if (!is_open(remote.port)) {
+        remote.force_profile_status = ForceProfileStatus::Failed;
+        return true;
+      }
+      remote.force_profile_status = ForceProfileStatus::Loading;
+      const bool loaded = remote.device_force_profile && remote.device_force_profile.value() == profile;
+      remote.force_profile_step = loaded ? profile.num_segments + 1 : 0;
+      //  The device is left at the end of the profile.
+      auto& last = profile.segments[profile.num_segments - 1];
+      remote.commanded_force = last.force;
+      remote.commanded_direction = last.direction;
       return true;
     }
 
@@ -176,66 +611,868 @@ bool process_remote_message(LeverSystem::RemoteInstance& remote, LeverMessageDat
   }
 }
 
-void process_remote_instance(LeverSystem* system, LeverSystem::RemoteInstance& remote,
-                             LeverSystem::LocalInstance& local) {
-  if (auto data = read(&local.message)) {
-    if (process_remote_message(remote, std::move(data.value()))) {
-      remote.need_send_state = true;
+bool is_in_flight(const LeverSystem::RemoteInstance& remote, DeviceCommandType type) {
+  for (int i = 0; i < remote.num_in_flight; i++) {
+    if (remote.in_flight[i].type == type) {
+      return true;
     }
   }
+  return false;
+}
 
-  const bool open = is_open(remote.serial_context);
-  if (remote.open_response) {
-    auto message = make_port_status_message(local.handle, remote.open_response.value(), open);
-    if (system->read_remote.maybe_write(message)) {
-      remote.open_response = std::nullopt;
+bool need_send_force(const LeverSystem::RemoteInstance& remote) {
+  return remote.sent_force != remote.commanded_force && !is_force_profile_active(remote) &&
+         !is_in_flight(remote, DeviceCommandType::SetForce);
+}
+
+bool need_send_direction(const LeverSystem::RemoteInstance& remote) {
+  return remote.sent_direction != remote.commanded_direction && !is_force_profile_active(remote) &&
+         !is_in_flight(remote, DeviceCommandType::SetDirection);
+}
+
+int num_negotiated_baud_rates() {
+  return int(std::size(Config::negotiated_baud_rates));
+}
+
+bool is_negotiating_baud(const LeverSystem::RemoteInstance& remote) {
+  return Config::use_baud_negotiation && remote.baud_negotiation != BaudNegotiation::Done;
+}
+
+//  Whether a device that has missed its last `misses` answers to a command is taken not to support
+//  it, given whether it has ever `answered` it.
+bool is_unsupported_after_miss(bool answered, int misses) {
+  return !answered || misses >= Config::max_num_consecutive_misses;
+}
+
+bool need_send_clock_read(const LeverSystem::RemoteInstance& remote) {
+  return Config::use_device_clock_sync && !remote.device_clock_unsupported &&
+         !is_in_flight(remote, DeviceCommandType::ReadClock);
+}
+
+//  Profile commands are sent one at a time, since each depends on the success of the last.
+bool need_send_force_profile_step(const LeverSystem::RemoteInstance& remote) {
+  return remote.force_profile_status == ForceProfileStatus::Loading &&
+         !is_in_flight(remote, DeviceCommandType::ForceProfile);
+}
+
+bool need_send_stream_rate(const LeverSystem::RemoteInstance& remote) {
+  return Config::use_binary_state_stream &&
+         remote.sent_stream_rate != Config::state_stream_rate_hz &&
+         !is_in_flight(remote, DeviceCommandType::StreamState);
+}
+
+//  Device thresholds equivalent to `config`, which is in normalized lever positions.
+LeverEdgeThresholds to_device_edge_thresholds(const PullDetectConfig& config) {
+  if (!config.enabled) {
+    return {};
+  }
+  auto to_reading = [&config](float edge) {
+    const float v = config.invert_position ? 1.0f - edge : edge;
+    return int(std::lround(config.position_min + v * (config.position_max - config.position_min)));
+  };
+  return {to_reading(config.rising_edge), to_reading(config.falling_edge)};
+}
+
+bool need_send_edge_thresholds(const LeverSystem::RemoteInstance& remote) {
+  return Config::use_device_pull_detection && !remote.device_edges_unsupported &&
+         remote.sent_edge_thresholds != to_device_edge_thresholds(remote.pull_detect_config) &&
+         !is_in_flight(remote, DeviceCommandType::SetEdgeThresholds);
+}
+
+//  True while the device reports pull edges, in which case the worker does not look for them.
+bool device_detects_pulls(const LeverSystem::RemoteInstance& remote) {
+  return remote.device_edge_thresholds &&
+         remote.device_edge_thresholds.value().rising != remote.device_edge_thresholds.value().falling;
+}
+
+TimePoint stream_deadline(const LeverSystem::RemoteInstance& remote) {
+  return remote.last_frame_time + std::chrono::duration_cast<TimePoint::duration>(
+    Duration(Config::response_timeout_s));
+}
+
+void send_command(LeverSystem::RemoteInstance& remote, InFlightCommand command, const TimePoint& t) {
+  assert(remote.num_in_flight < Config::max_num_in_flight_commands);
+
+  char formatted[max_lever_command_size()];
+  auto written = SerialWriteResult::Failed;
+  switch (command.type) {
+    case DeviceCommandType::SetForce: {
+      int size = format_set_force_command(command.force, formatted, int(sizeof(formatted)));
+      written = write_nonblocking(&remote.port, formatted, size);
+      break;
+    }
+    case DeviceCommandType::SetDirection: {
+      const char* str = make_set_direction_command(command.direction);
+      written = write_nonblocking(&remote.port, str, int(std::strlen(str)));
+      break;
+    }
+    case DeviceCommandType::ReadState: {
+      const char* str = make_read_state_command();
+      written = write_nonblocking(&remote.port, str, int(std::strlen(str)));
+      break;
+    }
+    case DeviceCommandType::ReadClock: {
+      const char* str = make_read_clock_command();
+      written = write_nonblocking(&remote.port, str, int(std::strlen(str)));
+      break;
+    }
+    case DeviceCommandType::NegotiateBaud: {
+      int size = format_negotiate_baud_command(
+        command.baud_rate, formatted, int(sizeof(formatted)));
+      written = write_nonblocking(&remote.port, formatted, size);
+      break;
+    }
+    case DeviceCommandType::StreamState: {
+      int size = format_stream_state_command(
+        command.stream_rate_hz, formatted, int(sizeof(formatted)));
+      written = write_nonblocking(&remote.port, formatted, size);
+      break;
+    }
+    case DeviceCommandType::SetEdgeThresholds: {
+      int size = format_set_edge_thresholds_command(
+        command.edge_thresholds, formatted, int(sizeof(formatted)));
+      written = write_nonblocking(&remote.port, formatted, size);
+      break;
+    }
+    case DeviceCommandType::ForceProfile: {
+      const int step = command.force_profile_step;
+      const int num_segments = remote.force_profile.num_segments;
+      if (step == 0 || step > num_segments) {
+        const char* str = step == 0 ?
+          make_clear_force_profile_command() : make_run_force_profile_command();
+        written = write_nonblocking(&remote.port, str, int(std::strlen(str)));
+      } else {
+        int size = format_add_force_segment_command(
+          remote.force_profile.segments[step - 1], formatted, int(sizeof(formatted)));
+        written = write_nonblocking(&remote.port, formatted, size);
+      }
+      break;
+    }
+    default: {
+      assert(false);
     }
   }
 
-  if (open) {
-    remote.need_send_state = true;
+  command.sent_time = t;
+  if (written == SerialWriteResult::Written) {
+    command.deadline = t + std::chrono::duration_cast<TimePoint::duration>(
+      Duration(Config::response_timeout_s));
+  } else {
+    //  Fail the command on the next step rather than waiting for a response that cannot come.
+    command.deadline = t;
+    remote.write_failed = remote.write_failed || written == SerialWriteResult::Failed;
+  }
+
+  remote.in_flight[remote.num_in_flight++] = command;
+  remote.io_stats.num_commands_written++;
+}
+
+//  Returns the sequence number of the new sample.
+uint64_t record_state_sample(LeverSystem::RemoteInstance& remote, const TimePoint& t,
+                             std::optional<uint32_t> device_time_us = std::nullopt) {
+  assert(remote.state);
+  auto& outbox = remote.sample_outbox;
+  const uint64_t sequence = outbox.next_sequence++;
+  //  The outbox is emptied on every pass of the worker loop, so it only fills if a single read
+  //  returns an implausible number of samples. The gap in sequence numbers records the loss.
+  if (outbox.size < Config::max_num_unsent_samples) {
+    LeverSample sample{};
+    sample.time = t;
+    sample.sequence = sequence;
+    sample.state = remote.state.value();
+    sample.device_time_us = device_time_us;
+    outbox.samples[outbox.size++] = sample;
+  }
+
+  remote.io_stats.num_state_samples++;
+  remote.num_samples_in_window++;
+  const double window = elapsed_time(remote.sample_window_start, t);
+  if (window >= Config::sample_rate_window_s) {
+    remote.io_stats.state_sample_rate_hz = double(remote.num_samples_in_window) / window;
+    remote.sample_window_start = t;
+    remote.num_samples_in_window = 0;
+  }
+  return sequence;
+}
+
+//  Moves on to the next slower rate, once the device has given up on the current one.
+void reject_baud_candidate(LeverSystem::RemoteInstance& remote, const TimePoint& settle_time) {
+  remote.baud_settle_time = settle_time;
+  if (++remote.baud_candidate < num_negotiated_baud_rates()) {
+    remote.baud_negotiation = BaudNegotiation::Offering;
+  } else {
+    remote.baud_negotiation = BaudNegotiation::Done;
+  }
+}
+
+void complete_baud_negotiation(LeverSystem::RemoteInstance& remote, const InFlightCommand& command,
+                               std::optional<std::string_view> response, const TimePoint& t) {
+  const auto rate = response ? parse_baud_rate(*response) : std::nullopt;
+  const auto switch_delay = std::chrono::duration_cast<TimePoint::duration>(
+    Duration(Config::baud_switch_delay_s));
+  //  A device that switched but is not confirmed at the new rate returns to the default rate.
+  const auto device_revert_time = t + switch_delay + std::chrono::duration_cast<TimePoint::duration>(
+    Duration(double(baud_confirm_window_ms()) * 1e-3));
 
-    if (auto resp = om::set_force_grams(remote.serial_context, remote.commanded_force)) {
-      remote.force = remote.commanded_force;
+  if (remote.baud_negotiation == BaudNegotiation::Offering) {
+    if (!rate) {
+      //  Devices without negotiation do not answer.
+      if (response || ++remote.num_baud_offer_timeouts >= Config::max_num_baud_offer_timeouts) {
+        remote.baud_negotiation = BaudNegotiation::Done;
+      }
+    } else if (rate.value() != command.baud_rate) {
+      reject_baud_candidate(remote, t);
+    } else if (set_baud_rate(&remote.port, command.baud_rate)) {
+      //  The device switches as soon as it has answered; whatever arrives meanwhile is garbled.
+      clear(&remote.received);
+      remote.baud_rate = command.baud_rate;
+      remote.baud_negotiation = BaudNegotiation::Confirming;
+      remote.baud_settle_time = t + switch_delay;
     } else {
-      remote.force = std::nullopt;
+      reject_baud_candidate(remote, device_revert_time);
     }
 
-    if (auto resp = om::set_lever_direction(remote.serial_context, remote.commanded_direction)) {
-      remote.direction = remote.commanded_direction;
-    } else {
-      remote.direction = std::nullopt;
+  } else if (rate && rate.value() == command.baud_rate) {
+    remote.baud_negotiation = BaudNegotiation::Done;
+
+  } else {
+    //  The link does not work at the new rate.
+    set_baud_rate(&remote.port, default_baud_rate());
+    clear(&remote.received);
+    remote.baud_rate = default_baud_rate();
+    reject_baud_candidate(remote, device_revert_time);
+  }
+
+  remote.io_stats.baud_rate = remote.baud_rate;
+}
+
+//  Whether `line` has the shape of the device's response to `command`.
+bool answers(const LeverSystem::RemoteInstance& remote, const InFlightCommand& command,
+             std::string_view line) {
+  switch (command.type) {
+    case DeviceCommandType::SetForce:
+      return parse_lever_force(line).has_value();
+    case DeviceCommandType::SetDirection:
+      return parse_lever_direction(line).has_value();
+    case DeviceCommandType::ReadState:
+      return parse_lever_state(line).has_value();
+    case DeviceCommandType::StreamState:
+      return parse_stream_rate(line).has_value();
+    case DeviceCommandType::SetEdgeThresholds:
+      return parse_edge_thresholds(line).has_value();
+    case DeviceCommandType::ReadClock:
+      return parse_device_clock(line).has_value();
+    case DeviceCommandType::NegotiateBaud:
+      return parse_baud_rate(line).has_value();
+    case DeviceCommandType::ForceProfile:
+      return command.force_profile_step > remote.force_profile.num_segments ?
+        parse_force_profile_started(line).has_value() : parse_force_profile_size(line).has_value();
+    default: {
+      assert(false);
+      return false;
     }
+  }
+}
 
-    if (auto state = om::read_state(remote.serial_context)) {
-      remote.state = state.value();
-    } else {
-      remote.state = std::nullopt;
+//  Index of the oldest command in flight that `line` answers, or -1.
+int find_answered_command(const LeverSystem::RemoteInstance& remote, std::string_view line) {
+  for (int i = 0; i < remote.num_in_flight; i++) {
+    if (answers(remote, remote.in_flight[i], line)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//  Apply the device's response to the oldest command in flight, or its absence when the command
+//  timed out or the device skipped it.
+void complete_command(LeverSystem::RemoteInstance& remote,
+                      std::optional<std::string_view> response, const TimePoint& t) {
+  assert(remote.num_in_flight > 0);
+  const InFlightCommand command = remote.in_flight[0];
+  std::copy(remote.in_flight + 1, remote.in_flight + remote.num_in_flight, remote.in_flight);
+  remote.num_in_flight--;
+
+  const int type_index = int(command.type);
+  if (response) {
+    record(&remote.latency.round_trip[type_index], elapsed_time(command.sent_time, t));
+  } else {
+    remote.latency.num_failed[type_index]++;
+  }
+  remote.need_publish_latency = true;
+
+  //  A failed force or direction command is retried shortly, rather than at the next refresh.
+  const auto retry_time = t + std::chrono::duration_cast<TimePoint::duration>(
+    Duration(Config::worker_poll_interval_s));
+
+  switch (command.type) {
+    case DeviceCommandType::SetForce: {
+      if (response && parse_lever_force(*response)) {
+        remote.force = command.force;
+      } else {
+        remote.force = std::nullopt;
+        remote.next_refresh_time = std::min(remote.next_refresh_time, retry_time);
+      }
+      break;
+    }
+    case DeviceCommandType::SetDirection: {
+      if (response && parse_lever_direction(*response) == command.direction) {
+        remote.direction = command.direction;
+      } else {
+        remote.direction = std::nullopt;
+        remote.next_refresh_time = std::min(remote.next_refresh_time, retry_time);
+      }
+      break;
+    }
+    case DeviceCommandType::ReadState: {
+      remote.state = response ? parse_lever_state(*response) : std::nullopt;
+      if (remote.state) {
+        record_state_sample(remote, t);
+      }
+      break;
+    }
+    case DeviceCommandType::StreamState: {
+      auto rate = response ? parse_stream_rate(*response) : std::nullopt;
+      if (rate && rate.value() == command.stream_rate_hz) {
+        remote.streaming = command.stream_rate_hz > 0;
+        remote.last_frame_time = t;
+      } else {
+        remote.streaming = false;
+        remote.next_refresh_time = std::min(remote.next_refresh_time, retry_time);
+      }
+      break;
+    }
+    case DeviceCommandType::SetEdgeThresholds: {
+      auto thresholds = response ? parse_edge_thresholds(*response) : std::nullopt;
+      if (thresholds) {
+        remote.device_edges_answered = true;
+        remote.device_edges_unsupported = false;
+        remote.num_edge_threshold_misses = 0;
+      }
+      if (thresholds && thresholds.value() == command.edge_thresholds) {
+        remote.device_edge_thresholds = thresholds;
+      } else {
+        remote.device_edge_thresholds = std::nullopt;
+        if (!thresholds) {
+          remote.num_edge_threshold_misses++;
+          remote.device_edges_unsupported = is_unsupported_after_miss(
+            remote.device_edges_answered, remote.num_edge_threshold_misses);
+        }
+        remote.next_refresh_time = std::min(remote.next_refresh_time, retry_time);
+      }
+      break;
+    }
+    case DeviceCommandType::ReadClock: {
+      if (auto device_time = response ? parse_device_clock(*response) : std::nullopt) {
+        add_exchange(&remote.clock_sync, command.sent_time, t, device_time.value());
+        remote.clock_estimate = estimate(remote.clock_sync);
+        remote.device_clock_answered = true;
+        remote.device_clock_unsupported = false;
+        remote.num_clock_read_misses = 0;
+      } else {
+        remote.num_clock_read_misses++;
+        remote.device_clock_unsupported = is_unsupported_after_miss(
+          remote.device_clock_answered, remote.num_clock_read_misses);
+        if (remote.device_clock_unsupported) {
+          //  The estimate is not refined while the clock is not read, so it would go stale.
+          remote.clock_estimate = std::nullopt;
+        }
+      }
+      break;
+    }
+    case DeviceCommandType::NegotiateBaud: {
+      complete_baud_negotiation(remote, command, response, t);
+      break;
+    }
+    case DeviceCommandType::ForceProfile: {
+      const int step = command.force_profile_step;
+      const int num_segments = remote.force_profile.num_segments;
+      std::optional<int> count;
+      if (response) {
+        count = step > num_segments ?
+          parse_force_profile_started(*response) : parse_force_profile_size(*response);
+      }
+      //  Clearing empties the device's profile, and each added segment extends it by one.
+      const int expect_count = std::min(step, num_segments);
+      if (!count || count.value() != expect_count) {
+        remote.force_profile_status = ForceProfileStatus::Failed;
+        remote.device_force_profile = std::nullopt;
+      } else if (step > num_segments) {
+        remote.force_profile_status = ForceProfileStatus::Running;
+        remote.force_profile_deadline = t + std::chrono::duration_cast<TimePoint::duration>(
+          Duration(double(duration_ms(remote.force_profile)) * 1e-3 + Config::response_timeout_s));
+      } else {
+        if (step == num_segments) {
+          remote.device_force_profile = remote.force_profile;
+        }
+        remote.force_profile_step = step + 1;
+      }
+      break;
+    }
+    default: {
+      assert(false);
+    }
+  }
+
+  remote.need_publish_snapshot = true;
+}
+
+void step_device(LeverSystem::RemoteInstance& remote, const TimePoint& t) {
+  if (!is_open(remote.port)) {
+    return;
+  }
+
+  //  Responses are matched to commands by their shape, so the commands after a missed one keep
+  //  waiting for theirs.
+  while (remote.num_in_flight > 0 && t >= remote.in_flight[0].deadline) {
+    complete_command(remote, std::nullopt, t);
+  }
+
+  if (remote.force_profile_status == ForceProfileStatus::Running &&
+      t >= remote.force_profile_deadline) {
+    remote.force_profile_status = ForceProfileStatus::Failed;
+    remote.need_publish_snapshot = true;
+  }
+
+  if (t < remote.baud_settle_time) {
+    return;
+  } else if (is_negotiating_baud(remote)) {
+    //  Negotiation commands are sent one at a time, and nothing else is sent meanwhile, since a
+    //  response at the wrong rate is garbled.
+    if (remote.num_in_flight == 0) {
+      InFlightCommand command{};
+      command.type = DeviceCommandType::NegotiateBaud;
+      command.baud_rate = remote.baud_negotiation == BaudNegotiation::Offering ?
+        Config::negotiated_baud_rates[remote.baud_candidate] : remote.baud_rate;
+      send_command(remote, command, t);
+    }
+    return;
+  }
+
+  if (remote.streaming && t >= stream_deadline(remote)) {
+    //  The device stopped streaming, e.g. because it reset; fall back to polling until the
+    //  stream is restarted.
+    remote.streaming = false;
+    remote.sent_stream_rate = std::nullopt;
+    remote.state = std::nullopt;
+    remote.need_publish_snapshot = true;
+  }
+
+  if (t >= remote.next_refresh_time) {
+    remote.sent_force = std::nullopt;
+    remote.sent_direction = std::nullopt;
+    remote.sent_stream_rate = std::nullopt;
+    remote.sent_edge_thresholds = std::nullopt;
+    remote.device_edges_unsupported = false;
+    remote.device_clock_unsupported = false;
+    remote.next_refresh_time = t + std::chrono::duration_cast<TimePoint::duration>(
+      Duration(Config::command_refresh_interval_s));
+  }
+
+  //  Commands are written back to back, without waiting for earlier responses; the responses are
+  //  matched to their commands in order as they arrive.
+  if (need_send_force(remote)) {
+    InFlightCommand command{};
+    command.type = DeviceCommandType::SetForce;
+    command.force = remote.commanded_force;
+    send_command(remote, command, t);
+    remote.sent_force = remote.commanded_force;
+  }
+
+  if (need_send_direction(remote)) {
+    InFlightCommand command{};
+    command.type = DeviceCommandType::SetDirection;
+    command.direction = remote.commanded_direction;
+    send_command(remote, command, t);
+    remote.sent_direction = remote.commanded_direction;
+  }
+
+  if (need_send_stream_rate(remote)) {
+    InFlightCommand command{};
+    command.type = DeviceCommandType::StreamState;
+    command.stream_rate_hz = Config::state_stream_rate_hz;
+    send_command(remote, command, t);
+    remote.sent_stream_rate = Config::state_stream_rate_hz;
+  }
+
+  if (need_send_edge_thresholds(remote)) {
+    InFlightCommand command{};
+    command.type = DeviceCommandType::SetEdgeThresholds;
+    command.edge_thresholds = to_device_edge_thresholds(remote.pull_detect_config);
+    send_command(remote, command, t);
+    remote.sent_edge_thresholds = command.edge_thresholds;
+  }
+
+  if (need_send_force_profile_step(remote)) {
+    InFlightCommand command{};
+    command.type = DeviceCommandType::ForceProfile;
+    command.force_profile_step = remote.force_profile_step;
+    if (command.force_profile_step == 0) {
+      remote.device_force_profile = std::nullopt;
+    }
+    send_command(remote, command, t);
+  }
+
+  if (need_send_clock_read(remote) && t >= remote.next_clock_time) {
+    InFlightCommand command{};
+    command.type = DeviceCommandType::ReadClock;
+    send_command(remote, command, t);
+    remote.next_clock_time = t + std::chrono::duration_cast<TimePoint::duration>(
+      Duration(Config::clock_sync_interval_s));
+  }
+
+  if (!remote.streaming && !is_in_flight(remote, DeviceCommandType::ReadState) &&
+      t >= remote.next_state_time) {
+    InFlightCommand command{};
+    command.type = DeviceCommandType::ReadState;
+    send_command(remote, command, t);
+    remote.next_state_time = t + std::chrono::duration_cast<TimePoint::duration>(
+      Duration(Config::worker_poll_interval_s));
+  }
+}
+
+//  Time until `remote` next needs attention from the worker, absent any input.
+double time_until_next_step(const LeverSystem::RemoteInstance& remote, const TimePoint& t) {
+  if (!is_open(remote.port)) {
+    return Config::worker_poll_interval_s;
+  }
+  if (t < remote.baud_settle_time) {
+    return elapsed_time(t, remote.baud_settle_time);
+  } else if (is_negotiating_baud(remote)) {
+    return remote.num_in_flight > 0 ? elapsed_time(t, remote.in_flight[0].deadline) : 0.0;
+  }
+  if (need_send_force(remote) || need_send_direction(remote) || need_send_stream_rate(remote) ||
+      need_send_edge_thresholds(remote) || need_send_force_profile_step(remote)) {
+    return 0.0;
+  }
+
+  double result = elapsed_time(t, remote.next_refresh_time);
+  if (remote.num_in_flight > 0) {
+    result = std::min(result, elapsed_time(t, remote.in_flight[0].deadline));
+  }
+  if (remote.force_profile_status == ForceProfileStatus::Running) {
+    result = std::min(result, elapsed_time(t, remote.force_profile_deadline));
+  }
+  if (need_send_clock_read(remote)) {
+    result = std::min(result, elapsed_time(t, remote.next_clock_time));
+  }
+  if (remote.streaming) {
+    result = std::min(result, elapsed_time(t, stream_deadline(remote)));
+  } else if (!is_in_flight(remote, DeviceCommandType::ReadState)) {
+    result = std::min(result, elapsed_time(t, remote.next_state_time));
+  }
+  return result;
+}
+
+void apply_state_frame(LeverSystem::RemoteInstance& remote, const LeverStateFrame& frame,
+                       const TimePoint& t) {
+  auto& stats = remote.io_stats;
+  stats.num_frames++;
+  if (remote.last_frame_sequence) {
+    const auto expected = uint16_t(remote.last_frame_sequence.value() + 1);
+    stats.num_dropped_frames += uint16_t(frame.sequence - expected);
+  }
+  remote.last_frame_sequence = frame.sequence;
+  remote.device_time_us = frame.device_time_us;
+  remote.last_frame_time = t;
+  remote.state = frame.state;
+  remote.need_publish_snapshot = true;
+  record_state_sample(remote, t, frame.device_time_us);
+}
+
+void apply_edge_frame(LeverSystem::RemoteInstance& remote, const LeverEdgeFrame& frame,
+                      const TimePoint& t) {
+  auto& stats = remote.io_stats;
+  stats.num_edge_frames++;
+  if (remote.last_edge_sequence) {
+    const auto expected = uint16_t(remote.last_edge_sequence.value() + 1);
+    stats.num_dropped_edge_frames += uint16_t(frame.sequence - expected);
+  }
+  remote.last_edge_sequence = frame.sequence;
+  remote.device_time_us = frame.device_time_us;
+  remote.state = frame.state;
+  remote.need_publish_snapshot = true;
+  const uint64_t sequence = record_state_sample(remote, t, frame.device_time_us);
+
+  auto& outbox = remote.sample_outbox;
+  if (device_detects_pulls(remote) && outbox.num_pull_events < Config::max_num_unsent_samples) {
+    PullEvent event{};
+    event.type = frame.pulled ? PullEventType::Pull : PullEventType::Release;
+    event.time = t;
+    event.sequence = sequence;
+    event.position = normalize_lever_position(frame.state.potentiometer_reading,
+                                              remote.pull_detect_config);
+    event.state = frame.state;
+    event.device_time_us = frame.device_time_us;
+    if (remote.clock_estimate) {
+      event.time = to_host_time(remote.clock_estimate.value(), frame.device_time_us);
+      event.time_error_bound_s = remote.clock_estimate.value().error_bound_s;
+    }
+    outbox.pull_events[outbox.num_pull_events++] = event;
+  }
+}
+
+void apply_profile_frame(LeverSystem::RemoteInstance& remote, const LeverProfileFrame& frame,
+                         const TimePoint& t) {
+  remote.device_time_us = frame.device_time_us;
+  remote.state = frame.state;
+  record_state_sample(remote, t, frame.device_time_us);
+  //  Frames for runs that were superseded before they finished are ignored.
+  if (remote.force_profile_status == ForceProfileStatus::Running) {
+    remote.force_profile_status = frame.completed ?
+      ForceProfileStatus::Completed : ForceProfileStatus::Failed;
+    //  Bring the device back in line with the commanded force and direction.
+    remote.sent_force = std::nullopt;
+    remote.sent_direction = std::nullopt;
+  }
+  remote.need_publish_snapshot = true;
+}
+
+//  Splits the received bytes into binary frames and text lines, leaving any incomplete tail.
+void parse_received(LeverSystem::RemoteInstance& remote, const TimePoint& t) {
+  constexpr char text_delims[] = {'\n', char(LeverFrameFormat::sync0), '\0'};
+  while (size(remote.received) > 0) {
+    const auto in = pending(remote.received);
+    const auto* data = reinterpret_cast<const uint8_t*>(in.data());
+
+    if (data[0] == LeverFrameFormat::sync0) {
+      if (int(in.size()) < LeverFrameFormat::size) {
+        break;
+      }
+      if (auto frame = decode_lever_state_frame(data, int(in.size()))) {
+        apply_state_frame(remote, frame.value(), t);
+        consume(&remote.received, LeverFrameFormat::size);
+      } else if (auto edge = decode_lever_edge_frame(data, int(in.size()))) {
+        apply_edge_frame(remote, edge.value(), t);
+        consume(&remote.received, LeverFrameFormat::size);
+      } else if (auto profile = decode_lever_profile_frame(data, int(in.size()))) {
+        apply_profile_frame(remote, profile.value(), t);
+        consume(&remote.received, LeverFrameFormat::size);
+      } else {
+        //  Resynchronize on the next sync byte.
+        remote.io_stats.num_corrupt_frames++;
+        consume(&remote.received, 1);
+      }
+      continue;
+    }
+
+    const auto end = in.find_first_of(text_delims);
+    if (end == std::string_view::npos) {
+      break;
+    } else if (in[end] != '\n') {
+      //  Text cut off by a frame is not a complete response; drop it.
+      consume(&remote.received, int(end));
+      continue;
+    }
+
+    auto line = in.substr(0, end + 1);
+    consume(&remote.received, int(line.size()));
+    //  Responses arrive in the order of their commands, but the device does not answer commands
+    //  it does not know. A line completes the oldest command in flight that it answers, and the
+    //  commands before that one as unanswered; a line that answers none is late or unsolicited, and
+    //  is dropped.
+    const int answered = find_answered_command(remote, line);
+    if (answered >= 0) {
+      for (int i = 0; i < answered; i++) {
+        complete_command(remote, std::nullopt, t);
+      }
+      complete_command(remote, line, t);
     }
   }
+}
 
-  if (remote.need_send_state) {
-    auto message = make_share_state_message(remote, local.handle);
-    if (system->read_remote.maybe_write(message)) {
-      remote.need_send_state = false;
+void receive(LeverSystem::Worker& worker, LeverSystem::RemoteInstance& remote) {
+  const auto t = now();
+  while (true) {
+    auto [dst, capacity] = write_space(&remote.received);
+    const int num_read = read_nonblocking(&remote.port, dst, capacity);
+    if (num_read < 0) {
+      printf("Lever port failed; reconnecting.\n");
+      begin_reconnect(worker, remote, t);
+      remote.need_publish_snapshot = true;
+      return;
+    } else if (num_read == 0) {
+      break;
     }
+    commit_write(&remote.received, num_read);
+    parse_received(remote, t);
+  }
+}
+
+void detect_pull(LeverSystem::RemoteInstance& remote, LeverSystem::LocalInstance& local,
+                 const LeverSample& sample) {
+  auto& config = remote.pull_detect_config;
+  if (!config.enabled || device_detects_pulls(remote)) {
+    return;
+  }
+
+  PullDetectParams params{};
+  params.current_position = normalize_lever_position(sample.state.potentiometer_reading, config);
+  remote.pull_detect.rising_edge = config.rising_edge;
+  remote.pull_detect.falling_edge = config.falling_edge;
+  auto res = lever::detect_pull(&remote.pull_detect, params);
+  if (!res.pulled_lever && !res.released_lever) {
+    return;
+  }
+
+  PullEvent event{};
+  event.lever = local.handle;
+  event.type = res.pulled_lever ? PullEventType::Pull : PullEventType::Release;
+  event.time = sample.time;
+  event.sequence = sample.sequence;
+  event.position = params.current_position;
+  event.state = sample.state;
+  local.pull_events.maybe_write(event);
+}
+
+void process_remote_instance(LeverSystem* system, LeverSystem::Worker& worker,
+                             LeverSystem::RemoteInstance& remote, LeverSystem::LocalInstance& local) {
+  //  Apply every queued command in one pass. Force and direction commands simply overwrite the
+  //  commanded values, so only the latest of each is sent to the device, and only if it changed.
+  auto commands = local.commands.peek_read();
+  for (int i = 0; i < commands.size(); i++) {
+    auto& data = commands[i];
+    record_dispatch(remote, data);
+    if (process_remote_message(system, worker, remote, std::move(data))) {
+      remote.need_publish_snapshot = true;
+    }
+  }
+  if (commands.size() > 0) {
+    local.commands.consume(commands.size());
+    remote.need_publish_snapshot = true;
+  }
+
+  if (remote.open_response) {
+    auto message = make_port_status_message(
+      local.handle, remote.open_response.value(), is_open(remote.port));
+    if (worker.read_remote.maybe_write(message)) {
+      remote.open_response = std::nullopt;
+    }
+  }
+
+  step_reconnect(system, worker, remote, now());
+  step_device(remote, now());
+  if (remote.write_failed) {
+    printf("Lever port failed; reconnecting.\n");
+    begin_reconnect(worker, remote, now());
+    remote.need_publish_snapshot = true;
+  }
+
+  auto& outbox = remote.sample_outbox;
+  for (int i = 0; i < outbox.size; i++) {
+    auto& sample = outbox.samples[i];
+    detect_pull(remote, local, sample);
+    local.samples.maybe_write(sample);
+    push(&system->recorder, remote.index, sample.time, sample.sequence, sample.state,
+         remote.commanded_force, remote.commanded_direction);
+  }
+  outbox.size = 0;
+
+  for (int i = 0; i < outbox.num_pull_events; i++) {
+    auto event = outbox.pull_events[i];
+    event.lever = local.handle;
+    local.pull_events.maybe_write(event);
+  }
+  outbox.num_pull_events = 0;
+
+  if (remote.need_publish_snapshot) {
+    write_latest(&local.latest, make_snapshot(remote));
+    remote.need_publish_snapshot = false;
+  }
+
+  const auto t = now();
+  if (remote.need_publish_latency && t >= remote.next_latency_publish_time) {
+    write_latest(&local.latest_latency, remote.latency);
+    remote.need_publish_latency = false;
+    remote.next_latency_publish_time = t + std::chrono::duration_cast<TimePoint::duration>(
+      Duration(Config::latency_publish_interval_s));
   }
 }
 
-void worker(LeverSystem* system) {
+void run_worker(LeverSystem* system, LeverSystem::Worker& worker) {
+  void* ready[Config::max_num_ready_devices];
+
   while (system->keep_processing.load()) {
-    for (int i = 0; i < int(system->remote_instances.size()); i++) {
-      process_remote_instance(
-        system, *system->remote_instances[i], *system->local_instances[i]);
+    const auto t = now();
+    take_open_results(system, worker);
+    retry_reconnects(system, worker, t);
+    double timeout = Config::worker_poll_interval_s;
+    for (auto handle : worker.levers) {
+      auto& local = *system->local_instances.at(handle);
+      auto& remote = *system->remote_instances.at(handle);
+      process_remote_instance(system, worker, remote, local);
+      timeout = std::min(timeout, time_until_next_step(remote, t));
     }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    //  Each device progresses as its own input arrives or its own deadline passes, so a slow or
+    //  unplugged device does not delay the others.
+    const int num_ready = wait_readable(
+      &worker.reactor, std::max(0.0, timeout), ready, Config::max_num_ready_devices);
+    for (int i = 0; i < num_ready; i++) {
+      receive(worker, *static_cast<LeverSystem::RemoteInstance*>(ready[i]));
+    }
+  }
+
+  for (auto handle : worker.levers) {
+    reset_remote_instance(worker, *system->remote_instances.at(handle));
+  }
+}
+
+int default_num_workers(int num_levers) {
+  const int num_cores = int(std::thread::hardware_concurrency());
+  const int max_num_workers = std::max(1, num_cores - Config::num_reserved_cores);
+  const int num_needed = (num_levers + Config::max_num_levers_per_worker - 1) /
+                         Config::max_num_levers_per_worker;
+  return std::max(1, std::min(num_needed, max_num_workers));
+}
+
+//  The worker of each lever. Groups are assigned whole, in order, to the worker on which their
+//  middle lever would fall were the levers split evenly; every worker gets at least one group.
+std::vector<int> assign_workers(const std::vector<int>& group_sizes, int num_levers, int num_workers) {
+  std::vector<int> result;
+  const auto num_groups = int(group_sizes.size());
+  int worker{};
+  for (int i = 0; i < num_groups; i++) {
+    const auto first = int(result.size());
+    if (i > 0) {
+      const int target = int(int64_t(first + group_sizes[i] / 2) * num_workers / num_levers);
+      worker = std::min(worker + 1, std::max(worker, target));
+      //  Leaves a group for each of the remaining workers.
+      worker = std::max(worker, num_workers - (num_groups - i));
+    }
+    result.insert(result.end(), group_sizes[i], worker);
   }
+  return result;
 }
 
-std::unique_ptr<LeverSystem::LocalInstance> make_local_instance(SerialLeverHandle handle) {
+std::unique_ptr<LeverSystem::LocalInstance> make_local_instance() {
   auto result = std::make_unique<LeverSystem::LocalInstance>();
-  result->handle = handle;
+  result->history.reserve(Config::sample_history_capacity);
+  return result;
+}
+
+//  Number of samples in `samples` older than `t`.
+int count_older(const SampleQueueView<LeverSample>& samples, const TimePoint& t) {
+  int lo{};
+  int hi = samples.size();
+  while (lo < hi) {
+    const int mid = lo + (hi - lo) / 2;
+    if (samples[mid].time < t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+LeverState lerp(const LeverState& a, const LeverState& b, float f) {
+  LeverState result{};
+  result.strain_gauge = a.strain_gauge + (b.strain_gauge - a.strain_gauge) * f;
+  result.calculated_pwm = a.calculated_pwm + (b.calculated_pwm - a.calculated_pwm) * f;
+  result.actual_pwm = a.actual_pwm + (b.actual_pwm - a.actual_pwm) * f;
+  result.potentiometer_reading =
+    a.potentiometer_reading + (b.potentiometer_reading - a.potentiometer_reading) * f;
   return result;
 }
 
@@ -243,84 +1480,216 @@ std::unique_ptr<LeverSystem::RemoteInstance> make_remote_instance() {
   return std::make_unique<LeverSystem::RemoteInstance>();
 }
 
+bool push_command(LeverSystem::LocalInstance* inst, LeverMessageData&& data) {
+  data.handle = inst->handle;
+  data.sequence = inst->next_command_sequence;
+  data.sent_time = now();
+  if (inst->commands.maybe_write(std::move(data))) {
+    inst->next_command_sequence++;
+    return true;
+  } else {
+    return false;
+  }
+}
+
 } //  anon
 
-void lever::initialize(LeverSystem* sys, int max_num_levers, SerialLeverHandle* levers) {
+void lever::initialize(LeverSystem* sys, int max_num_levers, SerialLeverHandle* levers,
+                       int num_workers, const std::vector<int>& lever_group_sizes) {
+  std::vector<int> group_sizes;
+  for (int size : lever_group_sizes) {
+    if (size > 0) {
+      group_sizes.push_back(size);
+    }
+  }
+  if (group_sizes.empty()) {
+    group_sizes.resize(max_num_levers, 1);
+  }
+  assert(std::accumulate(group_sizes.begin(), group_sizes.end(), 0) == max_num_levers);
+
+  if (num_workers <= 0) {
+    num_workers = default_num_workers(max_num_levers);
+  }
+  num_workers = std::max(1, std::min(num_workers, int(group_sizes.size())));
+  const auto lever_workers = assign_workers(group_sizes, max_num_levers, num_workers);
+
+  std::vector<SerialReactor*> reactors;
+  for (int i = 0; i < num_workers; i++) {
+    auto worker = std::make_unique<LeverSystem::Worker>();
+    worker->index = i;
+    if (!om::initialize(&worker->reactor)) {
+      printf("Failed to initialize lever serial reactor.\n");
+      assert(false);
+    }
+    reactors.push_back(&worker->reactor);
+    sys->workers.push_back(std::move(worker));
+  }
+
+  //  The levers of a group share a worker, so that the levers of a rig are served together.
   for (int i = 0; i < max_num_levers; i++) {
-    SerialLeverHandle handle{sys->instance_id++};
-    sys->local_instances.emplace_back() = make_local_instance(handle);
-    sys->remote_instances.emplace_back() = make_remote_instance();
+    SerialLeverHandle handle = sys->local_instances.insert(make_local_instance());
+    SerialLeverHandle remote_handle = sys->remote_instances.insert(make_remote_instance());
+    assert(remote_handle == handle);
+    (void) remote_handle;
+    const int worker = lever_workers[i];
+    auto& local = *sys->local_instances.at(handle);
+    local.handle = handle;
+    local.worker = worker;
+    sys->remote_instances.at(handle)->index = i;
+    sys->workers[worker]->levers.push_back(handle);
     levers[i] = handle;
   }
 
+  start(&sys->port_watcher, reactors.data(), num_workers);
+
   sys->keep_processing.store(true);
-  sys->worker_thread = std::thread{[sys]() {
-    worker(sys);
-  }};
+  for (auto& worker : sys->workers) {
+    auto* w = worker.get();
+    w->thread = std::thread{[sys, w]() {
+      run_worker(sys, *w);
+    }};
+  }
 }
 
 void lever::terminate(LeverSystem* sys) {
+  stop(&sys->recorder);
   sys->keep_processing.store(false);
-  if (sys->worker_thread.joinable()) {
-    sys->worker_thread.join();
+  for (auto& worker : sys->workers) {
+    wake(&worker->reactor);
   }
+  for (auto& worker : sys->workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+  //  Closes any ports opened for the workers after they stopped.
+  stop(&sys->port_watcher);
+  for (auto& worker : sys->workers) {
+    om::terminate(&worker->reactor);
+  }
+  sys->workers.clear();
   sys->local_instances.clear();
   sys->remote_instances.clear();
 }
 
 void lever::update(LeverSystem* system) {
+  //  Every pending command is queued this frame, in the order open -> close -> force/direction.
+  //  A command that does not fit stays pending, where later calls coalesce with it, and is retried
+  //  next frame.
   for (auto& inst : system->local_instances) {
-    if (inst->message.awaiting_read) {
-      (void) acknowledged(&inst->message);
+    bool published{};
+    if (inst->pending_open_port) {
+      auto data = make_open_port_message(std::string{inst->pending_open_port.value()});
+      if (push_command(inst.get(), std::move(data))) {
+        inst->pending_open_port = std::nullopt;
+        //  A newly opened port starts from default settings, so re-send the commanded ones.
+        inst->pending_canonical_force = inst->commanded_force;
+        inst->pending_canonical_direction = inst->commanded_direction;
+        published = true;
+      }
     }
 
-    if (inst->pending_open_port && !inst->message.awaiting_read) {
-      auto data = make_open_port_message(std::move(inst->pending_open_port.value()));
-      publish(&inst->message, std::move(data));
-      inst->pending_open_port = std::nullopt;
+    if (inst->pending_close_port && !inst->pending_open_port) {
+      if (push_command(inst.get(), make_close_port_message())) {
+        inst->pending_close_port = false;
+        published = true;
+      }
     }
 
-    if (inst->pending_close_port && !inst->message.awaiting_read) {
-      publish(&inst->message, make_close_port_message());
-      inst->pending_close_port = false;
+    if ((inst->pending_canonical_force || inst->pending_canonical_direction) &&
+        !inst->pending_open_port) {
+      auto data = make_set_force_and_direction_message(
+        inst->pending_canonical_force, inst->pending_canonical_direction);
+      if (push_command(inst.get(), std::move(data))) {
+        inst->pending_canonical_force = std::nullopt;
+        inst->pending_canonical_direction = std::nullopt;
+        published = true;
+      }
     }
 
-    if ((inst->pending_canonical_force || inst->pending_canonical_direction) && 
-        !inst->message.awaiting_read) {
+    if (inst->pending_pull_detect_config) {
+      auto data = make_set_pull_detect_config_message(inst->pending_pull_detect_config.value());
+      if (push_command(inst.get(), std::move(data))) {
+        inst->pending_pull_detect_config = std::nullopt;
+        published = true;
+      }
+    }
 
-      auto data = make_set_force_and_direction_message(
-        inst->pending_canonical_force, inst->pending_canonical_direction);
-      publish(&inst->message, std::move(data));
-      inst->pending_canonical_force = std::nullopt;
-      inst->pending_canonical_direction = std::nullopt;
+    if (inst->pending_force_profile && !inst->pending_open_port) {
+      auto data = make_run_force_profile_message(
+        inst->pending_force_profile.value(), inst->force_profile_run);
+      if (push_command(inst.get(), std::move(data))) {
+        inst->pending_force_profile = std::nullopt;
+        published = true;
+      }
+    }
+
+    if (published) {
+      system->workers[inst->worker]->wake_pending = true;
     }
   }
 
-  const int num_read = system->read_remote.size();
-  for (int i = 0; i < num_read; i++) {
-    auto response = system->read_remote.read();
-    if (response.type == LeverMessageType::ShareState) {
-      if (auto* inst = find_local_instance(system, response.handle)) {
-        inst->canonical_force = response.force;
-        inst->canonical_direction = response.direction;
-        inst->state = response.state;
-        inst->is_open = response.is_open;
+  for (auto& worker : system->workers) {
+    if (worker->wake_pending) {
+      wake(&worker->reactor);
+      worker->wake_pending = false;
+    }
+
+    auto responses = worker->read_remote.peek_read();
+    for (int i = 0; i < responses.size(); i++) {
+      auto& response = responses[i];
+      if (response.type == LeverMessageType::PortStatus) {
+        if (auto* inst = find_local_instance(system, response.handle)) {
+          assert(inst->awaiting_open);
+          inst->awaiting_open = false;
+          inst->is_open = response.is_open;
+        }
       }
+    }
+    worker->read_remote.consume(responses.size());
+  }
 
-    } else if (response.type == LeverMessageType::PortStatus) {
-      if (auto* inst = find_local_instance(system, response.handle)) {
-        assert(inst->awaiting_open);
-        inst->awaiting_open = false;
-        inst->is_open = response.is_open;
+  if (auto ports = read_ports(&system->port_watcher)) {
+    system->serial_ports = std::move(ports.value());
+  }
+
+  for (auto& inst : system->local_instances) {
+    while (inst->samples.size() > 0) {
+      auto sample = inst->samples.read();
+      inst->history.push(&sample, 1);
+    }
+  }
+
+  //  Port status responses are applied first, so that a newer snapshot takes precedence.
+  for (auto& inst : system->local_instances) {
+    if (auto snapshot = read_latest(&inst->latest)) {
+      inst->canonical_force = snapshot.value().force;
+      inst->canonical_direction = snapshot.value().direction;
+      inst->state = snapshot.value().state;
+      inst->is_open = snapshot.value().is_open;
+      inst->dispatch_stats = snapshot.value().dispatch_stats;
+      inst->io_stats = snapshot.value().io_stats;
+      inst->clock_estimate = snapshot.value().clock_estimate;
+      inst->reconnecting = snapshot.value().reconnecting;
+      inst->num_reconnect_attempts = snapshot.value().num_reconnect_attempts;
+      //  Until the worker has seen the latest run request, its status refers to an earlier one.
+      if (snapshot.value().force_profile_run == inst->force_profile_run) {
+        inst->force_profile_status = snapshot.value().force_profile_status;
       }
     }
+    if (auto latency = read_latest(&inst->latest_latency)) {
+      inst->latency = latency.value();
+    }
   }
 }
 
 void lever::set_force(LeverSystem* system, SerialLeverHandle instance, int grams) {
   if (auto* inst = find_local_instance(system, instance)) {
-    inst->pending_canonical_force = grams;
-    inst->commanded_force = grams;
+    //  Repeating the commanded force is a no-op.
+    if (grams != inst->commanded_force) {
+      inst->pending_canonical_force = grams;
+      inst->commanded_force = grams;
+    }
   } else {
     assert(false);
   }
@@ -328,10 +1697,39 @@ void lever::set_force(LeverSystem* system, SerialLeverHandle instance, int grams
 
 void lever::set_direction(LeverSystem* system, SerialLeverHandle instance, SerialLeverDirection dir) {
   if (auto* inst = find_local_instance(system, instance)) {
-    inst->pending_canonical_direction = dir;
-    inst->commanded_direction = dir;
+    if (dir != inst->commanded_direction) {
+      inst->pending_canonical_direction = dir;
+      inst->commanded_direction = dir;
+    }
+  } else {
+    assert(false);
+  }
+}
+
+void lever::run_force_profile(LeverSystem* system, SerialLeverHandle instance,
+                              const LeverForceProfile& profile) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    assert(profile.num_segments > 0 && profile.num_segments <= max_lever_force_profile_segments());
+    inst->pending_force_profile = profile;
+    inst->force_profile_run++;
+    inst->force_profile_status = ForceProfileStatus::Loading;
+    //  The profile leaves the device at its last segment, which supersedes any pending setting.
+    auto& last = profile.segments[profile.num_segments - 1];
+    inst->commanded_force = last.force;
+    inst->commanded_direction = last.direction;
+    inst->pending_canonical_force = std::nullopt;
+    inst->pending_canonical_direction = std::nullopt;
+  } else {
+    assert(false);
+  }
+}
+
+ForceProfileStatus lever::get_force_profile_status(LeverSystem* system, SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    return inst->force_profile_status;
   } else {
     assert(false);
+    return ForceProfileStatus::Idle;
   }
 }
 
@@ -371,6 +1769,32 @@ void lever::close_connection(LeverSystem* system, SerialLeverHandle handle) {
   }
 }
 
+bool lever::is_reconnecting(LeverSystem* system, SerialLeverHandle handle) {
+  if (auto* inst = find_local_instance(system, handle)) {
+    return inst->reconnecting;
+  } else {
+    assert(false);
+    return false;
+  }
+}
+
+int lever::get_num_reconnect_attempts(LeverSystem* system, SerialLeverHandle handle) {
+  if (auto* inst = find_local_instance(system, handle)) {
+    return inst->num_reconnect_attempts;
+  } else {
+    assert(false);
+    return 0;
+  }
+}
+
+const std::vector<PortDescriptor>& lever::get_serial_ports(LeverSystem* system) {
+  return system->serial_ports;
+}
+
+void lever::rescan_serial_ports(LeverSystem* system) {
+  request_rescan(&system->port_watcher);
+}
+
 int lever::get_commanded_force(LeverSystem* system, SerialLeverHandle instance) {
   if (auto* inst = find_local_instance(system, instance)) {
     return inst->commanded_force;
@@ -416,8 +1840,221 @@ SerialLeverDirection lever::get_commanded_direction(LeverSystem* system, SerialL
   }
 }
 
+CommandDispatchStats lever::get_command_dispatch_stats(LeverSystem* system, SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    return inst->dispatch_stats;
+  } else {
+    assert(false);
+    return {};
+  }
+}
+
+LeverIOStats lever::get_io_stats(LeverSystem* system, SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    return inst->io_stats;
+  } else {
+    assert(false);
+    return {};
+  }
+}
+
+uint64_t lever::get_num_skipped_state_updates(LeverSystem* system, SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    return num_skipped(&inst->latest);
+  } else {
+    assert(false);
+    return 0;
+  }
+}
+
+std::optional<LeverSample> lever::get_latest_sample(LeverSystem* system, SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    auto samples = inst->history.view();
+    if (samples.size() > 0) {
+      return samples[samples.size() - 1];
+    } else {
+      return std::nullopt;
+    }
+  } else {
+    assert(false);
+    return std::nullopt;
+  }
+}
+
+int lever::get_samples(LeverSystem* system, SerialLeverHandle instance, const TimePoint& t0,
+                       const TimePoint& t1, LeverSample* dst, int max_num_samples) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    auto samples = inst->history.view();
+    int num_copied{};
+    for (int i = count_older(samples, t0);
+         i < samples.size() && samples[i].time <= t1 && num_copied < max_num_samples; i++) {
+      dst[num_copied++] = samples[i];
+    }
+    return num_copied;
+  } else {
+    assert(false);
+    return 0;
+  }
+}
+
+std::optional<LeverState> lever::state_at(LeverSystem* system, SerialLeverHandle instance,
+                                          const TimePoint& t) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    auto samples = inst->history.view();
+    const int i = count_older(samples, t);
+    if (i == samples.size()) {
+      return std::nullopt;
+    } else if (samples[i].time == t) {
+      return samples[i].state;
+    } else if (i == 0) {
+      return std::nullopt;
+    }
+
+    auto& a = samples[i - 1];
+    auto& b = samples[i];
+    const double f = elapsed_time(a.time, t) / elapsed_time(a.time, b.time);
+    return lerp(a.state, b.state, float(f));
+  } else {
+    assert(false);
+    return std::nullopt;
+  }
+}
+
+uint64_t lever::get_num_overwritten_samples(LeverSystem* system, SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    return inst->samples.stats().num_overwritten;
+  } else {
+    assert(false);
+    return 0;
+  }
+}
+
+void lever::set_pull_detect_config(LeverSystem* system, SerialLeverHandle instance,
+                                   const PullDetectConfig& config) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    if (!(config == inst->pull_detect_config)) {
+      inst->pending_pull_detect_config = config;
+      inst->pull_detect_config = config;
+    }
+  } else {
+    assert(false);
+  }
+}
+
+int lever::read_pull_events(LeverSystem* system, SerialLeverHandle instance, PullEvent* dst,
+                            int max_num_events) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    auto events = inst->pull_events.peek_read();
+    const int num_read = std::min(events.size(), max_num_events);
+    for (int i = 0; i < num_read; i++) {
+      dst[i] = events[i];
+    }
+    inst->pull_events.consume(num_read);
+    return num_read;
+  } else {
+    assert(false);
+    return 0;
+  }
+}
+
+uint64_t lever::get_num_dropped_pull_events(LeverSystem* system, SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    return inst->pull_events.stats().num_dropped;
+  } else {
+    assert(false);
+    return 0;
+  }
+}
+
+CommandLatencyStats lever::get_command_latency_stats(LeverSystem* system, SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    return inst->latency;
+  } else {
+    assert(false);
+    return {};
+  }
+}
+
+const char* lever::to_string(DeviceCommandType type) {
+  switch (type) {
+    case DeviceCommandType::SetForce:
+      return "SetForce";
+    case DeviceCommandType::SetDirection:
+      return "SetDirection";
+    case DeviceCommandType::ReadState:
+      return "ReadState";
+    case DeviceCommandType::StreamState:
+      return "StreamState";
+    case DeviceCommandType::SetEdgeThresholds:
+      return "SetEdgeThresholds";
+    case DeviceCommandType::ForceProfile:
+      return "ForceProfile";
+    case DeviceCommandType::ReadClock:
+      return "ReadClock";
+    case DeviceCommandType::NegotiateBaud:
+      return "NegotiateBaud";
+    default:
+      assert(false);
+      return "";
+  }
+}
+
+std::optional<DeviceClockEstimate> lever::get_clock_estimate(LeverSystem* system,
+                                                             SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    return inst->clock_estimate;
+  } else {
+    assert(false);
+    return std::nullopt;
+  }
+}
+
+bool lever::start_recording(LeverSystem* system, const std::string& file_path, const TimePoint& t0) {
+  return start(&system->recorder, file_path, t0);
+}
+
+void lever::stop_recording(LeverSystem* system) {
+  stop(&system->recorder);
+}
+
+bool lever::is_recording(LeverSystem* system) {
+  return is_recording(system->recorder);
+}
+
+LeverRecordingStats lever::get_recording_stats(LeverSystem* system) {
+  return get_stats(system->recorder);
+}
+
 int lever::num_remote_commands(LeverSystem* sys) {
-  return sys->read_remote.size();
+  int result{};
+  for (auto& worker : sys->workers) {
+    result += worker->read_remote.size();
+  }
+  return result;
+}
+
+RingBufferStats lever::get_remote_queue_stats(LeverSystem* sys) {
+  RingBufferStats result{};
+  for (auto& worker : sys->workers) {
+    const auto stats = worker->read_remote.stats();
+    result.num_dropped += stats.num_dropped;
+    result.num_overwritten += stats.num_overwritten;
+    result.high_water_mark = std::max(result.high_water_mark, stats.high_water_mark);
+  }
+  return result;
+}
+
+int lever::num_workers(LeverSystem* sys) {
+  return int(sys->workers.size());
+}
+
+int lever::get_worker_index(LeverSystem* system, SerialLeverHandle instance) {
+  if (auto* inst = find_local_instance(system, instance)) {
+    return inst->worker;
+  } else {
+    assert(false);
+    return 0;
+  }
 }
 
 LeverSystem* lever::get_global_lever_system() {
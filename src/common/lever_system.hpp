@@ -1,7 +1,13 @@
 #pragma once
 
 #include "serial_lever.hpp"
+#include "lever_pull.hpp"
+#include "lever_recorder.hpp"
+#include "device_clock.hpp"
 #include "identifier.hpp"
+#include "latency_histogram.hpp"
+#include "ringbuffer.hpp"
+#include "time.hpp"
 #include <vector>
 
 namespace om::lever {
@@ -11,13 +17,110 @@ struct SerialLeverHandle {
   uint32_t id;
 };
 
+//  Time from a command being issued on the ui thread to it being applied by the lever worker.
+struct CommandDispatchStats {
+  uint64_t num_commands;
+  uint64_t last_sequence;
+  double last_latency_s;
+  double mean_latency_s;
+  double max_latency_s;
+};
+
+//  Serial traffic between the lever worker and a device.
+struct LeverIOStats {
+  uint64_t num_commands_written;
+  uint64_t num_state_samples;
+  //  Valid state responses or frames per second, over the most recent window.
+  double state_sample_rate_hz;
+  //  Binary state stream only.
+  uint64_t num_frames;
+  uint64_t num_dropped_frames;
+  uint64_t num_corrupt_frames;
+  //  Pull edges reported by the device.
+  uint64_t num_edge_frames;
+  uint64_t num_dropped_edge_frames;
+  //  Rate of the open port, or 0 if it is closed.
+  uint32_t baud_rate;
+  //  Times the port was reopened by the worker after failing.
+  uint64_t num_reconnections;
+};
+
+//  Commands the lever worker writes to a device; each is answered with one line.
+enum class DeviceCommandType {
+  SetForce = 0,
+  SetDirection,
+  ReadState,
+  StreamState,
+  SetEdgeThresholds,
+  ForceProfile,
+  ReadClock,
+  NegotiateBaud,
+};
+
+constexpr int num_device_command_types() {
+  return 8;
+}
+
+//  Time from writing each command to reading its response, by `DeviceCommandType`.
+struct CommandLatencyStats {
+  LatencyHistogram round_trip[num_device_command_types()];
+  //  Commands that were not answered in time.
+  uint64_t num_failed[num_device_command_types()];
+};
+
+//  A decoded lever state, stamped by the worker when it was received.
+struct LeverSample {
+  TimePoint time;
+  //  Increases by one with each sample from a lever, across reconnections.
+  uint64_t sequence;
+  LeverState state;
+  //  Device clock for samples from binary frames; map it with `get_clock_estimate`.
+  std::optional<uint32_t> device_time_us;
+};
+
+enum class PullEventType {
+  Pull = 0,
+  Release,
+};
+
+//  An edge found by the lever worker's pull detection, stamped with the sample that crossed it.
+struct PullEvent {
+  SerialLeverHandle lever;
+  PullEventType type;
+  TimePoint time;
+  uint64_t sequence;
+  float position;
+  LeverState state;
+  //  Set for edges detected by the device rather than the lever worker. When the device clock has
+  //  been estimated, `time` is this device time mapped to host time, within `time_error_bound_s`.
+  std::optional<uint32_t> device_time_us;
+  std::optional<double> time_error_bound_s;
+};
+
+enum class ForceProfileStatus {
+  Idle = 0,
+  Loading,
+  Running,
+  Completed,
+  Failed,
+};
+
 struct LeverSystem;
 
-void initialize(LeverSystem* sys, int max_num_levers, SerialLeverHandle* levers);
+//  The levers are served by `num_workers` threads, each owning a consecutive run of them; 0 sizes
+//  the pool to the number of levers and cores. `lever_group_sizes` splits the levers into
+//  consecutive groups, e.g. the levers of each rig, that are never split across workers; by
+//  default each lever is its own group. There are no more workers than groups.
+void initialize(LeverSystem* sys, int max_num_levers, SerialLeverHandle* levers, int num_workers = 0,
+                const std::vector<int>& lever_group_sizes = {});
 void update(LeverSystem* system);
 void terminate(LeverSystem* sys);
 
 int num_remote_commands(LeverSystem* sys);
+//  Port status responses from all workers.
+RingBufferStats get_remote_queue_stats(LeverSystem* sys);
+int num_workers(LeverSystem* sys);
+int get_worker_index(LeverSystem* system, SerialLeverHandle instance);
 LeverSystem* get_global_lever_system();
 
 void set_force(LeverSystem* system, SerialLeverHandle instance, int grams);
@@ -26,11 +129,66 @@ void open_connection(LeverSystem* system, SerialLeverHandle handle, const std::s
 bool is_pending_open(LeverSystem* system, SerialLeverHandle handle);
 bool is_open(LeverSystem* system, SerialLeverHandle handle);
 void close_connection(LeverSystem* system, SerialLeverHandle handle);
+//  True while the worker is reopening a port that failed, e.g. because its cable was unplugged.
+//  Attempts back off exponentially, and are retried at once when a serial device is added. Opening
+//  or closing the connection stops them.
+bool is_reconnecting(LeverSystem* system, SerialLeverHandle handle);
+int get_num_reconnect_attempts(LeverSystem* system, SerialLeverHandle handle);
+
+//  Serial ports present on the system, as of the last `update`. The list is refreshed in the
+//  background whenever a device is added or removed; `rescan_serial_ports` refreshes it on request.
+const std::vector<PortDescriptor>& get_serial_ports(LeverSystem* system);
+void rescan_serial_ports(LeverSystem* system);
+
+//  Loads `profile` onto the device, unless it already holds it, and runs it there. Force and
+//  direction are not sent to the device while the profile loads and runs; afterwards the
+//  commanded force and direction are those of its last segment.
+void run_force_profile(LeverSystem* system, SerialLeverHandle instance, const LeverForceProfile& profile);
+//  Status of the most recent `run_force_profile`, as of the last `update`.
+ForceProfileStatus get_force_profile_status(LeverSystem* system, SerialLeverHandle instance);
 
 std::optional<int> get_canonical_force(LeverSystem* system, SerialLeverHandle instance);
 int get_commanded_force(LeverSystem* system, SerialLeverHandle instance);
 std::optional<LeverState> get_state(LeverSystem* system, SerialLeverHandle instance);
 std::optional<SerialLeverDirection> get_canonical_direction(LeverSystem* system, SerialLeverHandle instance);
 SerialLeverDirection get_commanded_direction(LeverSystem* system, SerialLeverHandle instance);
+CommandDispatchStats get_command_dispatch_stats(LeverSystem* system, SerialLeverHandle instance);
+LeverIOStats get_io_stats(LeverSystem* system, SerialLeverHandle instance);
+//  As of the last `update`; refreshed every half second or so while the lever is in use.
+CommandLatencyStats get_command_latency_stats(LeverSystem* system, SerialLeverHandle instance);
+const char* to_string(DeviceCommandType type);
+//  Number of state snapshots published by the worker but superseded before the ui thread read them.
+uint64_t get_num_skipped_state_updates(LeverSystem* system, SerialLeverHandle instance);
+
+//  Query the samples received so far, as of the last `update`. Only a fixed number of the most
+//  recent samples is retained.
+std::optional<LeverSample> get_latest_sample(LeverSystem* system, SerialLeverHandle instance);
+//  Copies the samples with time in [t0, t1], oldest first, to `dst`; returns how many were copied.
+int get_samples(LeverSystem* system, SerialLeverHandle instance, const TimePoint& t0,
+                const TimePoint& t1, LeverSample* dst, int max_num_samples);
+//  State at `t`, linearly interpolated between the samples around it. Returns nullopt if `t` lies
+//  outside the retained samples.
+std::optional<LeverState> state_at(LeverSystem* system, SerialLeverHandle instance, const TimePoint& t);
+//  Relation of the device clock to host time, refined continuously while the lever is open. Nullopt
+//  while the device does not answer clock reads, rather than a fit that is no longer refined.
+std::optional<DeviceClockEstimate> get_clock_estimate(LeverSystem* system, SerialLeverHandle instance);
+//  Samples lost because the ui thread did not call `update` often enough.
+uint64_t get_num_overwritten_samples(LeverSystem* system, SerialLeverHandle instance);
+
+//  Pull detection for a lever with an enabled config runs on the device, which reports each edge as
+//  soon as its potentiometer crosses a threshold, or on the lever worker for every sample it
+//  receives if the device does not support it. Setting an unchanged config is a no-op.
+void set_pull_detect_config(LeverSystem* system, SerialLeverHandle instance, const PullDetectConfig& config);
+//  Moves up to `max_num_events` pending pull events, oldest first, to `dst`; returns how many.
+int read_pull_events(LeverSystem* system, SerialLeverHandle instance, PullEvent* dst, int max_num_events);
+//  Events lost because they were not read quickly enough.
+uint64_t get_num_dropped_pull_events(LeverSystem* system, SerialLeverHandle instance);
+
+//  Streams every sample of every lever to `file_path`, with times relative to `t0`, until
+//  `stop_recording` or `terminate`. See lever_recorder.hpp for the file format.
+bool start_recording(LeverSystem* system, const std::string& file_path, const TimePoint& t0);
+void stop_recording(LeverSystem* system);
+bool is_recording(LeverSystem* system);
+LeverRecordingStats get_recording_stats(LeverSystem* system);
 
 }
\ No newline at end of file
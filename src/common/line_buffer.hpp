@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace om {
+
+/*
+ * LineBuffer - Fixed-capacity receive buffer for a byte stream, tokenized into lines in place.
+ * Bytes are read directly into `write_space` and consumed from the front; the unread bytes are
+ * moved to the start of the storage only when the free space at the back runs out, so steady-state
+ * use never allocates. Views returned by `pending` and `next_line` are valid until the next call
+ * to `write_space`.
+ */
+
+template <int Capacity>
+struct LineBuffer {
+  static_assert(Capacity > 0);
+
+  char data[Capacity];
+  int begin{};
+  int end{};
+  //  Number of times the buffer filled without a complete line, discarding its contents.
+  uint64_t num_overflows{};
+};
+
+template <int Capacity>
+int size(const LineBuffer<Capacity>& buff) {
+  return buff.end - buff.begin;
+}
+
+template <int Capacity>
+void clear(LineBuffer<Capacity>* buff) {
+  buff->begin = 0;
+  buff->end = 0;
+}
+
+//  Returns the free space at the back of the buffer, compacting it first if necessary. A buffer
+//  that is full of unconsumed bytes is discarded, since no line can be longer than the buffer.
+template <int Capacity>
+std::pair<char*, int> write_space(LineBuffer<Capacity>* buff) {
+  if (buff->end == Capacity) {
+    if (buff->begin == 0) {
+      buff->end = 0;
+      buff->num_overflows++;
+    } else {
+      const int num_pending = size(*buff);
+      std::memmove(buff->data, buff->data + buff->begin, size_t(num_pending));
+      buff->begin = 0;
+      buff->end = num_pending;
+    }
+  }
+  return {buff->data + buff->end, Capacity - buff->end};
+}
+
+template <int Capacity>
+void commit_write(LineBuffer<Capacity>* buff, int num_written) {
+  assert(num_written >= 0 && buff->end + num_written <= Capacity);
+  buff->end += num_written;
+}
+
+template <int Capacity>
+std::string_view pending(const LineBuffer<Capacity>& buff) {
+  return std::string_view{buff.data + buff.begin, size_t(size(buff))};
+}
+
+template <int Capacity>
+void consume(LineBuffer<Capacity>* buff, int num_bytes) {
+  assert(num_bytes >= 0 && num_bytes <= size(*buff));
+  buff->begin += num_bytes;
+  if (buff->begin == buff->end) {
+    clear(buff);
+  }
+}
+
+//  Consumes and returns the next complete line, including its terminating '\n'.
+template <int Capacity>
+std::optional<std::string_view> next_line(LineBuffer<Capacity>* buff) {
+  auto view = pending(*buff);
+  auto eol = view.find('\n');
+  if (eol == std::string_view::npos) {
+    return std::nullopt;
+  }
+  auto line = view.substr(0, eol + 1);
+  consume(buff, int(line.size()));
+  return line;
+}
+
+}
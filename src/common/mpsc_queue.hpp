@@ -0,0 +1,141 @@
+#pragma once
+
+#include "common.hpp"
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+namespace om {
+
+/*
+ * MPSCQueue - A bounded, non-locking queue that is thread-safe for any number of writers and 1
+ * reader, with space for N elements. N must be a power of two.
+ *
+ * Each slot carries a sequence number that tells writers whether the slot is free for the current
+ * lap and tells the reader whether the slot's element has been published. Writers claim a slot by
+ * advancing a shared write index with compare-exchange; they never wait on each other beyond that.
+ * If the queue is full, `maybe_write` fails rather than blocking.
+ */
+
+template <typename T, int N>
+class MPSCQueue {
+private:
+  static constexpr int capacity = N;
+  static constexpr uint32_t index_mask = uint32_t(N - 1);
+
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    T data;
+  };
+
+public:
+  MPSCQueue();
+
+  //  by writers
+  template <typename U = T>
+  bool maybe_write(U&& element) noexcept;
+
+  //  by reader
+  bool maybe_read(T* out) noexcept;
+  //  Move up to `max_num` published elements into `out`, in order. Returns the number read.
+  int read_batch(T* out, int max_num) noexcept;
+  //  Invoke `f(T&)` on each published element in order, then release the slots. Returns the number
+  //  of elements visited.
+  template <typename F>
+  int drain(F&& f, int max_num = N) noexcept;
+
+  //  Approximate number of elements pending read; exact only when writers are idle.
+  int size() const noexcept;
+
+  int write_capacity() const noexcept {
+    return N;
+  }
+
+private:
+  std::unique_ptr<Slot[]> slots;
+
+  alignas(cache_line_size) std::atomic<uint32_t> wp{0};
+  alignas(cache_line_size) std::atomic<uint32_t> rp{0};
+};
+
+/*
+ * Impl
+ */
+
+template <typename T, int N>
+MPSCQueue<T, N>::MPSCQueue() : slots(new Slot[N]{}) {
+  static_assert(N > 1, "Expected N > 1.");
+  static_assert((N & (N - 1)) == 0, "Expected N to be a power of two.");
+  for (int i = 0; i < N; i++) {
+    slots[i].sequence.store(uint32_t(i), std::memory_order_relaxed);
+  }
+}
+
+template <typename T, int N>
+template <typename U>
+bool MPSCQueue<T, N>::maybe_write(U&& element) noexcept {
+  auto w = wp.load(std::memory_order_relaxed);
+  Slot* slot;
+
+  while (true) {
+    slot = &slots[w & index_mask];
+    const auto seq = slot->sequence.load(std::memory_order_acquire);
+    const auto dif = int32_t(seq - w);
+    if (dif == 0) {
+      if (wp.compare_exchange_weak(w, w + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (dif < 0) {
+      //  The slot still holds an element from the previous lap.
+      return false;
+    } else {
+      w = wp.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->data = std::forward<U>(element);
+  slot->sequence.store(w + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T, int N>
+template <typename F>
+int MPSCQueue<T, N>::drain(F&& f, int max_num) noexcept {
+  auto r = rp.load(std::memory_order_relaxed);
+  int num_read{};
+
+  while (num_read < max_num) {
+    auto& slot = slots[r & index_mask];
+    if (slot.sequence.load(std::memory_order_acquire) != r + 1) {
+      break;
+    }
+    f(slot.data);
+    slot.sequence.store(r + uint32_t(capacity), std::memory_order_release);
+    r++;
+    num_read++;
+  }
+
+  rp.store(r, std::memory_order_relaxed);
+  return num_read;
+}
+
+template <typename T, int N>
+int MPSCQueue<T, N>::read_batch(T* out, int max_num) noexcept {
+  return drain([out](T& element) mutable {
+    *out++ = std::move(element);
+  }, max_num);
+}
+
+template <typename T, int N>
+bool MPSCQueue<T, N>::maybe_read(T* out) noexcept {
+  return read_batch(out, 1) == 1;
+}
+
+template <typename T, int N>
+int MPSCQueue<T, N>::size() const noexcept {
+  const auto w = wp.load(std::memory_order_acquire);
+  const auto r = rp.load(std::memory_order_relaxed);
+  return int(w - r);
+}
+
+}
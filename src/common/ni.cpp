@@ -1,5 +1,5 @@
 #include "ni.hpp"
-#include "ringbuffer.hpp"
+#include "ringbuffer_pinned_storage.hpp"
 #include "common.hpp"
 #include <NIDAQmx.h>
 #include <vector>
@@ -7,13 +7,15 @@
 #include <optional>
 #include <atomic>
 #include <mutex>
+#include <cmath>
 
 namespace {
 
 using namespace om;
 
 struct Config {
-  static constexpr int input_sample_buffer_ring_buffer_capacity = 16;
+  static constexpr int min_sample_buffer_queue_capacity = 16;
+  static constexpr double default_sample_buffer_queue_duration_s = 1.0;
   static constexpr uint64_t input_sample_index_sync_interval = 10000;
 };
 
@@ -116,25 +118,12 @@ void push_trigger_time_point(
   tps->time_points.push_back(tp);
 }
 
-struct StaticSampleBufferArray {
+struct SampleBufferArray {
   void clear() {
     num_buffers = 0;
   }
 
-  void push(ni::SampleBuffer buff) {
-    assert(num_buffers < Config::input_sample_buffer_ring_buffer_capacity);
-    buffers[num_buffers++] = buff;
-  }
-
-  std::optional<ni::SampleBuffer> pop_back() {
-    if (num_buffers > 0) {
-      return buffers[--num_buffers];
-    } else {
-      return std::nullopt;
-    }
-  }
-
-  ni::SampleBuffer buffers[Config::input_sample_buffer_ring_buffer_capacity]{};
+  std::vector<ni::SampleBuffer> buffers;
   int num_buffers{};
 };
 
@@ -149,7 +138,7 @@ struct {
   NITriggerDetect ni_trigger_detect{};
   std::mutex ni_trigger_time_point_mutex{};
 
-  std::vector<double> daq_sample_buffer;
+  double* daq_sample_buffer{};
   int num_samples_per_input_channel{};
   int num_analog_input_channels{};
   double input_sample_rate{};
@@ -159,13 +148,13 @@ struct {
   ni::ChannelDescriptor analog_output_channel_descs[32]{};
   int num_analog_output_channels{};
 
-  RingBuffer<ni::SampleBuffer, Config::input_sample_buffer_ring_buffer_capacity> send_to_ni_daq;
-  StaticSampleBufferArray received_from_ni{};
-
-  RingBuffer<ni::SampleBuffer, Config::input_sample_buffer_ring_buffer_capacity> send_from_ni_daq;
-  StaticSampleBufferArray available_to_send_to_ui{};
+  PinnedRingBuffer<ni::SampleBuffer> send_to_ni_daq;
+  PinnedRingBuffer<ni::SampleBuffer> send_from_ni_daq;
+  //  Contiguous copy of the buffers currently peeked from `send_from_ni_daq`.
+  SampleBufferArray received_from_ni{};
 
-  std::vector<std::unique_ptr<double[]>> sample_buffer_data;
+  //  Backs `daq_sample_buffer` followed by the data of every sample buffer in flight.
+  PinnedRegion sample_data_region{};
   om::TimePoint time0{};
   bool initialized{};
 
@@ -207,43 +196,38 @@ void ni_trigger_detect(
   return uint32_t(num_read);
 }
 
-void ni_acquire_sample_buffers() {
-  const int num_rcv = globals.send_to_ni_daq.size();
-  for (int i = 0; i < num_rcv; i++) {
-    globals.available_to_send_to_ui.push(globals.send_to_ni_daq.read());
-  }
-}
-
 void ni_maybe_send_sample_buffer(
   const double* read_buff, uint32_t num_samples, uint64_t sample0_index, double sample0_time) {
   //
-  if (globals.send_from_ni_daq.full()) {
+  //  Buffers returned by the ui are filled and handed back in place, without intermediate copies.
+  auto available = globals.send_to_ni_daq.peek_read();
+  auto dst = globals.send_from_ni_daq.prepare_write(1);
+  if (available.size() == 0 || dst.size() == 0) {
+    globals.send_from_ni_daq.record_dropped();
     return;
   }
 
   const uint32_t num_channels = globals.num_analog_input_channels;
-  if (auto opt_send = globals.available_to_send_to_ui.pop_back()) {
-    auto& send = opt_send.value();
-    const uint32_t tot_data_size = num_samples * num_channels;
-
-    memcpy(send.data, read_buff, sizeof(double) * tot_data_size);
-    send.num_samples_per_channel = num_samples;
-    send.num_channels = num_channels;
-    send.sample0_time = sample0_time;
-    send.sample0_index = sample0_index;
-
-    globals.send_from_ni_daq.write(send);
-  }
+  auto& send = dst[0];
+  send.data = available[0].data;
+  const uint32_t tot_data_size = num_samples * num_channels;
+
+  memcpy(send.data, read_buff, sizeof(double) * tot_data_size);
+  send.num_samples_per_channel = num_samples;
+  send.num_channels = num_channels;
+  send.sample0_time = sample0_time;
+  send.sample0_index = sample0_index;
+
+  globals.send_to_ni_daq.consume(1);
+  globals.send_from_ni_daq.commit_write(1);
 }
 
 int32 CVICALLBACK ni_input_sample_callback(TaskHandle task, int32, uInt32 num_samples, void*) {
   //
   assert(num_samples == globals.num_samples_per_input_channel);
-  assert(globals.daq_sample_buffer.size() == num_samples * globals.num_analog_input_channels);
+  assert(globals.daq_sample_buffer);
 
-  ni_acquire_sample_buffers();
-
-  double* read_buff = globals.daq_sample_buffer.data();
+  double* read_buff = globals.daq_sample_buffer;
   const uint32_t num_read = ni_read_data(task, read_buff, num_samples);
 
   const uint64_t sample0_index = globals.ni_num_input_samples_acquired;
@@ -265,24 +249,54 @@ int32 CVICALLBACK ni_input_sample_callback(TaskHandle task, int32, uInt32 num_sa
   return 0;
 }
 
-void init_input_data_handoff(int num_channels, int num_samples_per_channel) {
-  assert(globals.sample_buffer_data.empty());
+int sample_buffer_queue_capacity(const ni::InitParams& params) {
+  if (params.sample_buffer_queue_capacity) {
+    return std::max(2, params.sample_buffer_queue_capacity.value());
+  }
+
+  const double buffers_per_s = params.sample_rate / double(params.num_samples_per_channel);
+  const int cap = int(std::ceil(buffers_per_s * Config::default_sample_buffer_queue_duration_s)) + 1;
+  return std::max(Config::min_sample_buffer_queue_capacity, cap);
+}
+
+bool init_input_data_handoff(const ni::InitParams& params) {
+  assert(!globals.sample_data_region.data);
+
+  PinnedRegionParams region_params{};
+  region_params.try_huge_pages = params.lock_sample_memory;
+  region_params.lock = params.lock_sample_memory;
+
+  const int queue_cap = sample_buffer_queue_capacity(params);
+  if (!globals.send_to_ni_daq.get_storage().init(queue_cap, region_params) ||
+      !globals.send_from_ni_daq.get_storage().init(queue_cap, region_params)) {
+    return false;
+  }
+
+  //  The ring buffers round their capacity up to a power of two, and hold one less than that.
+  const int num_buffers = globals.send_to_ni_daq.write_capacity();
+  globals.received_from_ni.buffers.resize(num_buffers);
 
-  const int total_num_samples = num_channels * num_samples_per_channel;
-  globals.daq_sample_buffer.resize(total_num_samples);
+  const size_t total_num_samples =
+    size_t(params.num_analog_input_channels) * size_t(params.num_samples_per_channel);
+  auto region = allocate_pinned_region(
+    sizeof(double) * total_num_samples * size_t(num_buffers + 1), region_params);
+  if (!region) {
+    return false;
+  }
 
-  for (int i = 0; i < Config::input_sample_buffer_ring_buffer_capacity - 1; i++) {
-    //  - 1 because ring buffer capacity is actually one less than
-    //  `input_sample_buffer_ring_buffer_capacity`
-    auto& dst = globals.sample_buffer_data.emplace_back();
-    dst = std::make_unique<double[]>(total_num_samples);
+  globals.sample_data_region = region.value();
+  auto* sample_data = static_cast<double*>(globals.sample_data_region.data);
+  globals.daq_sample_buffer = sample_data;
 
+  for (int i = 0; i < num_buffers; i++) {
     ni::SampleBuffer buff{};
-    buff.data = dst.get();
+    buff.data = sample_data + total_num_samples * size_t(i + 1);
     if (!globals.send_to_ni_daq.maybe_write(buff)) {
       assert(false);
     }
   }
+
+  return true;
 }
 
 bool start_outputs(const ni::InitParams& params) {
@@ -447,9 +461,7 @@ bool ni::init_ni(const InitParams& params) {
   globals.num_analog_input_channels = params.num_analog_input_channels;
   globals.num_samples_per_input_channel = params.num_samples_per_channel;
 
-  init_input_data_handoff(params.num_analog_input_channels, params.num_samples_per_channel);
-
-  if (!start_daq(params)) {
+  if (!init_input_data_handoff(params) || !start_daq(params)) {
     terminate_ni();
     return false;
   } else {
@@ -511,7 +523,7 @@ void ni::update_ni() {
 
 void ni::terminate_ni() {
   stop_daq();
-  globals.daq_sample_buffer.clear();
+  globals.daq_sample_buffer = nullptr;
   globals.ni_trigger_detect.reset();
   globals.num_samples_per_input_channel = 0;
   globals.num_analog_input_channels = 0;
@@ -521,8 +533,10 @@ void ni::terminate_ni() {
   globals.send_to_ni_daq.clear();
   globals.send_from_ni_daq.clear();
   globals.received_from_ni.clear();
-  globals.available_to_send_to_ui.clear();
-  globals.sample_buffer_data.clear();
+  globals.received_from_ni.buffers.clear();
+  globals.send_to_ni_daq.get_storage().release();
+  globals.send_from_ni_daq.get_storage().release();
+  free_pinned_region(&globals.sample_data_region);
   globals.time0 = {};
   globals.output_pulse_queue.clear();
   globals.input_sample_sync_points.clear();
@@ -530,26 +544,36 @@ void ni::terminate_ni() {
 }
 
 int ni::read_sample_buffers(const SampleBuffer** buffs) {
-  int num_rcv = globals.send_from_ni_daq.size();
-  for (int i = 0; i < num_rcv; i++) {
-    globals.received_from_ni.push(globals.send_from_ni_daq.read());
-  }
-
-  *buffs = globals.received_from_ni.buffers;
-  return globals.received_from_ni.num_buffers;
+  //  Buffers stay in `send_from_ni_daq` until released, so repeated calls between releases see
+  //  the same buffers plus any that arrived since.
+  auto rcv = globals.send_from_ni_daq.peek_read();
+  auto& dst = globals.received_from_ni;
+  std::copy(rcv.first, rcv.first + rcv.first_size, dst.buffers.data());
+  std::copy(rcv.second, rcv.second + rcv.second_size, dst.buffers.data() + rcv.first_size);
+  dst.num_buffers = rcv.size();
+
+  *buffs = dst.buffers.data();
+  return dst.num_buffers;
 }
 
 void ni::release_sample_buffers() {
-  while (true) {
-    auto buff = globals.received_from_ni.pop_back();
-    if (buff) {
-      if (!globals.send_to_ni_daq.maybe_write(std::move(buff.value()))) {
-        assert(false);
-      }
-    } else {
-      break;
-    }
+  auto& rcv = globals.received_from_ni;
+  if (rcv.num_buffers == 0) {
+    return;
+  }
+
+  if (globals.send_to_ni_daq.num_free() < rcv.num_buffers) {
+    assert(false);
+    return;
   }
+
+  globals.send_to_ni_daq.write_range_copy(rcv.buffers.data(), rcv.buffers.data() + rcv.num_buffers);
+  globals.send_from_ni_daq.consume(rcv.num_buffers);
+  rcv.clear();
+}
+
+RingBufferStats ni::read_sample_buffer_queue_stats() {
+  return globals.send_from_ni_daq.stats();
 }
 
 om::TimePoint ni::read_time0() {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "time.hpp"
+#include "ringbuffer.hpp"
 #include <vector>
 #include <optional>
 
@@ -21,6 +22,11 @@ struct InitParams {
   const ChannelDescriptor* analog_output_channels;
   int num_analog_output_channels;
   std::optional<const char*> sample_clock_channel_name;
+  //  Number of sample buffers that can be in flight between the NI callback and the ui thread. If
+  //  unset, enough to hold about one second of samples.
+  std::optional<int> sample_buffer_queue_capacity;
+  //  Pre-fault and lock sample memory, backed by huge pages where possible.
+  bool lock_sample_memory{true};
 };
 
 struct TriggerTimePoint {
@@ -42,6 +48,9 @@ void terminate_ni();
 
 int read_sample_buffers(const SampleBuffer** buffs);
 void release_sample_buffers();
+//  Counters for the queue of sample buffers sent from the NI callback to the ui thread. A buffer is
+//  dropped when the queue is full or when the ui thread holds every buffer.
+RingBufferStats read_sample_buffer_queue_stats();
 
 om::TimePoint read_time0();
 std::vector<TriggerTimePoint> read_trigger_time_points();
@@ -27,6 +27,12 @@ void om::gui::render_ni_gui(NIGUIData* gui, const ni::SampleBuffer* buffs, int n
     ImGui::TreePop();
   }
 
+  {
+    const auto queue_stats = ni::read_sample_buffer_queue_stats();
+    ImGui::Text("SampleBufferQueue: %d dropped | %d high water",
+                int(queue_stats.num_dropped), queue_stats.high_water_mark);
+  }
+
   if (ImGui::TreeNode("StartTriggerTimePoints")) {
     for (int i = 0; i < std::min(16, int(trigger_time_points.size())); i++) {
       auto& tp = trigger_time_points[i];
@@ -37,7 +43,13 @@ void om::gui::render_ni_gui(NIGUIData* gui, const ni::SampleBuffer* buffs, int n
 
   if (ImGui::TreeNode("VoltagePlot")) {
     ImPlot::BeginPlot("TriggerChannel");
-    ImPlot::PlotLine("Trigger", gui->sample_history.data.data(), gui->sample_history.size);
+    //  The history wraps around, so it is copied into one run; two lines would leave a gap where
+    //  the runs meet.
+    auto history = gui->sample_history.view();
+    auto& samples = gui->plot_samples;
+    samples.assign(history.first, history.first + history.first_size);
+    samples.insert(samples.end(), history.second, history.second + history.second_size);
+    ImPlot::PlotLine("Trigger", samples.data(), int(samples.size()));
     ImPlot::EndPlot();
     ImGui::TreePop();
   }
@@ -2,6 +2,7 @@
 
 #include "sample_queue.hpp"
 #include "ni.hpp"
+#include <vector>
 
 namespace om::led {
 struct LEDSync;
@@ -11,6 +12,8 @@ namespace om::gui {
 
 struct NIGUIData {
   SampleQueue<double> sample_history;
+  //  The history in one run, for plotting; reused between frames.
+  std::vector<double> plot_samples;
 };
 
 void render_ni_gui(NIGUIData* gui, const ni::SampleBuffer* buffs, int num_sample_buffs, om::led::LEDSync* sync);
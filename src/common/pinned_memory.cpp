@@ -0,0 +1,151 @@
+#include "pinned_memory.hpp"
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace om {
+
+namespace {
+
+struct Config {
+  static constexpr size_t huge_page_size = size_t(2) * 1024 * 1024;
+};
+
+size_t round_up(size_t size, size_t multiple) {
+  return ((size + multiple - 1) / multiple) * multiple;
+}
+
+#ifdef _WIN32
+
+size_t page_size() {
+  SYSTEM_INFO info{};
+  GetSystemInfo(&info);
+  return size_t(info.dwPageSize);
+}
+
+void* map_huge_pages(size_t size) {
+  //  Requires the "Lock pages in memory" privilege; fails otherwise.
+  return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+}
+
+void* map_pages(size_t size) {
+  return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void unmap(void* data, size_t) {
+  VirtualFree(data, 0, MEM_RELEASE);
+}
+
+bool lock_pages(void* data, size_t size) {
+  return VirtualLock(data, size) != 0;
+}
+
+void unlock_pages(void* data, size_t size) {
+  VirtualUnlock(data, size);
+}
+
+#else
+
+size_t page_size() {
+  return size_t(sysconf(_SC_PAGESIZE));
+}
+
+void* map_huge_pages(size_t size) {
+#if defined(__linux__)
+  void* res = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+  return res == MAP_FAILED ? nullptr : res;
+#else
+  (void) size;
+  return nullptr;
+#endif
+}
+
+//  Not populated, so that transparent huge pages can be requested before the pages are touched.
+void* map_pages(size_t size) {
+#if defined(__linux__)
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#else
+  const int flags = MAP_PRIVATE | MAP_ANON;
+#endif
+  void* res = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  return res == MAP_FAILED ? nullptr : res;
+}
+
+void unmap(void* data, size_t size) {
+  munmap(data, size);
+}
+
+bool lock_pages(void* data, size_t size) {
+  return mlock(data, size) == 0;
+}
+
+void unlock_pages(void* data, size_t size) {
+  munlock(data, size);
+}
+
+#endif
+
+} //  anon
+
+std::optional<PinnedRegion> allocate_pinned_region(size_t size, const PinnedRegionParams& params) {
+  if (size == 0) {
+    return std::nullopt;
+  }
+
+  PinnedRegion result{};
+  if (params.try_huge_pages && size >= Config::huge_page_size) {
+    result.size = round_up(size, Config::huge_page_size);
+    result.data = map_huge_pages(result.size);
+    result.huge_pages = result.data != nullptr;
+  }
+
+  if (!result.data) {
+    result.size = round_up(size, page_size());
+    result.data = map_pages(result.size);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (result.data && params.try_huge_pages && size >= Config::huge_page_size) {
+      //  Fall back to transparent huge pages, if enabled. The pages are faulted in below, after this.
+      (void) madvise(result.data, result.size, MADV_HUGEPAGE);
+    }
+#endif
+  }
+
+  if (!result.data) {
+    printf("Failed to map pinned region of %zu bytes.\n", size);
+    return std::nullopt;
+  }
+
+  //  Touch every page now rather than on first use.
+  std::memset(result.data, 0, result.size);
+
+  if (params.lock) {
+    result.locked = lock_pages(result.data, result.size);
+    if (!result.locked) {
+      printf("Failed to lock pinned region of %zu bytes; continuing unlocked.\n", result.size);
+    }
+  }
+
+  return result;
+}
+
+void free_pinned_region(PinnedRegion* region) {
+  if (region->data) {
+    if (region->locked) {
+      unlock_pages(region->data, region->size);
+    }
+    unmap(region->data, region->size);
+  }
+  *region = {};
+}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <optional>
+#include <cstddef>
+
+namespace om {
+
+struct PinnedRegionParams {
+  //  Back the region with huge pages if it is large enough and the system allows it.
+  bool try_huge_pages;
+  //  Lock the region into physical memory, so that it is never paged out.
+  bool lock;
+};
+
+/*
+ * PinnedRegion - Page-aligned memory that is zero-filled and fully faulted in at allocation, so
+ * that first touch from a real-time thread does not page-fault.
+ */
+
+struct PinnedRegion {
+  void* data;
+  size_t size;
+  bool huge_pages;
+  bool locked;
+};
+
+std::optional<PinnedRegion> allocate_pinned_region(size_t size, const PinnedRegionParams& params);
+void free_pinned_region(PinnedRegion* region);
+
+}
@@ -1,11 +1,11 @@
 #include "render.hpp"
+#include "slot_map.hpp"
 #include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include <cassert>
-#include <unordered_map>
 #include <glad/glad.h>
 #include <optional>
 #include <iostream>
@@ -31,14 +31,17 @@ struct Program {
 };
 
 struct ProgramHandle {
+  OM_INTEGER_IDENTIFIER_EQUALITY(ProgramHandle, id)
   uint32_t id;
 };
 
 struct VaoHandle {
+  OM_INTEGER_IDENTIFIER_EQUALITY(VaoHandle, id)
   uint32_t id;
 };
 
 struct BufferHandle {
+  OM_INTEGER_IDENTIFIER_EQUALITY(BufferHandle, id)
   uint32_t id;
 };
 
@@ -55,15 +58,10 @@ struct QuadDrawable {
 };
 
 struct {
-  uint32_t next_buffer_handle_id{1};
-  uint32_t next_vao_handle_id{1};
-  uint32_t next_texture_handle_id{1};
-  uint32_t next_program_handle_id{1};
-
-  std::unordered_map<uint32_t, Buffer> buffers;
-  std::unordered_map<uint32_t, Texture> textures;
-  std::unordered_map<uint32_t, Vao> vaos;
-  std::unordered_map<uint32_t, Program> programs;
+  SlotMap<BufferHandle, Buffer> buffers;
+  SlotMap<TextureHandle, Texture> textures;
+  SlotMap<VaoHandle, Vao> vaos;
+  SlotMap<ProgramHandle, Program> programs;
 
   VaoHandle quad_vao{};
   ProgramHandle image_program{};
@@ -124,18 +122,14 @@ ProgramHandle create_program(const char* vert, const char* frag) {
   glDeleteShader(vert_shader);
   glDeleteShader(frag_shader);
 
-  ProgramHandle result{globals.next_program_handle_id++};
-  globals.programs[result.id] = prog;
-  return result;
+  return globals.programs.insert(prog);
 }
 
 VaoHandle create_vao() {
   Vao vao{};
   glGenVertexArrays(1, &vao.handle);
 
-  VaoHandle result{globals.next_vao_handle_id++};
-  globals.vaos[result.id] = vao;
-  return result;
+  return globals.vaos.insert(vao);
 }
 
 const char* get_quad_vert_source() {
@@ -216,9 +210,7 @@ BufferHandle create_buffer() {
   Buffer buff{};
   glGenBuffers(1, &buff.handle);
 
-  BufferHandle result{globals.next_buffer_handle_id++};
-  globals.buffers[result.id] = buff;
-  return result;
+  return globals.buffers.insert(buff);
 }
 
 VaoHandle create_2d_quad() {
@@ -228,10 +220,10 @@ VaoHandle create_2d_quad() {
   };
 
   auto buff_handle = create_buffer();
-  auto& buff = globals.buffers.at(buff_handle.id);
+  auto& buff = globals.buffers.at(buff_handle);
 
   auto vao_handle = create_vao();
-  auto& vao = globals.vaos.at(vao_handle.id);
+  auto& vao = globals.vaos.at(vao_handle);
 
   glBindBuffer(GL_ARRAY_BUFFER, buff.handle);
   glBufferData(GL_ARRAY_BUFFER, 12 * sizeof(float), data, GL_STATIC_DRAW);
@@ -245,15 +237,15 @@ VaoHandle create_2d_quad() {
 }
 
 Program* get_program(ProgramHandle handle) {
-  return &globals.programs.at(handle.id);
+  return &globals.programs.at(handle);
 }
 
 Vao* get_vao(VaoHandle handle) {
-  return &globals.vaos.at(handle.id);
+  return &globals.vaos.at(handle);
 }
 
 Texture* get_texture(TextureHandle handle) {
-  return &globals.textures.at(handle.id);
+  return &globals.textures.at(handle);
 }
 
 template <typename Drawable>
@@ -330,16 +322,16 @@ void submit_frame() {
 }
 
 void terminate_rendering() {
-  for (auto& [_, vao] : globals.vaos) {
+  for (auto& vao : globals.vaos) {
     glDeleteVertexArrays(1, &vao.handle);
   }
-  for (auto& [_, buff] : globals.buffers) {
+  for (auto& buff : globals.buffers) {
     glDeleteBuffers(1, &buff.handle);
   }
-  for (auto& [_, texture] : globals.textures) {
+  for (auto& texture : globals.textures) {
     glDeleteTextures(1, &texture.handle);
   }
-  for (auto& [_, prog] : globals.programs) {
+  for (auto& prog : globals.programs) {
     glDeleteProgram(prog.handle);
   }
 
@@ -357,8 +349,7 @@ TextureHandle create_2d_image(const void* data, int w, int h, int nc) {
   Texture tex{};
   glGenTextures(1, &tex.handle);
 
-  TextureHandle result{globals.next_texture_handle_id++};
-  globals.textures[result.id] = tex;
+  TextureHandle result = globals.textures.insert(tex);
 
   glBindTexture(GL_TEXTURE_2D, tex.handle);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
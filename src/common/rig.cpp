@@ -0,0 +1,76 @@
+#include "rig.hpp"
+#include <cassert>
+
+namespace om {
+
+int total_num_levers(const std::vector<RigDescriptor>& descs) {
+  int result{};
+  for (auto& desc : descs) {
+    result += desc.num_levers;
+  }
+  return result;
+}
+
+int total_num_pumps(const std::vector<RigDescriptor>& descs) {
+  int result{};
+  for (auto& desc : descs) {
+    result += desc.num_pumps;
+  }
+  return result;
+}
+
+std::vector<int> num_levers_per_rig(const std::vector<RigDescriptor>& descs) {
+  std::vector<int> result;
+  for (auto& desc : descs) {
+    result.push_back(desc.num_levers);
+  }
+  return result;
+}
+
+std::vector<Rig> make_rigs(const std::vector<RigDescriptor>& descs,
+                           const std::vector<lever::SerialLeverHandle>& levers) {
+  assert(int(levers.size()) == total_num_levers(descs));
+
+  std::vector<Rig> result;
+  int lever_index{};
+  int pump_index{};
+  for (int i = 0; i < int(descs.size()); i++) {
+    auto& desc = descs[i];
+    assert(!desc.stimulus_regions.empty());
+
+    Rig rig{};
+    rig.index = i;
+    rig.name = desc.name.empty() ? "Rig" + std::to_string(i) : desc.name;
+    rig.first_lever_index = lever_index;
+    for (int j = 0; j < desc.num_levers; j++) {
+      rig.levers.push_back(levers[lever_index++]);
+    }
+    for (int j = 0; j < desc.num_pumps; j++) {
+      rig.pumps.push_back(pump::ith_pump(pump_index++));
+    }
+    rig.stimulus_regions = desc.stimulus_regions;
+    result.push_back(std::move(rig));
+  }
+  return result;
+}
+
+std::vector<RigDescriptor> make_side_by_side_rigs(int num_rigs, int num_levers, int num_pumps) {
+  std::vector<RigDescriptor> result;
+  const float width = 2.0f / float(num_rigs);
+  for (int i = 0; i < num_rigs; i++) {
+    RigDescriptor desc{};
+    desc.num_levers = num_levers;
+    desc.num_pumps = num_pumps;
+    desc.stimulus_regions[0].center = Vec2f{-1.0f + width * (float(i) + 0.5f), 0.0f};
+    desc.stimulus_regions[0].half_size = Vec2f{width * 0.5f, 1.0f};
+    result.push_back(std::move(desc));
+  }
+  return result;
+}
+
+const StimulusRegion& stimulus_region(const Rig& rig, int i) {
+  assert(!rig.stimulus_regions.empty());
+  return rig.stimulus_regions[std::min(i, int(rig.stimulus_regions.size()) - 1)];
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "lever_system.hpp"
+#include "juice_pump.hpp"
+#include "vector.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace om {
+
+/*
+ * Rig - One behavioral setup: a set of levers, the juice pumps that reward them, and the regions of
+ * the render window in which its stimuli are drawn. Several rigs may be run by one App; their levers
+ * are served by the lever system's shared workers, all of a rig's levers by the same worker, and
+ * their pumps are consecutive pumps on the one pump chain.
+ *
+ * A StimulusRegion maps the render window's normalized coordinates ([-1, 1] on each axis) onto a
+ * sub-rectangle of the window, so that a task can place its stimuli as though it had the whole
+ * window to itself. Sizes are scaled by the region's smaller half-extent, so that stimuli keep their
+ * shape in a region that is not square.
+ */
+
+struct StimulusRegion {
+  Vec2f center{};
+  Vec2f half_size{1.0f};
+};
+
+struct RigDescriptor {
+  std::string name;
+  int num_levers{2};
+  int num_pumps{2};
+  std::vector<StimulusRegion> stimulus_regions{StimulusRegion{}};
+};
+
+struct Rig {
+  int index;
+  std::string name;
+  //  Index of `levers[0]` among all of the App's levers.
+  int first_lever_index;
+  std::vector<lever::SerialLeverHandle> levers;
+  std::vector<pump::PumpHandle> pumps;
+  std::vector<StimulusRegion> stimulus_regions;
+};
+
+int total_num_levers(const std::vector<RigDescriptor>& descs);
+int total_num_pumps(const std::vector<RigDescriptor>& descs);
+//  The number of levers of each rig, e.g. to keep a rig's levers on one lever worker.
+std::vector<int> num_levers_per_rig(const std::vector<RigDescriptor>& descs);
+
+//  Assigns `levers`, which must hold `total_num_levers(descs)` handles, and the pumps to each rig in
+//  order. Rigs without a name are named after their index.
+std::vector<Rig> make_rigs(const std::vector<RigDescriptor>& descs,
+                           const std::vector<lever::SerialLeverHandle>& levers);
+
+//  `num_rigs` descriptors whose single stimulus regions tile the window side by side.
+std::vector<RigDescriptor> make_side_by_side_rigs(int num_rigs, int num_levers, int num_pumps);
+
+inline Vec2f to_window_offset(const StimulusRegion& region, const Vec2f& offset) {
+  return region.center + offset * region.half_size;
+}
+
+inline Vec2f to_window_size(const StimulusRegion& region, const Vec2f& size) {
+  return size * Vec2f{std::min(region.half_size.x, region.half_size.y)};
+}
+
+//  The region in which stimulus `i` of the rig is drawn; stimuli beyond the last region share it.
+const StimulusRegion& stimulus_region(const Rig& rig, int i);
+
+}
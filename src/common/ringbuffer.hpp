@@ -1,8 +1,13 @@
 #pragma once
 
+#include "common.hpp"
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <memory>
+#include <thread>
+#include <type_traits>
+#include <cstdint>
 
 namespace om {
 
@@ -22,10 +27,69 @@ namespace detail {
   };
 }
 
+/*
+ * RingBufferFullPolicy - What `maybe_write` does when the buffer is full.
+ *
+ * RejectNewest: The new element is not written and `maybe_write` returns false.
+ * OverwriteOldest: The oldest unread element is discarded to make room. Requires a trivially
+ *  copyable T, since the reader may copy an element while the writer discards it; such reads are
+ *  detected and retried. peek_read() and consume() are unavailable in this mode.
+ * Block: The writer yields until the reader frees a slot. Not for use on real-time threads.
+ */
+
+enum class RingBufferFullPolicy {
+  RejectNewest = 0,
+  OverwriteOldest,
+  Block
+};
+
+/*
+ * RingBufferStats - Counters maintained by the writer, readable from any thread.
+ */
+
+struct RingBufferStats {
+  //  Elements rejected by `maybe_write` (RejectNewest) or by callers via `record_dropped`.
+  uint64_t num_dropped;
+  //  Unread elements discarded to make room (OverwriteOldest).
+  uint64_t num_overwritten;
+  //  Largest number of elements observed pending read.
+  int high_water_mark;
+};
+
+/*
+ * RingBufferSpans - Up to two contiguous runs of slots in a RingBuffer's storage; `second` is
+ * non-empty only when the run wraps around the end of the storage.
+ */
+
+template <typename T>
+struct RingBufferSpans {
+  int size() const noexcept {
+    return first_size + second_size;
+  }
+
+  T& operator[](int i) const noexcept {
+    return i < first_size ? first[i] : second[i - first_size];
+  }
+
+  T* first;
+  int first_size;
+  T* second;
+  int second_size;
+};
+
+//  Passed as N to size a RingBuffer at runtime, from a Storage with a `capacity` member.
+constexpr int ring_buffer_dynamic_capacity = 0;
+
 /*
  * RingBuffer - A non-locking ring buffer that is thread-safe for 1 reader and 1 writer, with space
- * for N elements. This space is finite; if the buffer becomes full, no further writes are
- * possible.
+ * for N - 1 elements. This space is finite; if the buffer becomes full, no further writes are
+ * possible. N must be a power of two, or `ring_buffer_dynamic_capacity`, in which case the
+ * capacity is that of the storage.
+ *
+ * The read and write indices live on separate cache lines, and each side keeps a cached copy of
+ * the other side's index so that it only touches the other side's cache line when the cached
+ * value says the buffer is empty (reader) or full (writer). `size()` is to be called by the
+ * reader; `num_free()` and `full()` by the writer.
  */
 
 template <typename T, int N>
@@ -42,10 +106,12 @@ struct RingBufferHeapStorage {
   std::unique_ptr<T[]> buffer;
 };
 
-template <typename T, int N, typename Storage = RingBufferStackStorage<T, N>>
+template <typename T, int N, typename Storage = RingBufferStackStorage<T, N>,
+          RingBufferFullPolicy Policy = RingBufferFullPolicy::RejectNewest>
 class RingBuffer {
 private:
-  static constexpr int capacity = N;
+  static constexpr bool dynamic_capacity = N == ring_buffer_dynamic_capacity;
+  static constexpr bool overwrites = Policy == RingBufferFullPolicy::OverwriteOldest;
 
 public:
   RingBuffer();
@@ -53,6 +119,7 @@ public:
   template <typename U = T>
   void write(U&& element) noexcept;
 
+  //  Write `element` if there is space, otherwise apply `Policy`. Returns whether it was written.
   template <typename U = T>
   bool maybe_write(U&& element) noexcept;
 
@@ -61,19 +128,43 @@ public:
   //  Move elements in range [begin, end). Caller must ensure num_free() >= end - begin.
   void write_range_move(T* begin, T* end) noexcept;
 
+  //  Slots for up to `n` elements (fewer if the buffer lacks space) that the writer can construct
+  //  in place, then publish with commit_write().
+  RingBufferSpans<T> prepare_write(int n) noexcept;
+  //  Publish the first `n` slots returned by the last prepare_write().
+  void commit_write(int n) noexcept;
+
+  //  All elements pending read, left in place until consume() is called.
+  RingBufferSpans<T> peek_read() noexcept;
+  //  Release the first `n` elements returned by peek_read(). Consumed slots are not destroyed;
+  //  they keep their values until overwritten by the writer.
+  void consume(int n) noexcept;
+
   T read() noexcept;
   void clear() noexcept;
 
-  //  Number of elements written and pending read.
+  //  Number of elements written and pending read. Elements written since the writer's index was
+  //  last loaded may not be counted, but a size of 0 is always confirmed against the writer.
   int size() const noexcept;
   //  Number of slots that can be written to.
   int num_free() const noexcept;
   bool full() const noexcept;
 
   int write_capacity() const noexcept {
-    return N - 1;
+    return storage_capacity() - 1;
+  }
+
+  //  For storage that must be set up at runtime. Only to be used while no thread is reading from
+  //  or writing to the buffer.
+  Storage& get_storage() noexcept {
+    return storage;
   }
 
+  //  by writer, for elements dropped without calling `maybe_write`.
+  void record_dropped(int n = 1) noexcept;
+  //  Safe to call from any thread.
+  RingBufferStats stats() const noexcept;
+
   T* begin();
   T* end();
   const T* begin() const;
@@ -83,131 +174,269 @@ private:
   template <typename CopyOrMove, typename U>
   void write_range_impl(U* begin, U* end) noexcept;
 
+  int storage_capacity() const noexcept {
+    if constexpr (dynamic_capacity) {
+      return storage.capacity;
+    } else {
+      return N;
+    }
+  }
+
+  uint32_t index_mask() const noexcept {
+    return uint32_t(storage_capacity() - 1);
+  }
+
+  RingBufferSpans<T> make_spans(uint32_t index, int size) noexcept;
+  void discard_oldest() noexcept;
+  void update_high_water_mark(uint32_t w) noexcept;
+
 private:
   Storage storage;
 
-  std::atomic<int> rp{0};
-  std::atomic<int> wp{0};
+  //  Indices increase monotonically and wrap at 2^32; the storage slot is `index & index_mask()`.
+  alignas(cache_line_size) std::atomic<uint32_t> wp{0};
+  mutable uint32_t writer_cached_rp{0};
+  std::atomic<uint64_t> num_dropped{0};
+  std::atomic<uint64_t> num_overwritten{0};
+  std::atomic<int> high_water_mark{0};
+
+  alignas(cache_line_size) std::atomic<uint32_t> rp{0};
+  mutable uint32_t reader_cached_wp{0};
 };
 
 /*
  * Impl
  */
 
-template <typename T, int N, typename Storage>
-RingBuffer<T, N, Storage>::RingBuffer() {
-  static_assert(N > 1, "Expected N > 1.");
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+RingBuffer<T, N, Storage, Policy>::RingBuffer() {
+  static_assert(dynamic_capacity || N > 1, "Expected N > 1.");
+  static_assert((N & (N - 1)) == 0, "Expected N to be a power of two.");
+  static_assert(!overwrites || std::is_trivially_copyable_v<T>,
+                "Expected a trivially copyable T with RingBufferFullPolicy::OverwriteOldest.");
 }
 
-template <typename T, int N, typename Storage>
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
 template <typename U>
-void RingBuffer<T, N, Storage>::write(U&& element) noexcept {
-  auto w = wp.load();
-  storage.buffer[w] = std::forward<U>(element);
-  wp.store((w + 1) % capacity);
+void RingBuffer<T, N, Storage, Policy>::write(U&& element) noexcept {
+  auto w = wp.load(std::memory_order_relaxed);
+  storage.buffer[w & index_mask()] = std::forward<U>(element);
+  wp.store(w + 1, std::memory_order_release);
+  update_high_water_mark(w + 1);
 }
 
-template <typename T, int N, typename Storage>
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
 template <typename CopyOrMove, typename U>
-void RingBuffer<T, N, Storage>::write_range_impl(U* begin, U* end) noexcept {
+void RingBuffer<T, N, Storage, Policy>::write_range_impl(U* begin, U* end) noexcept {
   auto size = end - begin;
-  auto w = wp.load();
-  auto free_space_ahead = capacity - w;
+  auto w = wp.load(std::memory_order_relaxed);
+  auto w_ind = int(w & index_mask());
+  auto free_space_ahead = storage_capacity() - w_ind;
   auto forwards_size = size < free_space_ahead ? size : free_space_ahead;
 
-  CopyOrMove::apply(begin, begin + forwards_size, this->begin() + w);
+  CopyOrMove::apply(begin, begin + forwards_size, this->begin() + w_ind);
 
   if (forwards_size < size) {
     CopyOrMove::apply(begin + forwards_size, end, this->begin());
   }
 
-  wp.store((w + size) % capacity);
+  wp.store(w + uint32_t(size), std::memory_order_release);
+  update_high_water_mark(w + uint32_t(size));
 }
 
-template <typename T, int N, typename Storage>
-void RingBuffer<T, N, Storage>::write_range_copy(const T* begin, const T* end) noexcept {
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+void RingBuffer<T, N, Storage, Policy>::write_range_copy(const T* begin, const T* end) noexcept {
   write_range_impl<detail::CopyRange, const T>(begin, end);
 }
 
-template <typename T, int N, typename Storage>
-void RingBuffer<T, N, Storage>::write_range_move(T* begin, T* end) noexcept {
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+void RingBuffer<T, N, Storage, Policy>::write_range_move(T* begin, T* end) noexcept {
   write_range_impl<detail::MoveRange, T>(begin, end);
 }
 
-template <typename T, int N, typename Storage>
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
 template <typename U>
-bool RingBuffer<T, N, Storage>::maybe_write(U&& element) noexcept {
-  if (!full()) {
-    write(std::forward<U>(element));
-    return true;
+bool RingBuffer<T, N, Storage, Policy>::maybe_write(U&& element) noexcept {
+  if (full()) {
+    if constexpr (Policy == RingBufferFullPolicy::RejectNewest) {
+      record_dropped();
+      return false;
+    } else if constexpr (Policy == RingBufferFullPolicy::OverwriteOldest) {
+      discard_oldest();
+    } else {
+      while (full()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  write(std::forward<U>(element));
+  return true;
+}
+
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+void RingBuffer<T, N, Storage, Policy>::discard_oldest() noexcept {
+  //  `full()` has just refreshed `writer_cached_rp`. If the reader advanced in the meantime the
+  //  exchange fails, but then there is room anyway.
+  auto r = writer_cached_rp;
+  if (rp.compare_exchange_strong(r, r + 1, std::memory_order_acq_rel)) {
+    writer_cached_rp = r + 1;
+    num_overwritten.store(num_overwritten.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
   } else {
-    return false;
+    writer_cached_rp = r;
+  }
+}
+
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+void RingBuffer<T, N, Storage, Policy>::update_high_water_mark(uint32_t w) noexcept {
+  //  The cached read index lags the true one, so this over-estimates the size; only confirm
+  //  against the true read index when the estimate would raise the mark.
+  const int hwm = high_water_mark.load(std::memory_order_relaxed);
+  if (int(w - writer_cached_rp) > hwm) {
+    writer_cached_rp = rp.load(std::memory_order_acquire);
+    const int size = int(w - writer_cached_rp);
+    if (size > hwm) {
+      high_water_mark.store(size, std::memory_order_relaxed);
+    }
   }
 }
 
-template <typename T, int N, typename Storage>
-T RingBuffer<T, N, Storage>::read() noexcept {
-  auto r = rp.load();
-  T element = std::move(storage.buffer[r]);
-  rp = (r + 1) % capacity;
-  return element;
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+void RingBuffer<T, N, Storage, Policy>::record_dropped(int n) noexcept {
+  num_dropped.store(num_dropped.load(std::memory_order_relaxed) + uint64_t(n),
+                    std::memory_order_relaxed);
+}
+
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+RingBufferStats RingBuffer<T, N, Storage, Policy>::stats() const noexcept {
+  RingBufferStats result{};
+  result.num_dropped = num_dropped.load(std::memory_order_relaxed);
+  result.num_overwritten = num_overwritten.load(std::memory_order_relaxed);
+  result.high_water_mark = high_water_mark.load(std::memory_order_relaxed);
+  return result;
+}
+
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+RingBufferSpans<T> RingBuffer<T, N, Storage, Policy>::make_spans(uint32_t index, int size) noexcept {
+  const int ind = int(index & index_mask());
+  const int space_ahead = storage_capacity() - ind;
+  const int forwards_size = size < space_ahead ? size : space_ahead;
+
+  RingBufferSpans<T> result{};
+  result.first = begin() + ind;
+  result.first_size = forwards_size;
+  result.second = begin();
+  result.second_size = size - forwards_size;
+  return result;
+}
+
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+RingBufferSpans<T> RingBuffer<T, N, Storage, Policy>::prepare_write(int n) noexcept {
+  const int num_avail = num_free();
+  return make_spans(wp.load(std::memory_order_relaxed), n < num_avail ? n : num_avail);
+}
+
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+void RingBuffer<T, N, Storage, Policy>::commit_write(int n) noexcept {
+  auto w = wp.load(std::memory_order_relaxed);
+  wp.store(w + uint32_t(n), std::memory_order_release);
+  update_high_water_mark(w + uint32_t(n));
 }
 
-template <typename T, int N, typename Storage>
-void RingBuffer<T, N, Storage>::clear() noexcept {
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+RingBufferSpans<T> RingBuffer<T, N, Storage, Policy>::peek_read() noexcept {
+  static_assert(!overwrites, "peek_read() is unavailable with RingBufferFullPolicy::OverwriteOldest.");
+  const int num_read = size();
+  return make_spans(rp.load(std::memory_order_relaxed), num_read);
+}
+
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+void RingBuffer<T, N, Storage, Policy>::consume(int n) noexcept {
+  static_assert(!overwrites, "consume() is unavailable with RingBufferFullPolicy::OverwriteOldest.");
+  auto r = rp.load(std::memory_order_relaxed);
+  rp.store(r + uint32_t(n), std::memory_order_release);
+}
+
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+T RingBuffer<T, N, Storage, Policy>::read() noexcept {
+  if constexpr (overwrites) {
+    //  The writer may discard the element while it is being copied, in which case the read index
+    //  will have moved and the copy is retried from the new oldest element.
+    auto r = rp.load(std::memory_order_acquire);
+    while (true) {
+      T element = storage.buffer[r & index_mask()];
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (rp.compare_exchange_weak(r, r + 1, std::memory_order_acq_rel)) {
+        return element;
+      }
+    }
+  } else {
+    auto r = rp.load(std::memory_order_relaxed);
+    T element = std::move(storage.buffer[r & index_mask()]);
+    rp.store(r + 1, std::memory_order_release);
+    return element;
+  }
+}
+
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+void RingBuffer<T, N, Storage, Policy>::clear() noexcept {
   int num_read = size();
   for (int i = 0; i < num_read; i++) {
     read();
   }
 }
 
-template <typename T, int N, typename Storage>
-int RingBuffer<T, N, Storage>::size() const noexcept {
-  int rp_value = rp % capacity;
-  int wp_value = wp % capacity;
-
-  if (rp_value <= wp_value) {
-    return wp_value - rp_value;
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+int RingBuffer<T, N, Storage, Policy>::size() const noexcept {
+  if constexpr (overwrites) {
+    //  The writer also advances the read index when it discards, so neither index can be cached.
+    const auto w = wp.load(std::memory_order_acquire);
+    return int(w - rp.load(std::memory_order_acquire));
   } else {
-    return wp_value + (capacity - rp_value);
+    const auto r = rp.load(std::memory_order_relaxed);
+    if (reader_cached_wp == r) {
+      reader_cached_wp = wp.load(std::memory_order_acquire);
+    }
+    return int(reader_cached_wp - r);
   }
 }
 
-template <typename T, int N, typename Storage>
-int RingBuffer<T, N, Storage>::num_free() const noexcept {
-  int rp_value = rp % capacity;
-  int wp_value = wp % capacity;
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+int RingBuffer<T, N, Storage, Policy>::num_free() const noexcept {
+  writer_cached_rp = rp.load(std::memory_order_acquire);
+  return storage_capacity() - int(wp.load(std::memory_order_relaxed) - writer_cached_rp) - 1;
+}
 
-  if (rp_value <= wp_value) {
-    return capacity - (wp_value - rp_value) - 1;
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+bool RingBuffer<T, N, Storage, Policy>::full() const noexcept {
+  const auto w = wp.load(std::memory_order_relaxed);
+  if (int(w - writer_cached_rp) < storage_capacity() - 1) {
+    //  The cached read index can only lag the true one, so there is at least this much room.
+    return false;
   } else {
-    return rp_value - wp_value - 1;
+    return num_free() == 0;
   }
 }
 
-template <typename T, int N, typename Storage>
-bool RingBuffer<T, N, Storage>::full() const noexcept {
-  return num_free() == 0;
-}
-
-template <typename T, int N, typename Storage>
-T* RingBuffer<T, N, Storage>::begin() {
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+T* RingBuffer<T, N, Storage, Policy>::begin() {
   return &storage.buffer[0];
 }
 
-template <typename T, int N, typename Storage>
-T* RingBuffer<T, N, Storage>::end() {
-  return &storage.buffer[0] + N;
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+T* RingBuffer<T, N, Storage, Policy>::end() {
+  return &storage.buffer[0] + storage_capacity();
 }
 
-template <typename T, int N, typename Storage>
-const T* RingBuffer<T, N, Storage>::begin() const {
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+const T* RingBuffer<T, N, Storage, Policy>::begin() const {
   return &storage.buffer[0];
 }
 
-template <typename T, int N, typename Storage>
-const T* RingBuffer<T, N, Storage>::end() const {
-  return &storage.buffer[0] + N;
+template <typename T, int N, typename Storage, RingBufferFullPolicy Policy>
+const T* RingBuffer<T, N, Storage, Policy>::end() const {
+  return &storage.buffer[0] + storage_capacity();
 }
 
-}
\ No newline at end of file
+}
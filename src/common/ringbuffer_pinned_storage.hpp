@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ringbuffer.hpp"
+#include "pinned_memory.hpp"
+#include <new>
+
+namespace om {
+
+/*
+ * RingBufferPinnedStorage - RingBuffer storage whose capacity is chosen at runtime and whose
+ * elements live in a PinnedRegion. The capacity is rounded up to a power of two.
+ */
+
+template <typename T>
+struct RingBufferPinnedStorage {
+  RingBufferPinnedStorage() = default;
+  ~RingBufferPinnedStorage() {
+    release();
+  }
+
+  RingBufferPinnedStorage(const RingBufferPinnedStorage&) = delete;
+  RingBufferPinnedStorage& operator=(const RingBufferPinnedStorage&) = delete;
+
+  bool init(int min_capacity, const PinnedRegionParams& params) {
+    release();
+
+    int cap = 2;
+    while (cap < min_capacity) {
+      cap *= 2;
+    }
+
+    auto res = allocate_pinned_region(sizeof(T) * size_t(cap), params);
+    if (!res) {
+      return false;
+    }
+
+    region = res.value();
+    buffer = static_cast<T*>(region.data);
+    for (int i = 0; i < cap; i++) {
+      new (buffer + i) T{};
+    }
+    capacity = cap;
+    return true;
+  }
+
+  void release() {
+    for (int i = 0; i < capacity; i++) {
+      buffer[i].~T();
+    }
+    free_pinned_region(&region);
+    buffer = nullptr;
+    capacity = 0;
+  }
+
+  T* buffer{};
+  int capacity{};
+  PinnedRegion region{};
+};
+
+template <typename T, RingBufferFullPolicy Policy = RingBufferFullPolicy::RejectNewest>
+using PinnedRingBuffer = RingBuffer<T, ring_buffer_dynamic_capacity, RingBufferPinnedStorage<T>, Policy>;
+
+}
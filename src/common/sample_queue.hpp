@@ -1,9 +1,38 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 
 namespace om {
 
+/*
+ * SampleQueueView - The samples of a SampleQueue, oldest to newest, as two contiguous runs.
+ */
+
+template <typename T>
+struct SampleQueueView {
+  int size() const {
+    return first_size + second_size;
+  }
+
+  //  The `i`-th oldest sample.
+  const T& operator[](int i) const {
+    return i < first_size ? first[i] : second[i - first_size];
+  }
+
+  const T* first;
+  int first_size;
+  const T* second;
+  int second_size;
+};
+
+/*
+ * SampleQueue - Fixed-capacity history of the most recent samples. `data` is used circularly:
+ * once full, each push overwrites the oldest samples in place, so a push costs O(num_samples)
+ * regardless of capacity. The oldest sample is at `data[oldest()]`, and the history continues,
+ * wrapping around the end of `data`, for `size` samples.
+ */
+
 template <typename T>
 struct SampleQueue {
   int capacity() const {
@@ -11,36 +40,58 @@ struct SampleQueue {
   }
 
   void reserve(int n) {
-    data.resize(n);
+    if (n != capacity()) {
+      data.resize(n);
+      clear();
+    }
   }
 
   void clear() {
     size = 0;
+    head = 0;
   }
 
   void push(const T* samples, int num_samples) {
-    if (capacity() == 0) {
+    const int cap = capacity();
+    if (cap == 0) {
       return;
     }
 
-    int end{};
-    while (end < num_samples && size < capacity()) {
-      data[size++] = samples[end++];
+    if (num_samples > cap) {
+      samples += num_samples - cap;
+      num_samples = cap;
     }
 
-    int num_rem = num_samples - end;
-    while (num_rem > 0) {
-      const int num_rotate = std::min(capacity(), num_rem);
-      std::rotate(data.begin(), data.begin() + num_rotate, data.end());
-      for (int i = 0; i < num_rotate; i++) {
-        data[size - num_rotate + i] = samples[end++];
-      }
-      num_rem -= num_rotate;
-    }
+    const int forwards_size = std::min(num_samples, cap - head);
+    std::copy(samples, samples + forwards_size, data.begin() + head);
+    std::copy(samples + forwards_size, samples + num_samples, data.begin());
+
+    head = (head + num_samples) % cap;
+    size = std::min(cap, size + num_samples);
+  }
+
+  //  Index into `data` of the oldest sample. Can be passed as the `offset` argument of
+  //  ImPlot::PlotLine to plot the history in order, without copying.
+  int oldest() const {
+    return size < capacity() ? 0 : head;
+  }
+
+  SampleQueueView<T> view() const {
+    const int beg = oldest();
+    const int forwards_size = std::min(size, capacity() - beg);
+
+    SampleQueueView<T> result{};
+    result.first = data.data() + beg;
+    result.first_size = forwards_size;
+    result.second = data.data();
+    result.second_size = size - forwards_size;
+    return result;
   }
 
   std::vector<T> data;
   int size{};
+  //  Index into `data` at which the next sample is written.
+  int head{};
 };
 
-}
\ No newline at end of file
+}
@@ -1,20 +1,21 @@
 #include "serial_lever.hpp"
+#include <algorithm>
+#include <cassert>
+#include <charconv>
 #include <string>
 #include <cstring>
+#include <type_traits>
 
 namespace om {
 
 namespace {
 
-std::optional<int> parse_force(const std::string& s) {
-  constexpr const char* tg = "target grams: ";
-  auto tg_it = s.find(tg);
-  if (tg_it == std::string::npos) {
-    return std::nullopt;
-  } else {
-    char* ignore;
-    return std::strtol(s.data() + tg_it + std::strlen(tg), &ignore, 10);
-  }
+constexpr bool little_endian() {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return false;
+#else
+  return true;
+#endif
 }
 
 [[maybe_unused]] float parse_float(const char* base, size_t off, const char* prefix) {
@@ -22,37 +23,319 @@ std::optional<int> parse_force(const std::string& s) {
   return std::strtof(base + off + std::strlen(prefix), &ignore);
 }
 
-std::optional<LeverState> parse_state(const std::string& s) {
-#if 0
-    printf("Source: %s\n", s.c_str());
-#endif
+template <typename T>
+void write_le(uint8_t* dst, T value) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  uint8_t bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  for (size_t i = 0; i < sizeof(T); i++) {
+    dst[i] = bytes[little_endian() ? i : sizeof(T) - 1 - i];
+  }
+}
 
-    const auto not_found = std::string::npos;
-    constexpr const char* sg = "strain gauge reading: ";
-    constexpr const char* cpwm = "calculated PWM: ";
-    constexpr const char* real_pwm = "acutal PWM: ";
-    constexpr const char* pot_str = "P: ";
+template <typename T>
+T read_le(const uint8_t* src) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  uint8_t bytes[sizeof(T)];
+  for (size_t i = 0; i < sizeof(T); i++) {
+    bytes[little_endian() ? i : sizeof(T) - 1 - i] = src[i];
+  }
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+//  Finds `prefix` in `s` and parses the number that follows it.
+template <typename T>
+std::optional<T> parse_field(std::string_view s, std::string_view prefix) {
+  auto it = s.find(prefix);
+  if (it == std::string_view::npos) {
+    return std::nullopt;
+  }
 
-    auto sg_it = s.find(sg);
-    auto cpwm_it = s.find(cpwm);
-    auto real_pwm_it = s.find(real_pwm);  //  @NOTE: typo
-    auto pot_it = s.find(pot_str);  //  @NOTE: typo
+  const char* first = s.data() + it + prefix.size();
+  const char* last = s.data() + s.size();
+  //  Unlike strtof, from_chars does not skip leading whitespace.
+  while (first != last && (*first == ' ' || *first == '\t')) {
+    first++;
+  }
+
+  T value{};
+  auto res = std::from_chars(first, last, value);
+  if (res.ec != std::errc{}) {
+    return std::nullopt;
+  } else {
+    return value;
+  }
+}
 
-    if (sg_it == not_found || cpwm_it == not_found || real_pwm_it == not_found || pot_it == not_found) {
-        return std::nullopt;
+//  Writes `prefix` followed by the space-separated `values` and a newline.
+int format_command(char prefix, const int* values, int num_values, char* dst, int capacity) {
+  assert(capacity >= max_lever_command_size());
+  char* end = dst + std::min(capacity, max_lever_command_size());
+  char* p = dst;
+  *p++ = prefix;
+  for (int i = 0; i < num_values; i++) {
+    if (i > 0) {
+      *p++ = ' ';
     }
+    auto res = std::to_chars(p, end - 1, values[i]);
+    assert(res.ec == std::errc{});
+    p = res.ptr;
+  }
+  *p++ = '\n';
+  return int(p - dst);
+}
+
+int format_command(char prefix, int value, char* dst, int capacity) {
+  return format_command(prefix, &value, 1, dst, capacity);
+}
 
-    char* ignore;
-    LeverState result{};
-    result.strain_gauge = std::strtof(s.data() + sg_it + std::strlen(sg), &ignore);
-    result.calculated_pwm = std::strtof(s.data() + cpwm_it + std::strlen(cpwm), &ignore);
-    result.actual_pwm = std::strtof(s.data() + real_pwm_it + std::strlen(real_pwm), &ignore);
-    result.potentiometer_reading = std::strtof(s.data() + pot_it + std::strlen(pot_str), &ignore);
-    return result;
+void encode_frame(uint8_t type, uint8_t flags, uint16_t sequence, uint32_t device_time_us,
+                  const LeverState& state, uint8_t* dst) {
+  dst[0] = LeverFrameFormat::sync0;
+  dst[1] = LeverFrameFormat::sync1;
+  dst[2] = type;
+  dst[3] = flags;
+  write_le(dst + 4, sequence);
+  write_le(dst + 6, device_time_us);
+  write_le(dst + 10, state.strain_gauge);
+  write_le(dst + 14, state.calculated_pwm);
+  write_le(dst + 18, state.actual_pwm);
+  write_le(dst + 22, state.potentiometer_reading);
+  write_le(dst + 26, crc16_ccitt(dst + 2, LeverFrameFormat::size - 4));
+}
+
+bool is_valid_frame(uint8_t type, const uint8_t* data, int size) {
+  return size >= LeverFrameFormat::size &&
+         data[0] == LeverFrameFormat::sync0 &&
+         data[1] == LeverFrameFormat::sync1 &&
+         data[2] == type &&
+         read_le<uint16_t>(data + 26) == crc16_ccitt(data + 2, LeverFrameFormat::size - 4);
+}
+
+LeverState decode_frame_state(const uint8_t* data) {
+  LeverState result{};
+  result.strain_gauge = read_le<float>(data + 10);
+  result.calculated_pwm = read_le<float>(data + 14);
+  result.actual_pwm = read_le<float>(data + 18);
+  result.potentiometer_reading = read_le<float>(data + 22);
+  return result;
 }
 
 } //  anon
 
+std::optional<int> parse_lever_force(std::string_view s) {
+  return parse_field<int>(s, "target grams: ");
+}
+
+std::optional<LeverState> parse_lever_state(std::string_view s) {
+  auto strain_gauge = parse_field<float>(s, "strain gauge reading: ");
+  auto calculated_pwm = parse_field<float>(s, "calculated PWM: ");
+  auto actual_pwm = parse_field<float>(s, "acutal PWM: ");  //  @NOTE: typo
+  auto potentiometer = parse_field<float>(s, "P: ");
+  if (!strain_gauge || !calculated_pwm || !actual_pwm || !potentiometer) {
+    return std::nullopt;
+  }
+
+  LeverState result{};
+  result.strain_gauge = strain_gauge.value();
+  result.calculated_pwm = calculated_pwm.value();
+  result.actual_pwm = actual_pwm.value();
+  result.potentiometer_reading = potentiometer.value();
+  return result;
+}
+
+int format_set_force_command(int force, char* dst, int capacity) {
+  return format_command('g', force, dst, capacity);
+}
+
+std::string make_set_force_command(int force) {
+  char command[max_lever_command_size()];
+  return std::string{command, size_t(format_set_force_command(force, command, int(sizeof(command))))};
+}
+
+const char* make_set_direction_command(SerialLeverDirection dir) {
+  return dir == SerialLeverDirection::Forward ? "f\n" : "z\n";
+}
+
+std::optional<SerialLeverDirection> parse_lever_direction(std::string_view s) {
+  if (s.find("forward") != std::string_view::npos) {
+    return SerialLeverDirection::Forward;
+  } else if (s.find("reverse") != std::string_view::npos) {
+    return SerialLeverDirection::Reverse;
+  } else {
+    return std::nullopt;
+  }
+}
+
+const char* make_read_state_command() {
+  return "s";
+}
+
+const char* make_read_clock_command() {
+  return "t\n";
+}
+
+std::optional<uint32_t> parse_device_clock(std::string_view s) {
+  return parse_field<uint32_t>(s, "clock: ");
+}
+
+int format_negotiate_baud_command(uint32_t baud, char* dst, int capacity) {
+  return format_command('h', int(baud), dst, capacity);
+}
+
+std::optional<uint32_t> parse_baud_rate(std::string_view s) {
+  return parse_field<uint32_t>(s, "baud: ");
+}
+
+int format_stream_state_command(int rate_hz, char* dst, int capacity) {
+  return format_command('b', rate_hz, dst, capacity);
+}
+
+std::string make_stream_state_command(int rate_hz) {
+  char command[max_lever_command_size()];
+  return std::string{command, size_t(format_stream_state_command(rate_hz, command, int(sizeof(command))))};
+}
+
+std::optional<int> parse_stream_rate(std::string_view s) {
+  return parse_field<int>(s, "stream rate: ");
+}
+
+int format_set_edge_thresholds_command(const LeverEdgeThresholds& thresholds, char* dst, int capacity) {
+  const int values[2]{thresholds.rising, thresholds.falling};
+  return format_command('e', values, 2, dst, capacity);
+}
+
+std::optional<LeverEdgeThresholds> parse_edge_thresholds(std::string_view s) {
+  constexpr std::string_view prefix{"edge thresholds: "};
+  auto rising = parse_field<int>(s, prefix);
+  if (!rising) {
+    return std::nullopt;
+  }
+  //  The falling threshold is the next field after the rising one.
+  auto rest = s.substr(s.find(prefix) + prefix.size());
+  rest.remove_prefix(std::min(rest.find_first_not_of(" \t"), rest.size()));
+  rest.remove_prefix(std::min(rest.find_first_of(" \t"), rest.size()));
+  auto falling = parse_field<int>(rest, "");
+  if (!falling) {
+    return std::nullopt;
+  }
+
+  LeverEdgeThresholds result{};
+  result.rising = rising.value();
+  result.falling = falling.value();
+  return result;
+}
+
+bool operator==(const LeverForceProfile& a, const LeverForceProfile& b) {
+  if (a.num_segments != b.num_segments) {
+    return false;
+  }
+  for (int i = 0; i < a.num_segments; i++) {
+    auto& sa = a.segments[i];
+    auto& sb = b.segments[i];
+    if (sa.direction != sb.direction || sa.force != sb.force ||
+        sa.ramp_ms != sb.ramp_ms || sa.hold_ms != sb.hold_ms) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int duration_ms(const LeverForceProfile& profile) {
+  int result{};
+  for (int i = 0; i < profile.num_segments; i++) {
+    result += profile.segments[i].ramp_ms + profile.segments[i].hold_ms;
+  }
+  return result;
+}
+
+const char* make_clear_force_profile_command() {
+  return "c\n";
+}
+
+int format_add_force_segment_command(const LeverForceSegment& segment, char* dst, int capacity) {
+  const int values[4]{
+    int(segment.direction), segment.force, segment.ramp_ms, segment.hold_ms};
+  return format_command('l', values, 4, dst, capacity);
+}
+
+const char* make_run_force_profile_command() {
+  return "m\n";
+}
+
+std::optional<int> parse_force_profile_size(std::string_view s) {
+  return parse_field<int>(s, "profile segments: ");
+}
+
+std::optional<int> parse_force_profile_started(std::string_view s) {
+  return parse_field<int>(s, "profile started: ");
+}
+
+uint16_t crc16_ccitt(const uint8_t* data, int size) {
+  uint16_t crc = 0xffff;
+  for (int i = 0; i < size; i++) {
+    crc ^= uint16_t(data[i]) << 8;
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 0x8000) ? uint16_t((crc << 1) ^ 0x1021) : uint16_t(crc << 1);
+    }
+  }
+  return crc;
+}
+
+void encode_lever_state_frame(const LeverStateFrame& frame, uint8_t* dst) {
+  encode_frame(LeverFrameFormat::state_type, 0, frame.sequence, frame.device_time_us, frame.state, dst);
+}
+
+std::optional<LeverStateFrame> decode_lever_state_frame(const uint8_t* data, int size) {
+  if (!is_valid_frame(LeverFrameFormat::state_type, data, size)) {
+    return std::nullopt;
+  }
+
+  LeverStateFrame result{};
+  result.sequence = read_le<uint16_t>(data + 4);
+  result.device_time_us = read_le<uint32_t>(data + 6);
+  result.state = decode_frame_state(data);
+  return result;
+}
+
+void encode_lever_edge_frame(const LeverEdgeFrame& frame, uint8_t* dst) {
+  encode_frame(LeverFrameFormat::edge_type, uint8_t(frame.pulled), frame.sequence,
+               frame.device_time_us, frame.state, dst);
+}
+
+std::optional<LeverEdgeFrame> decode_lever_edge_frame(const uint8_t* data, int size) {
+  if (!is_valid_frame(LeverFrameFormat::edge_type, data, size)) {
+    return std::nullopt;
+  }
+
+  LeverEdgeFrame result{};
+  result.sequence = read_le<uint16_t>(data + 4);
+  result.device_time_us = read_le<uint32_t>(data + 6);
+  result.pulled = data[3] != 0;
+  result.state = decode_frame_state(data);
+  return result;
+}
+
+void encode_lever_profile_frame(const LeverProfileFrame& frame, uint8_t* dst) {
+  encode_frame(LeverFrameFormat::profile_type, uint8_t(frame.completed), frame.sequence,
+               frame.device_time_us, frame.state, dst);
+}
+
+std::optional<LeverProfileFrame> decode_lever_profile_frame(const uint8_t* data, int size) {
+  if (!is_valid_frame(LeverFrameFormat::profile_type, data, size)) {
+    return std::nullopt;
+  }
+
+  LeverProfileFrame result{};
+  result.sequence = read_le<uint16_t>(data + 4);
+  result.device_time_us = read_le<uint32_t>(data + 6);
+  result.completed = data[3] != 0;
+  result.state = decode_frame_state(data);
+  return result;
+}
+
 std::string to_string(const LeverState& state, const std::string& delim) {
   std::string result;
   result += "strain_gauge: " + std::to_string(state.strain_gauge);
@@ -63,31 +346,25 @@ std::string to_string(const LeverState& state, const std::string& delim) {
 }
 
 std::optional<LeverState> read_state(const SerialContext& context) {
-  context.instance->write("s");
+  context.instance->write(make_read_state_command());
   if (auto str = readline(context)) {
-    return parse_state(str.value());
+    return parse_lever_state(str.value());
   } else {
     return std::nullopt;
   }
 }
 
 std::optional<int> set_force_grams(const SerialContext& context, int force) {
-  std::string command{"g"};
-  command += std::to_string(force);
-  command += "\n";
-  context.instance->write(command);
+  context.instance->write(make_set_force_command(force));
   if (auto res = readline(context)) {
-    return parse_force(res.value());
+    return parse_lever_force(res.value());
   } else {
     return std::nullopt;
   }
 }
 
 bool set_lever_direction(const SerialContext& context, SerialLeverDirection dir) {
-  const char* cmd = dir == SerialLeverDirection::Forward ? "f" : "z";
-  std::string command{cmd};
-  command += "\n";
-  context.instance->write(command);
+  context.instance->write(make_set_direction_command(dir));
   if (auto res = readline(context)) {
     return true;
   } else {
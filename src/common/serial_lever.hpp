@@ -1,6 +1,7 @@
 #pragma once
 
 #include "serial.hpp"
+#include <string_view>
 
 namespace om {
 
@@ -24,8 +25,173 @@ constexpr uint32_t default_read_write_timeout() {
   return 1000;
 }
 
+//  Time a device waits, after switching to a negotiated baud rate, for the host to confirm it.
+constexpr uint32_t baud_confirm_window_ms() {
+  return 500;
+}
+
+//  Time a device at a rate other than the default waits for a command before returning to the
+//  default, e.g. because the host exited without restoring it. Hosts send commands more often.
+constexpr uint32_t baud_idle_timeout_ms() {
+  return 3000;
+}
+
 std::string to_string(const LeverState& state, const std::string& delim = "\n");
 
+constexpr int max_lever_command_size() {
+  return 32;
+}
+
+constexpr int max_lever_force_profile_segments() {
+  return 8;
+}
+
+//  Commands and responses of the text protocol, for callers that do their own I/O. The `format_`
+//  functions write a command of at most `max_lever_command_size()` bytes into `dst` and return its
+//  length; they and the parsers do not allocate.
+int format_set_force_command(int force, char* dst, int capacity);
+std::string make_set_force_command(int force);
+const char* make_set_direction_command(SerialLeverDirection dir);
+const char* make_read_state_command();
+std::optional<int> parse_lever_force(std::string_view s);
+//  The device answers the direction commands with "forward" or "reverse".
+std::optional<SerialLeverDirection> parse_lever_direction(std::string_view s);
+std::optional<LeverState> parse_lever_state(std::string_view s);
+//  The device answers with "clock: <micros>", its clock when it handled the command.
+const char* make_read_clock_command();
+std::optional<uint32_t> parse_device_clock(std::string_view s);
+
+/*
+ * Baud rate negotiation - Devices start at `default_baud_rate()`. The negotiate command asks the
+ * device to switch to `baud`; it answers "baud: <rate>" at its current rate, with `baud` if it
+ * supports it, in which case it switches right after, and with its current rate otherwise. Asking
+ * for the rate the device is already at confirms that rate. A device that switched to a rate other
+ * than the default and is not asked for that rate again within `baud_confirm_window_ms()` returns
+ * to the default, so that a host which could not follow it can still reach it; so does a device
+ * that receives no command for `baud_idle_timeout_ms()`, so that the next host to open the port at
+ * the default rate reaches it even if the last one never restored the default.
+ */
+
+int format_negotiate_baud_command(uint32_t baud, char* dst, int capacity);
+std::optional<uint32_t> parse_baud_rate(std::string_view s);
+
+/*
+ * Binary state stream - Opt-in alternative to polling with `s`. After the start-stream command,
+ * the device pushes a fixed-size frame at the requested rate, interleaved with the text responses
+ * to other commands. Frame layout (little-endian):
+ *
+ *   sync 0xA5 0x5A | type u8 | reserved u8 | sequence u16 | device time us u32 |
+ *   strain gauge, calculated pwm, actual pwm, potentiometer f32 x 4 | crc16 u16
+ *
+ * The CRC (CCITT, initial value 0xFFFF) covers the bytes from `type` up to the CRC. Text responses
+ * are printable ASCII, so the first sync byte always marks the start of a frame.
+ */
+
+struct LeverStateFrame {
+  uint16_t sequence;
+  uint32_t device_time_us;
+  LeverState state;
+};
+
+struct LeverFrameFormat {
+  static constexpr uint8_t sync0 = 0xA5;
+  static constexpr uint8_t sync1 = 0x5A;
+  static constexpr uint8_t state_type = 1;
+  static constexpr uint8_t edge_type = 2;
+  static constexpr uint8_t profile_type = 3;
+  static constexpr int size = 28;
+};
+
+/*
+ * Pull edges - After the set-edge-thresholds command, the device compares its potentiometer reading
+ * against the thresholds every time it samples the strain gauge. When `rising` > `falling`, the lever
+ * is pulled once the reading rises above `rising` and released once it falls below `falling`; the
+ * comparisons are reversed otherwise, for levers whose reading decreases as they are pulled. Equal
+ * thresholds disable detection.
+ *
+ * Each crossing is reported immediately, whether or not the state stream is running, as a frame
+ * laid out like a state frame with type `edge_type`, the reserved byte set to 1 for a pull and 0
+ * for a release, and a sequence number counting edges only.
+ */
+
+struct LeverEdgeThresholds {
+  int rising;
+  int falling;
+};
+
+struct LeverEdgeFrame {
+  uint16_t sequence;
+  uint32_t device_time_us;
+  bool pulled;
+  LeverState state;
+};
+
+inline bool operator==(const LeverEdgeThresholds& a, const LeverEdgeThresholds& b) {
+  return a.rising == b.rising && a.falling == b.falling;
+}
+inline bool operator!=(const LeverEdgeThresholds& a, const LeverEdgeThresholds& b) {
+  return !(a == b);
+}
+
+//  Starts the stream, or stops it if `rate_hz` is 0. The device answers with "stream rate: <hz>".
+int format_stream_state_command(int rate_hz, char* dst, int capacity);
+std::string make_stream_state_command(int rate_hz);
+std::optional<int> parse_stream_rate(std::string_view s);
+
+//  The device answers with "edge thresholds: <rising> <falling>".
+int format_set_edge_thresholds_command(const LeverEdgeThresholds& thresholds, char* dst, int capacity);
+std::optional<LeverEdgeThresholds> parse_edge_thresholds(std::string_view s);
+
+/*
+ * Force profiles - A list of segments loaded onto the device with the clear and add-segment
+ * commands, then run with the run command. Each segment sets the direction, then ramps the force
+ * linearly from its value at the start of the segment to `force` over `ramp_ms`, then holds it for
+ * `hold_ms`. The device updates the force every millisecond, and reports the end of the run with a
+ * frame laid out like a state frame with type `profile_type`, the reserved byte set to 1 if the
+ * profile ran to completion and 0 if it was stopped by the clear command, and a sequence number
+ * counting runs.
+ */
+
+struct LeverForceSegment {
+  SerialLeverDirection direction;
+  int force;
+  int ramp_ms;
+  int hold_ms;
+};
+
+struct LeverForceProfile {
+  LeverForceSegment segments[max_lever_force_profile_segments()];
+  int num_segments;
+};
+
+struct LeverProfileFrame {
+  uint16_t sequence;
+  uint32_t device_time_us;
+  bool completed;
+  LeverState state;
+};
+
+bool operator==(const LeverForceProfile& a, const LeverForceProfile& b);
+int duration_ms(const LeverForceProfile& profile);
+
+//  The clear and add-segment commands are answered with "profile segments: <count>", the run
+//  command with "profile started: <count>".
+const char* make_clear_force_profile_command();
+int format_add_force_segment_command(const LeverForceSegment& segment, char* dst, int capacity);
+const char* make_run_force_profile_command();
+std::optional<int> parse_force_profile_size(std::string_view s);
+std::optional<int> parse_force_profile_started(std::string_view s);
+
+uint16_t crc16_ccitt(const uint8_t* data, int size);
+//  `dst` must hold `LeverFrameFormat::size` bytes.
+void encode_lever_state_frame(const LeverStateFrame& frame, uint8_t* dst);
+//  Returns nullopt unless `data` holds a complete state frame with a valid CRC.
+std::optional<LeverStateFrame> decode_lever_state_frame(const uint8_t* data, int size);
+void encode_lever_edge_frame(const LeverEdgeFrame& frame, uint8_t* dst);
+std::optional<LeverEdgeFrame> decode_lever_edge_frame(const uint8_t* data, int size);
+void encode_lever_profile_frame(const LeverProfileFrame& frame, uint8_t* dst);
+std::optional<LeverProfileFrame> decode_lever_profile_frame(const uint8_t* data, int size);
+
 std::optional<LeverState> read_state(const SerialContext& context);
 std::optional<int> set_force_grams(const SerialContext& context, int force);
 [[nodiscard]] bool set_lever_direction(const SerialContext& context, SerialLeverDirection dir);
@@ -0,0 +1,221 @@
+#include "serial_port_watcher.hpp"
+#include "time.hpp"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace om {
+
+namespace {
+
+bool same_ports(const std::vector<PortDescriptor>& a, const std::vector<PortDescriptor>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].port != b[i].port || a[i].description != b[i].description) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#if defined(__linux__)
+
+bool open_device_watch(SerialPortWatcher* watcher) {
+  const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  //  Attribute changes are included because udev sets a new node's permissions after creating it,
+  //  and an open attempted before then fails.
+  if (inotify_add_watch(fd, "/dev", IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+    ::close(fd);
+    return false;
+  }
+  watcher->inotify_fd = fd;
+  return true;
+}
+
+//  Reads every pending event; returns true if any concerned a tty node.
+bool drain_device_events(SerialPortWatcher* watcher) {
+  alignas(inotify_event) char buffer[4096];
+  bool changed{};
+  while (true) {
+    const auto num_read = ::read(watcher->inotify_fd, buffer, sizeof(buffer));
+    if (num_read < 0 && errno == EINTR) {
+      continue;
+    } else if (num_read <= 0) {
+      return changed;
+    }
+    for (ssize_t off = 0; off < num_read;) {
+      auto* evt = reinterpret_cast<const inotify_event*>(buffer + off);
+      if (evt->len > 0 && std::strncmp(evt->name, "tty", 3) == 0) {
+        changed = true;
+      }
+      off += ssize_t(sizeof(inotify_event) + evt->len);
+    }
+  }
+}
+
+#endif
+
+bool has_open_requests(const SerialPortWatcher* watcher) {
+  for (auto& client : watcher->clients) {
+    if (client->requests.size() > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void process_open_requests(SerialPortWatcher::Client* client) {
+  bool opened{};
+  while (client->requests.size() > 0) {
+    auto request = client->requests.read();
+    SerialPortOpenResult result{};
+    result.id = request.id;
+    result.port = open_serial_port(request.port, request.baud);
+    if (!client->results.maybe_write(std::move(result))) {
+      //  The client has stopped taking results; `result` was not moved from.
+      if (result.port) {
+        close_serial_port(&result.port.value());
+      }
+    }
+    opened = true;
+  }
+  if (opened) {
+    wake(client->reactor);
+  }
+}
+
+void watch(SerialPortWatcher* watcher) {
+  auto listed = enumerate_ports();
+  write_latest(&watcher->ports, listed);
+  auto next_scan_time = now();
+
+  while (watcher->keep_watching.load()) {
+    wait_for(&watcher->wakeup, SerialPortWatcherConfig::watch_interval_s, [watcher]() {
+      return !watcher->keep_watching.load() || has_open_requests(watcher) ||
+             watcher->rescan_requested.load();
+    });
+
+    for (auto& client : watcher->clients) {
+      process_open_requests(client.get());
+    }
+
+    bool changed{};
+    bool rescan = watcher->rescan_requested.exchange(false);
+#if defined(__linux__)
+    if (watcher->inotify_fd >= 0) {
+      changed = drain_device_events(watcher);
+      rescan = rescan || changed;
+    } else
+#endif
+    {
+      const auto t = now();
+      if (t >= next_scan_time) {
+        rescan = true;
+        next_scan_time = t + std::chrono::duration_cast<TimePoint::duration>(
+          Duration(SerialPortWatcherConfig::fallback_scan_interval_s));
+      }
+    }
+
+    if (!rescan) {
+      continue;
+    }
+    auto ports = enumerate_ports();
+    changed = changed || !same_ports(ports, listed);
+    listed = std::move(ports);
+    write_latest(&watcher->ports, listed);
+    if (changed) {
+      watcher->num_device_changes.fetch_add(1);
+      for (auto& client : watcher->clients) {
+        wake(client->reactor);
+      }
+    }
+  }
+}
+
+} //  anon
+
+bool start(SerialPortWatcher* watcher, SerialReactor** reactors, int num_clients) {
+  assert(!watcher->thread.joinable());
+  watcher->clients.clear();
+  for (int i = 0; i < num_clients; i++) {
+    watcher->clients.push_back(std::make_unique<SerialPortWatcher::Client>());
+    watcher->clients.back()->reactor = reactors[i];
+  }
+#if defined(__linux__)
+  if (!open_device_watch(watcher)) {
+    printf("Failed to watch /dev for serial devices; falling back to periodic scans.\n");
+  }
+#endif
+  watcher->keep_watching.store(true);
+  watcher->thread = std::thread{[watcher]() {
+    watch(watcher);
+  }};
+  return true;
+}
+
+void stop(SerialPortWatcher* watcher) {
+  if (!watcher->thread.joinable()) {
+    return;
+  }
+
+  watcher->keep_watching.store(false);
+  notify(&watcher->wakeup);
+  watcher->thread.join();
+
+  for (int i = 0; i < int(watcher->clients.size()); i++) {
+    while (auto result = take_open_result(watcher, i)) {
+      if (result.value().port) {
+        close_serial_port(&result.value().port.value());
+      }
+    }
+  }
+  watcher->clients.clear();
+#if defined(__linux__)
+  if (watcher->inotify_fd >= 0) {
+    ::close(watcher->inotify_fd);
+    watcher->inotify_fd = -1;
+  }
+#endif
+}
+
+bool submit_open(SerialPortWatcher* watcher, int client, SerialPortOpenRequest&& request) {
+  if (!watcher->clients[client]->requests.maybe_write(std::move(request))) {
+    return false;
+  }
+  notify(&watcher->wakeup);
+  return true;
+}
+
+std::optional<SerialPortOpenResult> take_open_result(SerialPortWatcher* watcher, int client) {
+  auto& results = watcher->clients[client]->results;
+  if (results.size() == 0) {
+    return std::nullopt;
+  }
+  return results.read();
+}
+
+uint64_t num_device_changes(const SerialPortWatcher& watcher) {
+  return watcher.num_device_changes.load();
+}
+
+void request_rescan(SerialPortWatcher* watcher) {
+  watcher->rescan_requested.store(true);
+  notify(&watcher->wakeup);
+}
+
+std::optional<std::vector<PortDescriptor>> read_ports(SerialPortWatcher* watcher) {
+  return read_latest(&watcher->ports);
+}
+
+}
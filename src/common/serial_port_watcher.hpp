@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ringbuffer.hpp"
+#include "serial.hpp"
+#include "serial_reactor.hpp"
+#include "triple_buffer.hpp"
+#include "wakeup.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace om {
+
+/*
+ * SerialPortWatcher - Opens serial ports and lists the system's ports on a background thread, since
+ * either can block for seconds on some drivers, and watches for serial devices being added or
+ * removed. On Linux, tty nodes appearing in or leaving /dev are reported by inotify; elsewhere, the
+ * ports are listed every `fallback_scan_interval_s` and compared with the previous list. Each
+ * change increments `num_device_changes` and publishes the new list.
+ *
+ * Each client is a thread that submits open requests and takes their results, matching them by
+ * `id`; it is woken through its reactor when a result arrives or a device changes. The list of
+ * ports may be read by another thread.
+ */
+
+struct SerialPortOpenRequest {
+  uint64_t id;
+  std::string port;
+  uint32_t baud;
+};
+
+struct SerialPortOpenResult {
+  uint64_t id;
+  std::optional<SerialPort> port;
+};
+
+struct SerialPortWatcherConfig {
+  static constexpr int queue_capacity = 16;
+  static constexpr double watch_interval_s = 0.1;
+  static constexpr double fallback_scan_interval_s = 2.0;
+};
+
+struct SerialPortWatcher {
+  struct Client {
+    RingBuffer<SerialPortOpenRequest, SerialPortWatcherConfig::queue_capacity> requests;
+    RingBuffer<SerialPortOpenResult, SerialPortWatcherConfig::queue_capacity> results;
+    //  Woken when one of its opens completes or a device changes.
+    SerialReactor* reactor{};
+  };
+
+  std::vector<std::unique_ptr<Client>> clients;
+  TripleBuffer<std::vector<PortDescriptor>> ports;
+  std::atomic<uint64_t> num_device_changes{};
+  std::atomic<bool> rescan_requested{};
+
+  std::thread thread;
+  std::atomic<bool> keep_watching{};
+  WakeupSignal wakeup;
+#if defined(__linux__)
+  int inotify_fd{-1};
+#endif
+};
+
+//  Client `i` is woken through `reactors[i]`.
+bool start(SerialPortWatcher* watcher, SerialReactor** reactors, int num_clients);
+//  Closes any ports opened but not yet taken.
+void stop(SerialPortWatcher* watcher);
+
+//  by client. Returns false if too many of the client's requests are pending.
+bool submit_open(SerialPortWatcher* watcher, int client, SerialPortOpenRequest&& request);
+std::optional<SerialPortOpenResult> take_open_result(SerialPortWatcher* watcher, int client);
+uint64_t num_device_changes(const SerialPortWatcher& watcher);
+
+//  by any thread.
+void request_rescan(SerialPortWatcher* watcher);
+//  by one reader. Returns the ports if they were listed since the last call.
+std::optional<std::vector<PortDescriptor>> read_ports(SerialPortWatcher* watcher);
+
+}
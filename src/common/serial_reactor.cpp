@@ -0,0 +1,353 @@
+#include "serial_reactor.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace om {
+
+namespace {
+
+#if defined(__linux__)
+
+std::optional<speed_t> to_speed(uint32_t baud) {
+  switch (baud) {
+    case 9600:
+      return B9600;
+    case 19200:
+      return B19200;
+    case 38400:
+      return B38400;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    case 230400:
+      return B230400;
+    case 460800:
+      return B460800;
+    case 500000:
+      return B500000;
+    case 921600:
+      return B921600;
+    case 1000000:
+      return B1000000;
+    case 2000000:
+      return B2000000;
+    default:
+      return std::nullopt;
+  }
+}
+
+bool configure_raw(int fd, speed_t speed) {
+  termios tty{};
+  if (tcgetattr(fd, &tty) != 0) {
+    return false;
+  }
+
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+  //  With O_NONBLOCK, VMIN = 1 makes an empty read fail with EAGAIN, so that a read of 0 bytes
+  //  unambiguously means the device hung up.
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    return false;
+  }
+
+  tcflush(fd, TCIOFLUSH);
+  return true;
+}
+
+#endif
+
+} //  anon
+
+std::optional<SerialPort> open_serial_port(const std::string& port, uint32_t baud) {
+#if defined(__linux__)
+  auto speed = to_speed(baud);
+  if (!speed) {
+    printf("Unsupported baud rate: %d.\n", int(baud));
+    return std::nullopt;
+  }
+
+  const int fd = ::open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    printf("Failed to open port.\n");
+    return std::nullopt;
+  }
+
+  if (!configure_raw(fd, speed.value())) {
+    printf("Failed to configure port.\n");
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  SerialPort result;
+  result.fd = fd;
+  return result;
+#else
+  if (auto ctx = make_context(port, baud, 0)) {
+    //  Reads return at once with whatever is buffered. A write timeout of 0 would mean no timeout,
+    //  so that a device that stopped reading would block the reactor's thread indefinitely.
+    try {
+      ctx.value().instance->setTimeout(
+        serial::Timeout::max(), 0, 0,
+        SerialReactorConfig::write_timeout_ms, SerialReactorConfig::write_timeout_ms_per_byte);
+    } catch (...) {
+      printf("Failed to set port timeouts.\n");
+      return std::nullopt;
+    }
+    SerialPort result;
+    result.context = std::move(ctx.value());
+    return result;
+  } else {
+    return std::nullopt;
+  }
+#endif
+}
+
+void close_serial_port(SerialPort* port) {
+#if defined(__linux__)
+  if (port->fd >= 0) {
+    ::close(port->fd);
+    port->fd = -1;
+  }
+#else
+  port->context = {};
+#endif
+}
+
+bool is_open(const SerialPort& port) {
+#if defined(__linux__)
+  return port.fd >= 0;
+#else
+  return is_open(port.context);
+#endif
+}
+
+bool set_baud_rate(SerialPort* port, uint32_t baud) {
+#if defined(__linux__)
+  auto speed = to_speed(baud);
+  termios tty{};
+  if (!speed || tcgetattr(port->fd, &tty) != 0) {
+    return false;
+  }
+  cfsetispeed(&tty, speed.value());
+  cfsetospeed(&tty, speed.value());
+  if (tcsetattr(port->fd, TCSANOW, &tty) != 0) {
+    return false;
+  }
+  tcflush(port->fd, TCIFLUSH);
+  return true;
+#else
+  try {
+    port->context.instance->setBaudrate(baud);
+    port->context.instance->flushInput();
+    return true;
+  } catch (...) {
+    return false;
+  }
+#endif
+}
+
+SerialWriteResult write_nonblocking(SerialPort* port, const char* data, int size) {
+  int num_written{};
+#if defined(__linux__)
+  while (num_written < size) {
+    auto res = ::write(port->fd, data + num_written, size_t(size - num_written));
+    if (res < 0 && errno == EINTR) {
+      continue;
+    } else if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      //  The output buffer is full, so the device is not keeping up.
+      break;
+    } else if (res <= 0) {
+      return SerialWriteResult::Failed;
+    }
+    num_written += int(res);
+  }
+#else
+  try {
+    //  Returns short if the write timed out.
+    num_written = int(port->context.instance->write(
+      reinterpret_cast<const uint8_t*>(data), size_t(size)));
+  } catch (...) {
+    return SerialWriteResult::Failed;
+  }
+#endif
+  if (num_written == size) {
+    return SerialWriteResult::Written;
+  } else if (num_written == 0) {
+    return SerialWriteResult::Full;
+  } else {
+    return SerialWriteResult::Failed;
+  }
+}
+
+int read_nonblocking(SerialPort* port, char* dst, int max_size) {
+#if defined(__linux__)
+  while (true) {
+    auto res = ::read(port->fd, dst, size_t(max_size));
+    if (res > 0) {
+      return int(res);
+    } else if (res == 0) {
+      return -1;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  }
+#else
+  try {
+    auto& instance = *port->context.instance;
+    const auto num_avail = std::min(instance.available(), size_t(max_size));
+    if (num_avail == 0) {
+      return 0;
+    }
+    return int(instance.read(reinterpret_cast<uint8_t*>(dst), num_avail));
+  } catch (...) {
+    return -1;
+  }
+#endif
+}
+
+bool initialize(SerialReactor* reactor) {
+#if defined(__linux__)
+  reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  reactor->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (reactor->epoll_fd < 0 || reactor->event_fd < 0) {
+    terminate(reactor);
+    return false;
+  }
+
+  epoll_event evt{};
+  evt.events = EPOLLIN;
+  evt.data.ptr = nullptr;
+  if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->event_fd, &evt) != 0) {
+    terminate(reactor);
+    return false;
+  }
+#endif
+  return true;
+}
+
+void terminate(SerialReactor* reactor) {
+  reactor->registrations.clear();
+#if defined(__linux__)
+  if (reactor->event_fd >= 0) {
+    ::close(reactor->event_fd);
+    reactor->event_fd = -1;
+  }
+  if (reactor->epoll_fd >= 0) {
+    ::close(reactor->epoll_fd);
+    reactor->epoll_fd = -1;
+  }
+#endif
+}
+
+bool add_port(SerialReactor* reactor, SerialPort* port, void* user_data) {
+  assert(is_open(*port) && user_data);
+#if defined(__linux__)
+  epoll_event evt{};
+  evt.events = EPOLLIN | EPOLLRDHUP;
+  evt.data.ptr = user_data;
+  if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, port->fd, &evt) != 0) {
+    return false;
+  }
+#endif
+  reactor->registrations.push_back({port, user_data});
+  return true;
+}
+
+void remove_port(SerialReactor* reactor, SerialPort* port) {
+  auto& regs = reactor->registrations;
+  auto it = std::find_if(regs.begin(), regs.end(), [port](auto& reg) {
+    return reg.port == port;
+  });
+  if (it == regs.end()) {
+    return;
+  }
+#if defined(__linux__)
+  epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, port->fd, nullptr);
+#endif
+  regs.erase(it);
+}
+
+int wait_readable(SerialReactor* reactor, double timeout_s, void** ready, int max_num_ready) {
+#if defined(__linux__)
+  epoll_event events[SerialReactorConfig::max_num_events];
+  const int max_num_events = std::min(max_num_ready + 1, SerialReactorConfig::max_num_events);
+  const int timeout_ms = std::max(0, int(timeout_s * 1e3 + 0.5));
+
+  int num_events = epoll_wait(reactor->epoll_fd, events, max_num_events, timeout_ms);
+  if (num_events < 0) {
+    return 0;
+  }
+
+  int num_ready{};
+  for (int i = 0; i < num_events; i++) {
+    if (events[i].data.ptr == nullptr) {
+      uint64_t ignore;
+      (void) ::read(reactor->event_fd, &ignore, sizeof(ignore));
+    } else if (num_ready < max_num_ready) {
+      ready[num_ready++] = events[i].data.ptr;
+    }
+  }
+  return num_ready;
+#else
+  auto collect = [reactor, ready, max_num_ready]() {
+    int num_ready{};
+    for (auto& reg : reactor->registrations) {
+      if (num_ready == max_num_ready) {
+        break;
+      }
+      bool readable{true};
+      try {
+        readable = reg.port->context.instance->available() > 0;
+      } catch (...) {
+        //  Report the port so that the caller's read fails and it can close the port.
+      }
+      if (readable) {
+        ready[num_ready++] = reg.user_data;
+      }
+    }
+    return num_ready;
+  };
+
+  int num_ready = collect();
+  if (num_ready == 0 && timeout_s > 0.0) {
+    const double interval = std::min(timeout_s, SerialReactorConfig::fallback_poll_interval_s);
+    wait_for(&reactor->wakeup, interval, [reactor]() {
+      return reactor->woken.load();
+    });
+    reactor->woken.store(false);
+    num_ready = collect();
+  }
+  return num_ready;
+#endif
+}
+
+void wake(SerialReactor* reactor) {
+#if defined(__linux__)
+  const uint64_t one = 1;
+  (void) ::write(reactor->event_fd, &one, sizeof(one));
+#else
+  reactor->woken.store(true);
+  notify(&reactor->wakeup);
+#endif
+}
+
+}
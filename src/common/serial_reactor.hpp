@@ -0,0 +1,91 @@
+#pragma once
+
+#include "serial.hpp"
+#include "wakeup.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace om {
+
+/*
+ * SerialPort - A serial port whose reads and writes never block. On Linux, the port is a raw file
+ * descriptor configured with termios, so that it can be waited on with epoll. Elsewhere, it wraps a
+ * SerialContext and reads only the bytes already buffered by the driver; there, the guarantee is
+ * weaker: a write the driver cannot take at once blocks for up to `write_timeout_ms` plus
+ * `write_timeout_ms_per_byte` per byte, so a wedged device can still stall its reactor that long.
+ */
+
+struct SerialPort {
+#if defined(__linux__)
+  int fd{-1};
+#else
+  SerialContext context;
+#endif
+};
+
+std::optional<SerialPort> open_serial_port(const std::string& port, uint32_t baud);
+void close_serial_port(SerialPort* port);
+bool is_open(const SerialPort& port);
+//  Changes the rate of an open port, discarding any received bytes not yet read.
+bool set_baud_rate(SerialPort* port, uint32_t baud);
+
+enum class SerialWriteResult {
+  Written = 0,
+  //  Nothing was written because the port's output buffer is full; the port is still usable.
+  Full,
+  //  The port failed, or the write stopped part way, leaving a truncated command on the wire; the
+  //  port should be closed.
+  Failed,
+};
+
+SerialWriteResult write_nonblocking(SerialPort* port, const char* data, int size);
+//  Returns the number of bytes read into `dst` (possibly 0), or -1 if the port failed, e.g.
+//  because the device was unplugged.
+int read_nonblocking(SerialPort* port, char* dst, int max_size);
+
+/*
+ * SerialReactor - Waits on a set of SerialPorts at once, returning whichever are readable. One
+ * thread owns the reactor; any thread may `wake` it. Uses epoll and an eventfd on Linux; elsewhere
+ * it polls the ports' buffered byte counts at `fallback_poll_interval_s`, which costs a little CPU
+ * and up to that much latency per read.
+ */
+
+struct SerialReactor {
+  struct Registration {
+    SerialPort* port;
+    void* user_data;
+  };
+
+  std::vector<Registration> registrations;
+#if defined(__linux__)
+  int epoll_fd{-1};
+  int event_fd{-1};
+#else
+  WakeupSignal wakeup;
+  std::atomic<bool> woken{};
+#endif
+};
+
+struct SerialReactorConfig {
+  static constexpr double fallback_poll_interval_s = 1e-3;
+  //  Bound on a write that the driver cannot take at once, where ports are not file descriptors.
+  static constexpr uint32_t write_timeout_ms = 10;
+  static constexpr uint32_t write_timeout_ms_per_byte = 2;
+  static constexpr int max_num_events = 32;
+};
+
+bool initialize(SerialReactor* reactor);
+void terminate(SerialReactor* reactor);
+
+//  `user_data` is returned by `wait_readable` when `port` has data to read or has failed.
+bool add_port(SerialReactor* reactor, SerialPort* port, void* user_data);
+void remove_port(SerialReactor* reactor, SerialPort* port);
+
+//  Blocks until a registered port is readable, `wake` is called, or `timeout_s` elapses. Writes
+//  the user data of readable ports to `ready` and returns how many there are.
+int wait_readable(SerialReactor* reactor, double timeout_s, void** ready, int max_num_ready);
+//  Safe to call from any thread.
+void wake(SerialReactor* reactor);
+
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include <cstdint>
+
+namespace om {
+
+/*
+ * Handle ids issued by a SlotMap pack a slot index in the low bits and the slot's generation in the
+ * high bits. Generations start at 1, so a valid id is never 0, and are advanced each time the slot
+ * is freed, so an id that outlives its element no longer matches the slot.
+ */
+
+namespace slot_map {
+
+constexpr int index_bits = 16;
+constexpr uint32_t index_mask = (uint32_t(1) << index_bits) - 1;
+constexpr uint32_t generation_mask = uint32_t(0xffffffff) >> index_bits;
+constexpr int max_num_slots = int(index_mask) + 1;
+
+inline uint32_t slot_index(uint32_t id) {
+  return id & index_mask;
+}
+
+inline uint32_t generation(uint32_t id) {
+  return id >> index_bits;
+}
+
+inline uint32_t make_id(uint32_t index, uint32_t generation) {
+  return (generation << index_bits) | index;
+}
+
+inline uint32_t next_generation(uint32_t generation) {
+  generation = (generation + 1) & generation_mask;
+  return generation == 0 ? 1 : generation;
+}
+
+}
+
+/*
+ * SlotMap - Associates elements with generational handles. Handle is a struct with a `uint32_t id`
+ * member, as declared with OM_INTEGER_IDENTIFIER_EQUALITY.
+ *
+ * Elements are stored densely, so iteration is a linear walk over contiguous memory, and lookup is
+ * two array reads plus a generation check. Handles to erased elements are detected rather than
+ * aliasing whatever is later stored in the same slot. Erasing moves the last element into the
+ * erased element's place; otherwise, elements are iterated in insertion order. Inserting may
+ * invalidate pointers to elements.
+ */
+
+template <typename Handle, typename T>
+class SlotMap {
+private:
+  static constexpr uint32_t null_index = 0xffffffff;
+
+  struct Slot {
+    uint32_t generation;
+    //  Index into `values` while occupied; next free slot while free.
+    uint32_t index;
+  };
+
+public:
+  template <typename U = T>
+  Handle insert(U&& value);
+  //  Returns whether `handle` referred to a live element.
+  bool erase(Handle handle);
+  //  Erase all elements. Existing handles become stale.
+  void clear();
+
+  T* find(Handle handle);
+  const T* find(Handle handle) const;
+  bool contains(Handle handle) const {
+    return find(handle) != nullptr;
+  }
+
+  //  `handle` must refer to a live element.
+  T& at(Handle handle);
+  const T& at(Handle handle) const;
+
+  //  Handle of the `i`th element in iteration order.
+  Handle handle_at(int i) const {
+    return handles[i];
+  }
+
+  int size() const {
+    return int(values.size());
+  }
+  bool empty() const {
+    return values.empty();
+  }
+  void reserve(int n);
+
+  T* begin() {
+    return values.data();
+  }
+  T* end() {
+    return values.data() + values.size();
+  }
+  const T* begin() const {
+    return values.data();
+  }
+  const T* end() const {
+    return values.data() + values.size();
+  }
+
+private:
+  int find_index(Handle handle) const;
+
+private:
+  std::vector<Slot> slots;
+  std::vector<T> values;
+  std::vector<Handle> handles;
+  uint32_t free_head{null_index};
+};
+
+/*
+ * Impl
+ */
+
+template <typename Handle, typename T>
+template <typename U>
+Handle SlotMap<Handle, T>::insert(U&& value) {
+  uint32_t slot_ind;
+  if (free_head != null_index) {
+    slot_ind = free_head;
+    free_head = slots[slot_ind].index;
+  } else {
+    assert(int(slots.size()) < slot_map::max_num_slots);
+    slot_ind = uint32_t(slots.size());
+    slots.push_back(Slot{1, 0});
+  }
+
+  auto& slot = slots[slot_ind];
+  slot.index = uint32_t(values.size());
+  values.push_back(std::forward<U>(value));
+
+  Handle result{slot_map::make_id(slot_ind, slot.generation)};
+  handles.push_back(result);
+  return result;
+}
+
+template <typename Handle, typename T>
+bool SlotMap<Handle, T>::erase(Handle handle) {
+  const int ind = find_index(handle);
+  if (ind < 0) {
+    return false;
+  }
+
+  const int last = size() - 1;
+  if (ind != last) {
+    values[ind] = std::move(values[last]);
+    handles[ind] = handles[last];
+    slots[slot_map::slot_index(handles[ind].id)].index = uint32_t(ind);
+  }
+  values.pop_back();
+  handles.pop_back();
+
+  const uint32_t slot_ind = slot_map::slot_index(handle.id);
+  auto& slot = slots[slot_ind];
+  slot.generation = slot_map::next_generation(slot.generation);
+  slot.index = free_head;
+  free_head = slot_ind;
+  return true;
+}
+
+template <typename Handle, typename T>
+void SlotMap<Handle, T>::clear() {
+  for (auto& handle : handles) {
+    const uint32_t slot_ind = slot_map::slot_index(handle.id);
+    auto& slot = slots[slot_ind];
+    slot.generation = slot_map::next_generation(slot.generation);
+    slot.index = free_head;
+    free_head = slot_ind;
+  }
+  values.clear();
+  handles.clear();
+}
+
+template <typename Handle, typename T>
+int SlotMap<Handle, T>::find_index(Handle handle) const {
+  const uint32_t slot_ind = slot_map::slot_index(handle.id);
+  if (slot_ind >= uint32_t(slots.size())) {
+    return -1;
+  }
+  //  A free slot's generation was advanced when it was freed, so it never matches.
+  const auto& slot = slots[slot_ind];
+  if (slot.generation != slot_map::generation(handle.id)) {
+    return -1;
+  }
+  return int(slot.index);
+}
+
+template <typename Handle, typename T>
+T* SlotMap<Handle, T>::find(Handle handle) {
+  const int ind = find_index(handle);
+  return ind < 0 ? nullptr : &values[ind];
+}
+
+template <typename Handle, typename T>
+const T* SlotMap<Handle, T>::find(Handle handle) const {
+  const int ind = find_index(handle);
+  return ind < 0 ? nullptr : &values[ind];
+}
+
+template <typename Handle, typename T>
+T& SlotMap<Handle, T>::at(Handle handle) {
+  auto* res = find(handle);
+  assert(res);
+  return *res;
+}
+
+template <typename Handle, typename T>
+const T& SlotMap<Handle, T>::at(Handle handle) const {
+  auto* res = find(handle);
+  assert(res);
+  return *res;
+}
+
+template <typename Handle, typename T>
+void SlotMap<Handle, T>::reserve(int n) {
+  slots.reserve(n);
+  values.reserve(n);
+  handles.reserve(n);
+}
+
+}
@@ -5,13 +5,14 @@
 
 namespace om {
 
-using TimePoint = std::chrono::high_resolution_clock::time_point;
+//  Monotonic, so that intervals between time points are never negative.
+using TimePoint = std::chrono::steady_clock::time_point;
 using Duration = std::chrono::duration<double>;
 
 std::string date_string();
 
 inline TimePoint now() {
-  return std::chrono::high_resolution_clock::now();
+  return std::chrono::steady_clock::now();
 }
 
 inline double elapsed_time(const TimePoint& t0, const TimePoint& t1) {
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "common.hpp"
+#include <atomic>
+#include <optional>
+#include <cstdint>
+
+namespace om {
+
+/*
+ * TripleBuffer - Non-locking "latest value" channel for 1 writer and 1 reader. The writer may
+ * publish as often as it likes without waiting for the reader; the reader always gets the most
+ * recently published value in O(1), and learns how many values it never saw.
+ *
+ * Three slots rotate between the writer (back), the reader (front), and a shared middle slot whose
+ * index, together with a "has new value" bit, is exchanged atomically.
+ */
+
+template <typename T>
+struct TripleBuffer {
+  static constexpr uint8_t index_mask = 0x3;
+  static constexpr uint8_t fresh_bit = 0x4;
+
+  struct Slot {
+    T value;
+    uint64_t sequence;
+  };
+
+  Slot slots[3]{};
+  alignas(cache_line_size) std::atomic<uint8_t> middle{1};
+
+  //  by writer
+  alignas(cache_line_size) uint8_t back{0};
+  uint64_t write_sequence{};
+
+  //  by reader
+  alignas(cache_line_size) uint8_t front{2};
+  uint64_t read_sequence{};
+  uint64_t num_skipped{};
+};
+
+//  by writer
+template <typename T, typename U = T>
+void write_latest(TripleBuffer<T>* tb, U&& value) {
+  auto& slot = tb->slots[tb->back];
+  slot.value = std::forward<U>(value);
+  slot.sequence = ++tb->write_sequence;
+
+  const uint8_t prev = tb->middle.exchange(
+    uint8_t(tb->back | TripleBuffer<T>::fresh_bit), std::memory_order_acq_rel);
+  tb->back = uint8_t(prev & TripleBuffer<T>::index_mask);
+}
+
+//  by reader. Returns the latest value if one was published since the last call.
+template <typename T>
+std::optional<T> read_latest(TripleBuffer<T>* tb) {
+  if (!(tb->middle.load(std::memory_order_relaxed) & TripleBuffer<T>::fresh_bit)) {
+    return std::nullopt;
+  }
+
+  const uint8_t prev = tb->middle.exchange(tb->front, std::memory_order_acq_rel);
+  tb->front = uint8_t(prev & TripleBuffer<T>::index_mask);
+
+  auto& slot = tb->slots[tb->front];
+  if (tb->read_sequence > 0 && slot.sequence > tb->read_sequence + 1) {
+    tb->num_skipped += slot.sequence - tb->read_sequence - 1;
+  }
+  tb->read_sequence = slot.sequence;
+  return slot.value;
+}
+
+//  by reader. Number of published values that were superseded before being read.
+template <typename T>
+uint64_t num_skipped(const TripleBuffer<T>* tb) {
+  return tb->num_skipped;
+}
+
+}
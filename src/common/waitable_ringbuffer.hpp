@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ringbuffer.hpp"
+#include "wakeup.hpp"
+
+namespace om {
+
+/*
+ * WaitableRingBuffer - A RingBuffer whose reader can block until data arrives, rather than poll.
+ * Writes through this type wake the reader if, and only if, it is parked in `wait_for_data`.
+ */
+
+template <typename T, int N, typename Storage = RingBufferStackStorage<T, N>,
+          RingBufferFullPolicy Policy = RingBufferFullPolicy::RejectNewest>
+class WaitableRingBuffer : public RingBuffer<T, N, Storage, Policy> {
+private:
+  using Base = RingBuffer<T, N, Storage, Policy>;
+
+public:
+  template <typename U = T>
+  void write(U&& element) noexcept {
+    Base::write(std::forward<U>(element));
+    notify(&signal);
+  }
+
+  template <typename U = T>
+  bool maybe_write(U&& element) noexcept {
+    if (Base::maybe_write(std::forward<U>(element))) {
+      notify(&signal);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  void write_range_copy(const T* begin, const T* end) noexcept {
+    Base::write_range_copy(begin, end);
+    notify(&signal);
+  }
+
+  void write_range_move(T* begin, T* end) noexcept {
+    Base::write_range_move(begin, end);
+    notify(&signal);
+  }
+
+  void commit_write(int n) noexcept {
+    Base::commit_write(n);
+    notify(&signal);
+  }
+
+  //  by reader. Returns true if data is pending read.
+  bool wait_for_data(double timeout_s) noexcept {
+    return wait_for(&signal, timeout_s, [this]() {
+      return this->size() > 0;
+    });
+  }
+
+private:
+  WakeupSignal signal;
+};
+
+}
@@ -0,0 +1,84 @@
+#include "wakeup.hpp"
+#include "time.hpp"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+namespace om {
+
+namespace {
+
+[[maybe_unused]] bool still_parked(const WakeupSignal* signal) {
+  return signal->state.load() == WakeupSignal::Parked;
+}
+
+#if defined(__linux__)
+
+void platform_wait(WakeupSignal* signal, double timeout_s) {
+  timespec ts{};
+  ts.tv_sec = time_t(timeout_s);
+  ts.tv_nsec = long((timeout_s - double(ts.tv_sec)) * 1e9);
+  auto* addr = reinterpret_cast<uint32_t*>(&signal->state);
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, uint32_t(WakeupSignal::Parked), &ts, nullptr, 0);
+}
+
+void platform_wake(WakeupSignal* signal) {
+  auto* addr = reinterpret_cast<uint32_t*>(&signal->state);
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+#elif defined(_WIN32)
+
+void platform_wait(WakeupSignal* signal, double timeout_s) {
+  uint32_t expect = WakeupSignal::Parked;
+  WaitOnAddress(&signal->state, &expect, sizeof(expect), DWORD(timeout_s * 1e3));
+}
+
+void platform_wake(WakeupSignal* signal) {
+  WakeByAddressSingle(&signal->state);
+}
+
+#else
+
+void platform_wait(WakeupSignal* signal, double timeout_s) {
+  std::unique_lock<std::mutex> lock(signal->mutex);
+  signal->cv.wait_for(lock, Duration(timeout_s), [signal]() {
+    return !still_parked(signal);
+  });
+}
+
+void platform_wake(WakeupSignal* signal) {
+  {
+    std::lock_guard<std::mutex> lock(signal->mutex);
+  }
+  signal->cv.notify_one();
+}
+
+#endif
+
+} //  anon
+
+void detail::park(WakeupSignal* signal, double timeout_s) {
+  //  Waits can return spuriously, so retry until notified or out of time.
+  const auto t0 = now();
+  double remaining = timeout_s;
+  while (remaining > 0.0 && still_parked(signal)) {
+    platform_wait(signal, remaining);
+    remaining = timeout_s - elapsed_time(t0, now());
+  }
+}
+
+void detail::unpark(WakeupSignal* signal) {
+  platform_wake(signal);
+}
+
+}
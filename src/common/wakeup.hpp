@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#if !defined(__linux__) && !defined(_WIN32)
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace om {
+
+/*
+ * WakeupSignal - Lets one consumer thread block until a producer signals it or a timeout elapses.
+ * The producer only makes a system call when the consumer is actually parked, so `notify` is a
+ * fence and a load in the common case. Uses a futex on Linux and WaitOnAddress on Windows.
+ */
+
+struct WakeupSignal {
+  enum State : uint32_t {
+    Idle = 0,
+    Parked,
+    Notified
+  };
+
+  std::atomic<uint32_t> state{Idle};
+#if !defined(__linux__) && !defined(_WIN32)
+  std::mutex mutex;
+  std::condition_variable cv;
+#endif
+};
+
+namespace detail {
+void park(WakeupSignal* signal, double timeout_s);
+void unpark(WakeupSignal* signal);
+}
+
+//  by producer, after publishing data.
+inline void notify(WakeupSignal* signal) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (signal->state.load(std::memory_order_relaxed) == WakeupSignal::Parked &&
+      signal->state.exchange(WakeupSignal::Notified) == WakeupSignal::Parked) {
+    detail::unpark(signal);
+  }
+}
+
+//  by consumer. Blocks until `ready()` returns true, `notify` is called, or `timeout_s` elapses.
+//  Returns the final value of `ready()`.
+template <typename Ready>
+bool wait_for(WakeupSignal* signal, double timeout_s, Ready&& ready) {
+  if (ready()) {
+    return true;
+  }
+
+  signal->state.store(WakeupSignal::Parked);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!ready()) {
+    detail::park(signal, timeout_s);
+  }
+  signal->state.store(WakeupSignal::Idle);
+  return ready();
+}
+
+}
@@ -0,0 +1,193 @@
+/*
+ * Compares the lever worker's response path against the previous one, which is reproduced below:
+ * received bytes appended to an std::string, each line copied out with `substr`, fields located
+ * with `std::string::find` and converted with `strtol` / `strtof`, and the force command built by
+ * `std::to_string` concatenation.
+ *
+ * Each poll formats a force command, then receives the force and state responses in chunks of
+ * `chunk_size` bytes, as a non-blocking read would return them. Reported are the mean time and the
+ * number of heap allocations per poll, counted by replacing the global operator new.
+ */
+
+#include "common/line_buffer.hpp"
+#include "common/serial_lever.hpp"
+#include "common/time.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace {
+
+std::atomic<uint64_t> num_allocations{};
+
+struct Config {
+  static constexpr int num_polls = 1 << 18;
+  static constexpr int chunk_size = 32;
+  static constexpr int buffer_capacity = 1024;
+};
+
+const char* force_response = "target grams: 120\tcalculated PWM value: 2287\r\n";
+const char* state_response =
+  "strain gauge reading: 31245.37\tcalculated PWM: 2301.55\tacutal PWM: 2287P: 40211\r\n";
+
+namespace legacy {
+
+std::optional<int> parse_force(const std::string& s) {
+  constexpr const char* tg = "target grams: ";
+  auto tg_it = s.find(tg);
+  if (tg_it == std::string::npos) {
+    return std::nullopt;
+  } else {
+    char* ignore;
+    return std::strtol(s.data() + tg_it + std::strlen(tg), &ignore, 10);
+  }
+}
+
+std::optional<om::LeverState> parse_state(const std::string& s) {
+  const auto not_found = std::string::npos;
+  constexpr const char* sg = "strain gauge reading: ";
+  constexpr const char* cpwm = "calculated PWM: ";
+  constexpr const char* real_pwm = "acutal PWM: ";
+  constexpr const char* pot_str = "P: ";
+
+  auto sg_it = s.find(sg);
+  auto cpwm_it = s.find(cpwm);
+  auto real_pwm_it = s.find(real_pwm);
+  auto pot_it = s.find(pot_str);
+  if (sg_it == not_found || cpwm_it == not_found || real_pwm_it == not_found || pot_it == not_found) {
+    return std::nullopt;
+  }
+
+  char* ignore;
+  om::LeverState result{};
+  result.strain_gauge = std::strtof(s.data() + sg_it + std::strlen(sg), &ignore);
+  result.calculated_pwm = std::strtof(s.data() + cpwm_it + std::strlen(cpwm), &ignore);
+  result.actual_pwm = std::strtof(s.data() + real_pwm_it + std::strlen(real_pwm), &ignore);
+  result.potentiometer_reading = std::strtof(s.data() + pot_it + std::strlen(pot_str), &ignore);
+  return result;
+}
+
+std::string make_force_command(int force) {
+  std::string command{"g"};
+  command += std::to_string(force);
+  command += "\n";
+  return command;
+}
+
+} //  legacy
+
+template <typename OnChunk>
+void feed(const char* response, OnChunk&& on_chunk) {
+  const int size = int(std::strlen(response));
+  for (int i = 0; i < size; i += Config::chunk_size) {
+    on_chunk(response + i, std::min(Config::chunk_size, size - i));
+  }
+}
+
+struct Result {
+  double ns_per_poll;
+  double allocations_per_poll;
+  double checksum;
+};
+
+template <typename Poll>
+Result measure(Poll&& poll) {
+  double checksum{};
+  const uint64_t allocs0 = num_allocations.load();
+  auto t0 = om::now();
+  for (int i = 0; i < Config::num_polls; i++) {
+    checksum += poll(i);
+  }
+  const double elapsed = om::elapsed_time(t0, om::now());
+  const uint64_t allocs1 = num_allocations.load();
+
+  Result result{};
+  result.ns_per_poll = elapsed / double(Config::num_polls) * 1e9;
+  result.allocations_per_poll = double(allocs1 - allocs0) / double(Config::num_polls);
+  result.checksum = checksum;
+  return result;
+}
+
+Result run_legacy() {
+  std::string received;
+  return measure([&](int i) {
+    double sum{};
+    auto command = legacy::make_force_command(100 + (i & 63));
+    sum += double(command.size());
+
+    auto on_chunk = [&](const char* data, int size) {
+      received.append(data, size_t(size));
+      std::string::size_type eol;
+      while ((eol = received.find('\n')) != std::string::npos) {
+        std::string line = received.substr(0, eol + 1);
+        received.erase(0, eol + 1);
+        if (auto force = legacy::parse_force(line)) {
+          sum += force.value();
+        } else if (auto state = legacy::parse_state(line)) {
+          sum += state.value().strain_gauge;
+        }
+      }
+    };
+    feed(force_response, on_chunk);
+    feed(state_response, on_chunk);
+    return sum;
+  });
+}
+
+Result run_line_buffer() {
+  om::LineBuffer<Config::buffer_capacity> received;
+  return measure([&](int i) {
+    double sum{};
+    char command[om::max_lever_command_size()];
+    sum += om::format_set_force_command(100 + (i & 63), command, int(sizeof(command)));
+
+    auto on_chunk = [&](const char* data, int size) {
+      auto [dst, capacity] = om::write_space(&received);
+      std::memcpy(dst, data, size_t(std::min(size, capacity)));
+      om::commit_write(&received, std::min(size, capacity));
+      while (auto line = om::next_line(&received)) {
+        if (auto force = om::parse_lever_force(line.value())) {
+          sum += force.value();
+        } else if (auto state = om::parse_lever_state(line.value())) {
+          sum += state.value().strain_gauge;
+        }
+      }
+    };
+    feed(force_response, on_chunk);
+    feed(state_response, on_chunk);
+    return sum;
+  });
+}
+
+void print(const char* name, const Result& result) {
+  printf("%12s: %7.1f ns/poll | %5.2f allocations/poll | checksum %0.1f\n",
+         name, result.ns_per_poll, result.allocations_per_poll, result.checksum);
+}
+
+} //  anon
+
+void* operator new(size_t size) {
+  num_allocations++;
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+int main(int, char**) {
+  print("legacy", run_legacy());
+  print("line_buffer", run_line_buffer());
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Contention benchmark for om::MPSCQueue. 2, 4 and 8 producer threads each push timestamped events
+ * while a single consumer drains them in batches, as a logging thread would. Reports aggregate
+ * throughput, the fraction of writes that found the queue full, and enqueue -> dequeue latency.
+ */
+
+#include "common/mpsc_queue.hpp"
+#include "common/time.hpp"
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <cstdio>
+
+namespace {
+
+struct Config {
+  static constexpr int queue_capacity = 4096;
+  static constexpr int num_events_per_producer = 1 << 19;
+  static constexpr int drain_batch_size = 256;
+  static constexpr int producer_counts[3]{2, 4, 8};
+};
+
+struct Event {
+  uint32_t producer;
+  uint32_t sequence;
+  om::TimePoint time;
+};
+
+using Queue = om::MPSCQueue<Event, Config::queue_capacity>;
+
+void run(int num_producers) {
+  auto queue = std::make_unique<Queue>();
+  std::atomic<uint64_t> num_full_writes{};
+  std::atomic<int> num_ready{};
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < num_producers; p++) {
+    producers.emplace_back([&, p]() {
+      num_ready++;
+      while (num_ready.load() < num_producers) {
+        std::this_thread::yield();
+      }
+
+      uint64_t full{};
+      for (int i = 0; i < Config::num_events_per_producer; i++) {
+        Event evt{uint32_t(p), uint32_t(i), om::now()};
+        while (!queue->maybe_write(evt)) {
+          full++;
+          std::this_thread::yield();
+        }
+      }
+      num_full_writes += full;
+    });
+  }
+
+  const uint64_t num_events = uint64_t(num_producers) * Config::num_events_per_producer;
+  std::vector<uint32_t> next_sequence(num_producers);
+  std::vector<float> latencies;
+  latencies.reserve(num_events);
+
+  uint64_t num_received{};
+  auto t0 = om::now();
+  while (num_received < num_events) {
+    const int n = queue->drain([&](Event& evt) {
+      if (evt.sequence != next_sequence[evt.producer]++) {
+        printf("Error: out of order event from producer %d.\n", int(evt.producer));
+        std::terminate();
+      }
+      latencies.push_back(float(om::elapsed_time(evt.time, om::now())));
+    }, Config::drain_batch_size);
+
+    num_received += uint64_t(n);
+    if (n == 0) {
+      std::this_thread::yield();
+    }
+  }
+  const double elapsed = om::elapsed_time(t0, om::now());
+
+  for (auto& producer : producers) {
+    producer.join();
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[std::min(latencies.size() - 1, size_t(p * double(latencies.size())))] * 1e6f;
+  };
+
+  printf("producers: %d | throughput: %7.2f M events/s | full: %5.2f%% | "
+         "latency (us) p50: %8.2f p99: %8.2f max: %8.2f\n",
+         num_producers,
+         double(num_events) / elapsed * 1e-6,
+         double(num_full_writes.load()) / double(num_events) * 100.0,
+         percentile(0.5), percentile(0.99), latencies.back() * 1e6f);
+}
+
+} //  anon
+
+int main(int, char**) {
+  for (int num_producers : Config::producer_counts) {
+    run(num_producers);
+  }
+  return 0;
+}
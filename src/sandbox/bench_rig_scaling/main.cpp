@@ -0,0 +1,178 @@
+/*
+ * Measures how the lever latency of each rig holds up as rigs are added to one lever system. For
+ * 1, 2, ... `max_num_rigs` rigs, the lever system is initialized with the levers of every rig, which
+ * are opened on consecutive ports `<port prefix>0`, `<port prefix>1`, ..., and then updated at the
+ * App's frame rate for `duration_s`. Each frame, the age of every lever's latest sample is
+ * recorded, and every `set_force_interval_s` each lever is commanded a new force, whose round trip
+ * the lever system records. Reported per rig are the achieved samples per second, the sample age
+ * at update, and the SetForce round trip.
+ *
+ * The ports can be provided by the virtual lever, e.g.
+ *   virtual_lever --levers 16 --link /tmp/lever
+ *   bench_rig_scaling /tmp/lever 8
+ *
+ * Usage: bench_rig_scaling <port prefix> <max num rigs> [seconds per step] [levers per rig]
+ *                          [num workers (0: one per 4 levers, up to the number of cores)]
+ */
+
+#include "common/latency_histogram.hpp"
+#include "common/lever_system.hpp"
+#include "common/time.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Config {
+  static constexpr double default_duration_s = 5.0;
+  static constexpr int default_num_levers_per_rig = 2;
+  static constexpr double frame_interval_s = 1.0 / 60.0;
+  static constexpr double open_timeout_s = 5.0;
+  static constexpr double set_force_interval_s = 0.1;
+  static constexpr int forces[2] = {100, 350};
+};
+
+struct RigResult {
+  double sample_rate_hz;
+  om::LatencyHistogram sample_age;
+  om::LatencyHistogram set_force_round_trip;
+  uint64_t num_failed_commands;
+  uint64_t num_reconnections;
+  int num_closed;
+};
+
+void add(om::LatencyHistogram* dst, const om::LatencyHistogram& src) {
+  if (src.total_count == 0) {
+    return;
+  }
+  for (int i = 0; i < om::LatencyHistogram::num_buckets; i++) {
+    dst->counts[i] += src.counts[i];
+  }
+  dst->min_us = dst->total_count == 0 ? src.min_us : std::min(dst->min_us, src.min_us);
+  dst->max_us = std::max(dst->max_us, src.max_us);
+  dst->sum_us += src.sum_us;
+  dst->total_count += src.total_count;
+}
+
+bool wait_until_open(om::lever::LeverSystem* sys, const std::vector<om::lever::SerialLeverHandle>& levers) {
+  const auto t0 = om::now();
+  while (om::elapsed_time(t0, om::now()) < Config::open_timeout_s) {
+    om::lever::update(sys);
+    bool all_open{true};
+    for (auto& lever : levers) {
+      all_open = all_open && om::lever::is_open(sys, lever);
+    }
+    if (all_open) {
+      return true;
+    }
+    std::this_thread::sleep_for(om::Duration(Config::frame_interval_s));
+  }
+  return false;
+}
+
+std::vector<RigResult> run(const std::string& port_prefix, int num_rigs, int num_levers_per_rig,
+                           int num_workers, double duration_s, int* used_num_workers) {
+  auto* sys = om::lever::get_global_lever_system();
+  const int num_levers = num_rigs * num_levers_per_rig;
+  std::vector<om::lever::SerialLeverHandle> levers(num_levers);
+  om::lever::initialize(sys, num_levers, levers.data(), num_workers,
+                        std::vector<int>(num_rigs, num_levers_per_rig));
+  *used_num_workers = om::lever::num_workers(sys);
+
+  for (int i = 0; i < num_levers; i++) {
+    om::lever::open_connection(sys, levers[i], port_prefix + std::to_string(i));
+  }
+
+  std::vector<RigResult> results(num_rigs);
+  if (!wait_until_open(sys, levers)) {
+    printf("Not every lever opened; are there %d ports named %s<n>?\n", num_levers, port_prefix.c_str());
+  }
+
+  const auto t0 = om::now();
+  auto next_set_force = t0;
+  int force_index{};
+  while (om::elapsed_time(t0, om::now()) < duration_s) {
+    const auto frame_start = om::now();
+    om::lever::update(sys);
+
+    for (int i = 0; i < num_levers; i++) {
+      if (auto sample = om::lever::get_latest_sample(sys, levers[i])) {
+        om::record(&results[i / num_levers_per_rig].sample_age,
+                   om::elapsed_time(sample.value().time, frame_start));
+      }
+    }
+
+    if (frame_start >= next_set_force) {
+      force_index = 1 - force_index;
+      for (auto& lever : levers) {
+        om::lever::set_force(sys, lever, Config::forces[force_index]);
+      }
+      next_set_force = frame_start + std::chrono::duration_cast<om::TimePoint::duration>(
+        om::Duration(Config::set_force_interval_s));
+    }
+
+    std::this_thread::sleep_until(frame_start + std::chrono::duration_cast<om::TimePoint::duration>(
+      om::Duration(Config::frame_interval_s)));
+  }
+
+  for (int i = 0; i < num_levers; i++) {
+    auto& result = results[i / num_levers_per_rig];
+    const auto io = om::lever::get_io_stats(sys, levers[i]);
+    const auto latency = om::lever::get_command_latency_stats(sys, levers[i]);
+    const int set_force = int(om::lever::DeviceCommandType::SetForce);
+    result.sample_rate_hz += io.state_sample_rate_hz / double(num_levers_per_rig);
+    result.num_reconnections += io.num_reconnections;
+    result.num_closed += int(!om::lever::is_open(sys, levers[i]));
+    add(&result.set_force_round_trip, latency.round_trip[set_force]);
+    for (int k = 0; k < om::lever::num_device_command_types(); k++) {
+      result.num_failed_commands += latency.num_failed[k];
+    }
+  }
+
+  om::lever::terminate(sys);
+  return results;
+}
+
+void print(int num_rigs, int num_workers, const std::vector<RigResult>& results) {
+  printf("%d rig(s), %d worker(s)\n", num_rigs, num_workers);
+  for (int i = 0; i < int(results.size()); i++) {
+    auto& result = results[i];
+    auto& age = result.sample_age;
+    auto& rt = result.set_force_round_trip;
+    printf("  rig %2d: %7.1f samples/s per lever | sample age p50 %6.2f ms p99 %6.2f ms | "
+           "SetForce p50 %6.2f ms p99 %6.2f ms max %6.2f ms | %d failed | %d reconnections | "
+           "%d closed\n",
+           i, result.sample_rate_hz, om::percentile_s(age, 50.0) * 1e3,
+           om::percentile_s(age, 99.0) * 1e3, om::percentile_s(rt, 50.0) * 1e3,
+           om::percentile_s(rt, 99.0) * 1e3, double(rt.max_us) * 1e-3,
+           int(result.num_failed_commands), int(result.num_reconnections), result.num_closed);
+  }
+}
+
+} //  anon
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    printf("Usage: %s <port prefix> <max num rigs> [seconds per step] [levers per rig] [num workers]\n",
+           argv[0]);
+    return 1;
+  }
+
+  const std::string port_prefix{argv[1]};
+  const int max_num_rigs = std::max(1, std::atoi(argv[2]));
+  const double duration_s = argc > 3 ? std::atof(argv[3]) : Config::default_duration_s;
+  const int num_levers_per_rig = argc > 4 ?
+    std::max(1, std::atoi(argv[4])) : Config::default_num_levers_per_rig;
+  const int num_workers = argc > 5 ? std::atoi(argv[5]) : 0;
+
+  for (int num_rigs = 1; num_rigs <= max_num_rigs; num_rigs++) {
+    int used_num_workers{};
+    auto results = run(port_prefix, num_rigs, num_levers_per_rig, num_workers, duration_s, &used_num_workers);
+    print(num_rigs, used_num_workers, results);
+  }
+  return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Compares om::RingBuffer against the previous implementation (adjacent, sequentially consistent
+ * `int` indices wrapped with `%`), which is reproduced below as `LegacyRingBuffer`.
+ *
+ * throughput: one producer thread pushes `num_items` elements as fast as the consumer drains them.
+ * latency: two threads bounce a value back and forth through a pair of buffers; half the mean
+ * round trip time is reported as one-way latency.
+ */
+
+#include "common/ringbuffer.hpp"
+#include "common/time.hpp"
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdio>
+
+namespace {
+
+template <typename T, int N>
+class LegacyRingBuffer {
+public:
+  bool maybe_write(const T& element) noexcept {
+    if (full()) {
+      return false;
+    }
+    auto w = wp.load();
+    buffer[w] = element;
+    wp.store((w + 1) % N);
+    return true;
+  }
+
+  T read() noexcept {
+    auto r = rp.load();
+    T element = std::move(buffer[r]);
+    rp = (r + 1) % N;
+    return element;
+  }
+
+  int size() const noexcept {
+    int rp_value = rp % N;
+    int wp_value = wp % N;
+    return rp_value <= wp_value ? wp_value - rp_value : wp_value + (N - rp_value);
+  }
+
+  int num_free() const noexcept {
+    int rp_value = rp % N;
+    int wp_value = wp % N;
+    return rp_value <= wp_value ? N - (wp_value - rp_value) - 1 : rp_value - wp_value - 1;
+  }
+
+  bool full() const noexcept {
+    return num_free() == 0;
+  }
+
+private:
+  std::array<T, N> buffer{};
+  std::atomic<int> rp{0};
+  std::atomic<int> wp{0};
+};
+
+struct Config {
+  static constexpr int buffer_capacity = 1024;
+  static constexpr uint64_t num_items = 1ull << 22;
+  static constexpr int num_round_trips = 100000;
+  static constexpr int num_trials = 5;
+};
+
+template <typename Buffer>
+double measure_throughput() {
+  auto buff = std::make_unique<Buffer>();
+
+  auto t0 = om::now();
+  std::thread producer{[&]() {
+    for (uint64_t i = 0; i < Config::num_items; i++) {
+      while (!buff->maybe_write(i)) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+
+  uint64_t expect{};
+  while (expect < Config::num_items) {
+    const int n = buff->size();
+    if (n == 0) {
+      std::this_thread::yield();
+    }
+    for (int i = 0; i < n; i++) {
+      if (buff->read() != expect++) {
+        printf("Error: out of order element.\n");
+        std::terminate();
+      }
+    }
+  }
+
+  producer.join();
+  return double(Config::num_items) / om::elapsed_time(t0, om::now());
+}
+
+template <typename Buffer>
+double measure_one_way_latency() {
+  auto ping = std::make_unique<Buffer>();
+  auto pong = std::make_unique<Buffer>();
+
+  std::thread echo{[&]() {
+    for (int i = 0; i < Config::num_round_trips; i++) {
+      while (ping->size() == 0) {
+        std::this_thread::yield();
+      }
+      while (!pong->maybe_write(ping->read())) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+
+  auto t0 = om::now();
+  for (int i = 0; i < Config::num_round_trips; i++) {
+    while (!ping->maybe_write(uint64_t(i))) {
+      std::this_thread::yield();
+    }
+    while (pong->size() == 0) {
+      std::this_thread::yield();
+    }
+    (void) pong->read();
+  }
+  const double elapsed = om::elapsed_time(t0, om::now());
+
+  echo.join();
+  return elapsed / double(Config::num_round_trips) * 0.5;
+}
+
+template <typename Buffer>
+void run(const char* name) {
+  std::vector<double> throughput;
+  std::vector<double> latency;
+  for (int i = 0; i < Config::num_trials; i++) {
+    throughput.push_back(measure_throughput<Buffer>());
+    latency.push_back(measure_one_way_latency<Buffer>());
+  }
+
+  std::sort(throughput.begin(), throughput.end());
+  std::sort(latency.begin(), latency.end());
+  const int mid = Config::num_trials / 2;
+
+  printf("%-8s throughput: %8.2f M items/s (min %8.2f, max %8.2f)\n",
+         name, throughput[mid] * 1e-6, throughput.front() * 1e-6, throughput.back() * 1e-6);
+  printf("%-8s latency:    %8.1f ns one-way  (min %8.1f, max %8.1f)\n",
+         name, latency[mid] * 1e9, latency.front() * 1e9, latency.back() * 1e9);
+}
+
+} //  anon
+
+int main(int, char**) {
+  run<LegacyRingBuffer<uint64_t, Config::buffer_capacity>>("legacy");
+  run<om::RingBuffer<uint64_t, Config::buffer_capacity>>("current");
+  return 0;
+}
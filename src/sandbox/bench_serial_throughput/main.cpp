@@ -0,0 +1,166 @@
+/*
+ * Measures how fast a lever can be polled for its state at each baud rate. For each rate, the port
+ * is opened at the default rate and the lever is switched to the rate with the negotiation
+ * handshake, as the lever worker does. The lever is then polled with `s` for `duration_s`, one
+ * request at a time, spinning on the port so that the measurement adds as little as possible to
+ * each round trip. Reported are the achieved samples per second and the distribution of
+ * round-trip times.
+ *
+ * Usage: bench_serial_throughput <port> [seconds per rate]
+ */
+
+#include "common/latency_histogram.hpp"
+#include "common/line_buffer.hpp"
+#include "common/serial_lever.hpp"
+#include "common/serial_reactor.hpp"
+#include "common/time.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace {
+
+struct Config {
+  static constexpr uint32_t baud_rates[] = {9600, 19200, 57600, 115200, 230400, 500000, 1000000, 2000000};
+  static constexpr double default_duration_s = 5.0;
+  static constexpr double response_timeout_s = double(om::default_read_write_timeout()) * 1e-3;
+  static constexpr double baud_switch_delay_s = 20e-3;
+  static constexpr int buffer_capacity = 1024;
+};
+
+struct Connection {
+  om::SerialPort port;
+  om::LineBuffer<Config::buffer_capacity> received;
+};
+
+struct Result {
+  bool negotiated;
+  uint64_t num_samples;
+  uint64_t num_failed;
+  double elapsed_s;
+  om::LatencyHistogram round_trip;
+};
+
+//  Writes `command` and waits for the line that answers it. The view is valid until the next call.
+std::optional<std::string_view> transact(Connection* conn, const char* command, int size) {
+  if (om::write_nonblocking(&conn->port, command, size) != om::SerialWriteResult::Written) {
+    return std::nullopt;
+  }
+  const auto t0 = om::now();
+  while (om::elapsed_time(t0, om::now()) < Config::response_timeout_s) {
+    if (auto line = om::next_line(&conn->received)) {
+      return line;
+    }
+    auto [dst, capacity] = om::write_space(&conn->received);
+    const int num_read = om::read_nonblocking(&conn->port, dst, capacity);
+    if (num_read < 0) {
+      return std::nullopt;
+    } else if (num_read == 0) {
+      std::this_thread::yield();
+    } else {
+      om::commit_write(&conn->received, num_read);
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<uint32_t> request_baud_rate(Connection* conn, uint32_t baud) {
+  char command[om::max_lever_command_size()];
+  const int size = om::format_negotiate_baud_command(baud, command, int(sizeof(command)));
+  auto response = transact(conn, command, size);
+  return response ? om::parse_baud_rate(response.value()) : std::nullopt;
+}
+
+//  Offers `baud`, follows the lever to it, and confirms it at the new rate.
+bool negotiate(Connection* conn, uint32_t baud) {
+  if (baud == om::default_baud_rate()) {
+    return true;
+  }
+  auto accepted = request_baud_rate(conn, baud);
+  if (!accepted || accepted.value() != baud || !om::set_baud_rate(&conn->port, baud)) {
+    return false;
+  }
+  om::clear(&conn->received);
+  std::this_thread::sleep_for(om::Duration(Config::baud_switch_delay_s));
+  auto confirmed = request_baud_rate(conn, baud);
+  return confirmed && confirmed.value() == baud;
+}
+
+//  Stops the state stream and pull edge reports, which would interleave frames with the responses.
+void quiet(Connection* conn) {
+  char command[om::max_lever_command_size()];
+  int size = om::format_stream_state_command(0, command, int(sizeof(command)));
+  (void) transact(conn, command, size);
+  size = om::format_set_edge_thresholds_command({}, command, int(sizeof(command)));
+  (void) transact(conn, command, size);
+  om::clear(&conn->received);
+}
+
+Result run(const std::string& port, uint32_t baud, double duration_s) {
+  Result result{};
+  auto opened = om::open_serial_port(port, om::default_baud_rate());
+  if (!opened) {
+    return result;
+  }
+
+  Connection conn;
+  conn.port = std::move(opened.value());
+  quiet(&conn);
+  result.negotiated = negotiate(&conn, baud);
+
+  if (result.negotiated) {
+    const char* command = om::make_read_state_command();
+    const int size = int(std::strlen(command));
+    const auto t0 = om::now();
+    while (om::elapsed_time(t0, om::now()) < duration_s) {
+      const auto sent = om::now();
+      auto response = transact(&conn, command, size);
+      if (response && om::parse_lever_state(response.value())) {
+        om::record(&result.round_trip, om::elapsed_time(sent, om::now()));
+        result.num_samples++;
+      } else {
+        result.num_failed++;
+        om::clear(&conn.received);
+      }
+    }
+    result.elapsed_s = om::elapsed_time(t0, om::now());
+  }
+
+  //  Leave the lever at the default rate for the next run.
+  if (baud != om::default_baud_rate()) {
+    (void) request_baud_rate(&conn, om::default_baud_rate());
+  }
+  om::close_serial_port(&conn.port);
+  return result;
+}
+
+void print(uint32_t baud, const Result& result) {
+  if (!result.negotiated) {
+    printf("%8d baud: not supported\n", int(baud));
+    return;
+  }
+  auto& hist = result.round_trip;
+  const double rate = result.elapsed_s > 0.0 ? double(result.num_samples) / result.elapsed_s : 0.0;
+  printf("%8d baud: %7.1f samples/s | mean %6.2f ms | p50 %6.2f ms | p99 %6.2f ms | "
+         "max %6.2f ms | %d failed\n",
+         int(baud), rate, om::mean_s(hist) * 1e3, om::percentile_s(hist, 50.0) * 1e3,
+         om::percentile_s(hist, 99.0) * 1e3, double(hist.max_us) * 1e-3, int(result.num_failed));
+}
+
+} //  anon
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("Usage: %s <port> [seconds per rate]\n", argv[0]);
+    return 1;
+  }
+
+  const std::string port{argv[1]};
+  const double duration_s = argc > 2 ? std::atof(argv[2]) : Config::default_duration_s;
+  for (uint32_t baud : Config::baud_rates) {
+    print(baud, run(port, baud, duration_s));
+  }
+  return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Lookup benchmark for om::SlotMap against the containers it replaced: an
+ * std::unordered_map<uint32_t, T> keyed by handle id (render, audio) and a linear scan over a
+ * vector of instances (lever system). Each trial looks up `num_lookups` handles drawn at random
+ * from the live set and sums a field of the element, so that the lookup cannot be elided.
+ */
+
+#include "common/slot_map.hpp"
+#include "common/identifier.hpp"
+#include "common/time.hpp"
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include <cstdio>
+
+namespace {
+
+struct Config {
+  static constexpr int num_lookups = 1 << 22;
+  static constexpr int element_counts[4]{2, 16, 256, 4096};
+  static constexpr int max_num_linear_elements = 256;
+};
+
+struct Handle {
+  OM_INTEGER_IDENTIFIER_EQUALITY(Handle, id)
+  uint32_t id;
+};
+
+struct Element {
+  Handle handle;
+  uint64_t value;
+  char payload[48];
+};
+
+template <typename F>
+double measure(const std::vector<Handle>& queries, F&& lookup) {
+  uint64_t sum{};
+  auto t0 = om::now();
+  for (auto& query : queries) {
+    sum += lookup(query);
+  }
+  const double elapsed = om::elapsed_time(t0, om::now());
+  if (sum == 0) {
+    printf("Error: no elements found.\n");
+  }
+  return elapsed / double(queries.size()) * 1e9;
+}
+
+void run(int num_elements) {
+  om::SlotMap<Handle, Element> slot_map;
+  std::unordered_map<uint32_t, Element> hash_map;
+  std::vector<Element> linear;
+
+  //  Churn the slot map a little so that lookups see non-initial generations.
+  for (int i = 0; i < num_elements; i++) {
+    slot_map.erase(slot_map.insert(Element{}));
+  }
+
+  std::vector<Handle> handles;
+  for (int i = 0; i < num_elements; i++) {
+    Element element{};
+    element.value = uint64_t(i + 1);
+    element.handle = slot_map.insert(element);
+    slot_map.at(element.handle).handle = element.handle;
+    hash_map[element.handle.id] = element;
+    linear.push_back(element);
+    handles.push_back(element.handle);
+  }
+
+  std::mt19937 rng{7};
+  std::uniform_int_distribution<int> dist{0, num_elements - 1};
+  std::vector<Handle> queries(Config::num_lookups);
+  for (auto& query : queries) {
+    query = handles[dist(rng)];
+  }
+
+  const double slot_map_ns = measure(queries, [&](Handle handle) {
+    return slot_map.find(handle)->value;
+  });
+  const double hash_map_ns = measure(queries, [&](Handle handle) {
+    return hash_map.find(handle.id)->second.value;
+  });
+
+  printf("elements: %5d | slot_map: %6.2f ns | unordered_map: %6.2f ns",
+         num_elements, slot_map_ns, hash_map_ns);
+
+  if (num_elements <= Config::max_num_linear_elements) {
+    const double linear_ns = measure(queries, [&](Handle handle) -> uint64_t {
+      for (auto& element : linear) {
+        if (element.handle == handle) {
+          return element.value;
+        }
+      }
+      return 0;
+    });
+    printf(" | linear scan: %6.2f ns", linear_ns);
+  }
+  printf("\n");
+}
+
+} //  anon
+
+int main(int, char**) {
+  for (int num_elements : Config::element_counts) {
+    run(num_elements);
+  }
+  return 0;
+}
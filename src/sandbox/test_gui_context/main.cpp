@@ -25,6 +25,7 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <numeric>
 
 #include <stdio.h>
 
@@ -39,8 +40,8 @@ void task_update(App& app);
 void always_update(App& app);
 void setup(App& app);
 void shutdown(App& app);
-void do_update_automated_pull(App& app);
-void ensure_some_trial_records_are_stored(App& app);
+void do_update_automated_pull(App& app, int r);
+void ensure_some_trial_records_are_stored(App& app, int r);
 
 struct Config {
   static constexpr int ni_num_samples_per_channel = 1000;
@@ -89,6 +90,69 @@ struct LeverReadout {
 }; // under construction ... -WS
 
 
+struct PendingReward {
+  om::TimePoint deliver_time;
+  int trial_number;
+  om::TimePoint trial_start_time;
+  int pump_index;
+};
+
+// task state of one rig; its levers and pumps are those of the rig with the same index in App::rigs
+struct RigSession {
+  // file name
+  std::string lever1_animal{ "Ginger" };
+  std::string lever2_animal{ "Dodson" };
+
+  // float lever_position_limits[2]{25e3f, 33e3f};
+  // float lever_position_limits[4]{ 64.5e3f, 65e3f, 14e2f, 55e2f}; // lever 1 and lever 2 have different potentiometer ranges - WS 
+  // float lever_position_limits[4]{ 63.7e3f, 65.3e3f, 12e2f, 59e2f }; // lever 1 and lever 2 have different potentiometer ranges - WS 
+  // float lever_position_limits[4]{ 42.4e3f, 48.2e3f, 12.5e2f, 70e2f }; // lever 1 and lever 2 have different potentiometer ranges - WS 
+  std::vector<float> lever_position_limits{ 44.1e3f, 49.7e3f, 14.0e2f, 55e2f }; // two per lever; lever 1 and lever 2 have different potentiometer ranges - WS 
+  std::vector<bool> invert_lever_position{true, false};
+
+  // per-lever state, one entry per lever of the rig
+  std::vector<om::lever::PullDetect> detect_pull;
+  std::vector<bool> getreward;
+  std::vector<int> rewarded;
+  std::vector<bool> leverpulled;
+  std::vector<float> leverpulledtime;  //mostly for the cooperative condition (taskytype = 3)
+  std::vector<bool> automated_pulls_enabled;
+  std::vector<om::lever::AutomatedPull> automated_pulls;
+  std::vector<bool> need_trigger_automated_pulls;
+  std::vector<om::lever::PullSchedule> automated_pull_schedules;
+
+  // pull / release events from the rig's levers that have not been handled yet, in order of occurrence
+  std::vector<om::lever::PullEvent> pull_events;
+  // juice deliveries waiting for `juice_delay_time` to pass, in order of delivery
+  std::vector<PendingReward> pending_rewards;
+
+  // variables that are updated every trial
+  int trialnumber{ 0 };
+  int first_pull_id{ 0 };
+  om::TimePoint first_pull_time{}; 
+  double other_pull_time{}; // time gap bwtween two pulls
+
+  double timepoint{};
+  om::TimePoint trialstart_time;
+  double trial_start_time_forsave;
+  om::TimePoint session_start_time;
+  int behavior_event{}; // 0 - trial starts; 9 - trial ends; 1 - lever 1 is pulled; 2 - lever 2 is pulled; 3 - pump 1 delivery; 4 - pump 2 delivery; etc
+
+  // task state machine
+  int state{};
+  bool entry{true};
+  om::NewTrialState new_trial{};
+  om::DelayState delay{};
+  om::InnerDelayState innerdelay{};
+  bool start_session_sound{true};
+
+  // struct for saving data
+  std::vector<TrialRecord> trial_records;
+  std::vector<BehaviorData> behavior_data;
+  std::vector<SessionInfo> session_info;
+  std::vector<LeverReadout> lever_readout; // under construction
+};
+
 struct App : public om::App {
   ~App() override = default;
   void setup() override {
@@ -110,9 +174,10 @@ struct App : public om::App {
   // Variable initiation
   // Some of these variable can be changed accordingly for each session. - Weikang
 
-  // file name
-  std::string lever1_animal{ "Ginger" };
-  std::string lever2_animal{ "Dodson" };
+  // one session per rig in `rig_descriptors`; sessions not given here are added in setup
+  std::vector<RigSession> sessions{RigSession{}};
+  // the rig whose settings are shown in the GUI
+  int gui_rig_index{};
 
   std::string experiment_date{ "20231205" };
 
@@ -135,13 +200,6 @@ struct App : public om::App {
   bool allow_automated_juice_delivery{false};
 
   int lever_force_limits[2]{-550, 550};
-  om::lever::PullDetect detect_pull[2]{};
-  // float lever_position_limits[2]{25e3f, 33e3f};
-  // float lever_position_limits[4]{ 64.5e3f, 65e3f, 14e2f, 55e2f}; // lever 1 and lever 2 have different potentiometer ranges - WS 
-  // float lever_position_limits[4]{ 63.7e3f, 65.3e3f, 12e2f, 59e2f }; // lever 1 and lever 2 have different potentiometer ranges - WS 
-  // float lever_position_limits[4]{ 42.4e3f, 48.2e3f, 12.5e2f, 70e2f }; // lever 1 and lever 2 have different potentiometer ranges - WS 
-  float lever_position_limits[4]{ 44.1e3f, 49.7e3f, 14.0e2f, 55e2f }; // lever 1 and lever 2 have different potentiometer ranges - WS 
-  bool invert_lever_position[2]{true, false};
   
   //float new_delay_time{2.0f};
   double new_delay_time{om::urand()*4+3}; //random delay between 3 to 5 s (in unit of second)
@@ -152,30 +210,11 @@ struct App : public om::App {
   // float new_total_time{ 15.0f }; // the time for the maximal trial time - only used for mutual cooperation condition (task type == 3)
   int total_trial_number{ 500 }; // the maximal trial number of a session
 
-  // variables that are updated every trial
-  int trialnumber{ 0 };
-  int first_pull_id{ 0 };
-  bool getreward[2]{false, false};
-  int rewarded[2]{0, 0};
-  om::TimePoint first_pull_time{}; 
-  double other_pull_time{}; // time gap bwtween two pulls
+  om::TimePoint lever_recording_t0;
 
-  double timepoint{};
-  om::TimePoint trialstart_time;
-  double trial_start_time_forsave;
-  om::TimePoint session_start_time;
-  int behavior_event{}; // 0 - trial starts; 9 - trial ends; 1 - lever 1 is pulled; 2 - lever 2 is pulled; 3 - pump 1 delivery; 4 - pump 2 delivery; etc
-
-
-  bool leverpulled[2]{ false, false };
-  float leverpulledtime[2]{ 0,0 };  //mostly for the cooperative condition (taskytype = 3)
   float pulledtime_thres{ 1.0f }; // time difference that two animals has to pull the lever 
 
-  bool automated_pulls_enabled[2]{};
-  om::lever::AutomatedPull automated_pulls[2]{};
   om::lever::AutomatedPullParams automated_pull_params{};
-  bool need_trigger_automated_pulls[2]{};
-  om::lever::PullSchedule automated_pull_schedules[2]{};
 
   om::led::LEDSync led_sync;
   om::gui::NIGUIData ni_gui_data{};
@@ -189,6 +228,7 @@ struct App : public om::App {
   std::optional<om::audio::BufferHandle> failed_pull_audio_buffer;
 
   // initiate stimuli if using colored squares
+  // offsets and sizes are within each rig's stimulus region (the whole window for a single rig)
   om::Vec2f stim0_size{ 0.2f };
   om::Vec2f stim0_offset{ -0.4f, 0.25f };
   om::Vec3f stim0_color{ 1.0f };
@@ -208,11 +248,7 @@ struct App : public om::App {
   // std::ofstream save_trial_data_file;
   
   bool dont_save_data{};
-  std::vector<TrialRecord> trial_records;
-  std::vector<BehaviorData> behavior_data;
-  std::vector<SessionInfo> session_info;
-  std::vector<LeverReadout> lever_readout; // under construction
-  std::vector<double> manual_reward_times;
+  std::vector<om::TimePoint> manual_reward_times; // saved relative to the start of each rig's session
 
 };
 
@@ -262,9 +298,51 @@ json to_json(const om::ni::TriggerTimePoint& tp) {
   return result;
 }
 
-json get_supp_data(const std::vector<double>& manual_reward_ts) {
+//  Summary statistics, plus the non-empty histogram buckets as [lower bound us, count] pairs.
+json to_json(const om::LatencyHistogram& hist) {
+  json result;
+  result["count"] = hist.total_count;
+  result["mean"] = om::mean_s(hist);
+  result["p50"] = om::percentile_s(hist, 50.0);
+  result["p90"] = om::percentile_s(hist, 90.0);
+  result["p99"] = om::percentile_s(hist, 99.0);
+  result["max"] = double(hist.max_us) * 1e-6;
+  json buckets = json::array();
+  for (int i = 0; i < om::LatencyHistogram::num_buckets; i++) {
+    if (hist.counts[i] > 0) {
+      buckets.push_back({om::detail::latency_bucket_lower_bound(i), hist.counts[i]});
+    }
+  }
+  result["buckets_us"] = buckets;
+  return result;
+}
+
+json to_json(const om::lever::CommandLatencyStats& stats) {
+  json result;
+  for (int i = 0; i < om::lever::num_device_command_types(); i++) {
+    auto hist = to_json(stats.round_trip[i]);
+    hist["num_failed"] = stats.num_failed[i];
+    result[om::lever::to_string(om::lever::DeviceCommandType(i))] = hist;
+  }
+  return result;
+}
+
+json get_supp_data(const std::vector<double>& manual_reward_ts,
+                   om::TimePoint lever_recording_t0, om::TimePoint session_t0,
+                   int first_lever_index,
+                   const std::vector<om::lever::CommandLatencyStats>& lever_latencies) {
   json result;
   result["manual_reward_times"] = manual_reward_ts;
+  //  Add to the times in the lever trajectory file to make them relative to the session start.
+  result["lever_recording_t0_offset"] = om::elapsed_time(session_t0, lever_recording_t0);
+  //  Index of this session's first lever in the lever trajectory file; the others follow in order.
+  result["first_lever_index"] = first_lever_index;
+  //  Round-trip times of the commands sent to each lever, in seconds.
+  json latencies = json::array();
+  for (auto& stats : lever_latencies) {
+    latencies.push_back(to_json(stats));
+  }
+  result["lever_command_latency"] = latencies;
   return result;
 }
 
@@ -348,6 +426,51 @@ json to_json(const std::vector<LeverReadout>& lever_reads) {
 
 
 
+// file names start with the date and the animals of the session, and the rig when there are several
+std::string session_file_prefix(const App& app, int r) {
+  const auto& s = app.sessions[r];
+  auto prefix = app.experiment_date + "_" + s.lever1_animal + "_" + s.lever2_animal;
+  if (app.rigs.size() > 1) {
+    prefix += "_" + app.rigs[r].name;
+  }
+  return prefix;
+}
+
+void setup_session(App& app, int r) {
+  auto& s = app.sessions[r];
+  const auto& rig = app.rigs[r];
+  // the task pairs the two levers (and the two pumps) of each rig
+  assert(rig.levers.size() == 2 && rig.pumps.size() >= 2);
+
+  const int num_levers = int(rig.levers.size());
+  s.lever_position_limits.resize(2 * num_levers);
+  s.invert_lever_position.resize(num_levers);
+  s.detect_pull.resize(num_levers);
+  s.getreward.resize(num_levers);
+  s.rewarded.resize(num_levers);
+  s.leverpulled.resize(num_levers);
+  s.leverpulledtime.resize(num_levers);
+  s.automated_pulls_enabled.resize(num_levers);
+  s.automated_pulls.resize(num_levers);
+  s.need_trigger_automated_pulls.resize(num_levers);
+  s.automated_pull_schedules.resize(num_levers);
+
+  // define the threshold of pulling
+  const float dflt_rising_edge = 0.475f;  // 0.6f
+  const float dflt_falling_edge = 0.2f; // 0.25f
+  for (auto& detect : s.detect_pull) {
+    detect.rising_edge = dflt_rising_edge;
+    detect.falling_edge = dflt_falling_edge;
+  }
+
+  // initialize lever force
+  if (app.allow_auto_lever_force_set) {
+    for (auto& lever : rig.levers) {
+      om::lever::set_force(om::lever::get_global_lever_system(), lever, app.normalforce);
+    }
+  }
+}
+
 void setup(App& app) {
   om::led::initialize(&app.led_sync, om::ni::read_time0(), Config::led_channel_index);
   
@@ -383,78 +506,98 @@ void setup(App& app) {
   auto buff_p2 = std::string{ OM_RES_DIR } + "/sounds/failed_beep.wav";
   app.failed_pull_audio_buffer = om::audio::read_buffer(buff_p2.c_str());
 
-  // define the threshold of pulling
-  const float dflt_rising_edge = 0.475f;  // 0.6f
-  const float dflt_falling_edge = 0.2f; // 0.25f
-  app.detect_pull[0].rising_edge = dflt_rising_edge;
-  app.detect_pull[1].rising_edge = dflt_rising_edge;
-  app.detect_pull[0].falling_edge = dflt_falling_edge;
-  app.detect_pull[1].falling_edge = dflt_falling_edge;
+  app.sessions.resize(app.rigs.size());
+  for (int r = 0; r < int(app.rigs.size()); r++) {
+    setup_session(app, r);
+  }
 
-  // initialize lever force
-  if (app.allow_auto_lever_force_set) {
-    om::lever::set_force(om::lever::get_global_lever_system(), app.levers[0], app.normalforce);
-    om::lever::set_force(om::lever::get_global_lever_system(), app.levers[1], app.normalforce);
+  // record every lever sample of every rig for the whole session, in one file
+  app.lever_recording_t0 = om::now();
+  std::string lever_trajectory_name = app.experiment_date;
+  for (auto& s : app.sessions) {
+    lever_trajectory_name += "_" + s.lever1_animal + "_" + s.lever2_animal;
   }
+  lever_trajectory_name += "_lever_trajectory_" + om::date_string() + ".bin";
+  om::lever::start_recording(om::lever::get_global_lever_system(), std::string{ OM_DATA_DIR } + "/" + lever_trajectory_name, app.lever_recording_t0);
 
  
 }
 
-void shutdown(App& app) {
-  ensure_some_trial_records_are_stored(app);
+void save_session_data(App& app, int r) {
+  auto& s = app.sessions[r];
+  const auto& rig = app.rigs[r];
+  ensure_some_trial_records_are_stored(app, r);
 
 #if 0
-  std::string trialrecords_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_TrialRecord_1.json";
-  std::string bhvdata_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_bhv_data_1.json";
-  std::string sessioninfo_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_session_info_1.json";
-  std::string leverread_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_lever_reading_1.json";
+  std::string trialrecords_name = app.experiment_date + "_" + s.lever1_animal + "_" + s.lever2_animal + "_TrialRecord_1.json";
+  std::string bhvdata_name = app.experiment_date + "_" + s.lever1_animal + "_" + s.lever2_animal + "_bhv_data_1.json";
+  std::string sessioninfo_name = app.experiment_date + "_" + s.lever1_animal + "_" + s.lever2_animal + "_session_info_1.json";
+  std::string leverread_name = app.experiment_date + "_" + s.lever1_animal + "_" + s.lever2_animal + "_lever_reading_1.json";
 #else
   auto postfix = om::date_string();
-  std::string trialrecords_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_TrialRecord_" + postfix + ".json";
-  std::string bhvdata_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_bhv_data_" + postfix + ".json";
-  std::string sessioninfo_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_session_info_" + postfix + ".json";
-  std::string leverread_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_lever_reading_" + postfix + ".json";
-  std::string ni_data_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_ni_data_" + postfix + ".json";
-  std::string supp_data_name = app.experiment_date + "_" + app.lever1_animal + "_" + app.lever2_animal + "_supp_data_" + postfix + ".json";
+  auto prefix = session_file_prefix(app, r);
+  std::string trialrecords_name = prefix + "_TrialRecord_" + postfix + ".json";
+  std::string bhvdata_name = prefix + "_bhv_data_" + postfix + ".json";
+  std::string sessioninfo_name = prefix + "_session_info_" + postfix + ".json";
+  std::string leverread_name = prefix + "_lever_reading_" + postfix + ".json";
+  std::string ni_data_name = prefix + "_ni_data_" + postfix + ".json";
+  std::string supp_data_name = prefix + "_supp_data_" + postfix + ".json";
 #endif
 
   if (!app.dont_save_data) {
     std::string file_path1 = std::string{ OM_DATA_DIR } + "/" + trialrecords_name;
     std::ofstream output_file1(file_path1);
-    output_file1 << to_json(app.trial_records);
+    output_file1 << to_json(s.trial_records);
 
     std::string file_path2 = std::string{ OM_DATA_DIR } + "/" + bhvdata_name;
     std::ofstream output_file2(file_path2);
-    output_file2 << to_json(app.behavior_data);
+    output_file2 << to_json(s.behavior_data);
 
     // save some task information into session_info
     SessionInfo session_info{};
-    session_info.lever1_animal = app.lever1_animal;
-    session_info.lever2_animal = app.lever2_animal;
+    session_info.lever1_animal = s.lever1_animal;
+    session_info.lever2_animal = s.lever2_animal;
     session_info.high_force = app.releaseforce;
     session_info.init_force = app.normalforce;
     session_info.experiment_date = app.experiment_date;
     session_info.task_type = app.tasktype;
     session_info.pulltime_thres = app.pulledtime_thres;
-    app.session_info.push_back(session_info);
+    s.session_info.push_back(session_info);
 
     std::string file_path3 = std::string{ OM_DATA_DIR } + "/" + sessioninfo_name;
     std::ofstream output_file3(file_path3);
-    output_file3 << to_json(app.session_info);
+    output_file3 << to_json(s.session_info);
 
     std::string file_path4 = std::string{ OM_DATA_DIR } + "/" + leverread_name;
     std::ofstream output_file4(file_path4);
-    output_file4 << to_json(app.lever_readout);
+    output_file4 << to_json(s.lever_readout);
 
     //  ni session data
     std::string ni_session_data_file_path = std::string{ OM_DATA_DIR } + "/" + ni_data_name;
     std::ofstream ni_output_file(ni_session_data_file_path);
-    ni_output_file << get_ni_json_data(&app.led_sync, app.session_start_time);
+    ni_output_file << get_ni_json_data(&app.led_sync, s.session_start_time);
 
     //  supplementary data
     std::string supp_data_fp = std::string{ OM_DATA_DIR } + "/" + supp_data_name;
     std::ofstream supp_file(supp_data_fp);
-    supp_file << get_supp_data(app.manual_reward_times);
+    std::vector<om::lever::CommandLatencyStats> lever_latencies;
+    for (auto& lever : rig.levers) {
+      lever_latencies.push_back(
+        om::lever::get_command_latency_stats(om::lever::get_global_lever_system(), lever));
+    }
+    std::vector<double> manual_reward_times;
+    for (auto& t : app.manual_reward_times) {
+      manual_reward_times.push_back(om::elapsed_time(s.session_start_time, t));
+    }
+    supp_file << get_supp_data(manual_reward_times, app.lever_recording_t0,
+                               s.session_start_time, rig.first_lever_index, lever_latencies);
+  }
+}
+
+void shutdown(App& app) {
+  om::lever::stop_recording(om::lever::get_global_lever_system());
+  for (int r = 0; r < int(app.rigs.size()); r++) {
+    save_session_data(app, r);
   }
 }
 
@@ -463,8 +606,9 @@ void render_lever_gui(App& app) {
   om::gui::LeverGUIParams gui_params{};
   gui_params.force_limit0 = app.lever_force_limits[0];
   gui_params.force_limit1 = app.lever_force_limits[1];
-  gui_params.serial_ports = app.ports.data();
-  gui_params.num_serial_ports = int(app.ports.size());
+  const auto& ports = om::lever::get_serial_ports(om::lever::get_global_lever_system());
+  gui_params.serial_ports = ports.data();
+  gui_params.num_serial_ports = int(ports.size());
   gui_params.num_levers = int(app.levers.size());
   gui_params.levers = app.levers.data();
   gui_params.lever_system = om::lever::get_global_lever_system();
@@ -480,9 +624,10 @@ void render_lever_gui(App& app) {
 
 void render_juice_pump_gui(App& app) {
   om::gui::JuicePumpGUIParams gui_params{};
-  gui_params.serial_ports = app.ports.data();
-  gui_params.num_ports = int(app.ports.size());
-  gui_params.num_pumps = 2;
+  const auto& ports = om::lever::get_serial_ports(om::lever::get_global_lever_system());
+  gui_params.serial_ports = ports.data();
+  gui_params.num_ports = int(ports.size());
+  gui_params.num_pumps = om::total_num_pumps(app.rig_descriptors);
   gui_params.allow_automated_run = app.allow_automated_juice_delivery;
   auto res = om::gui::render_juice_pump_gui(gui_params);
 
@@ -491,7 +636,7 @@ void render_juice_pump_gui(App& app) {
   }
 
   if (res.reward_triggered) {
-    app.manual_reward_times.push_back(om::elapsed_time(app.session_start_time, om::now()));
+    app.manual_reward_times.push_back(om::now());
   }
 }
 
@@ -515,7 +660,7 @@ void render_gui(App& app) {
 
   ImGui::Begin("GUI");
   if (ImGui::Button("Refresh ports")) {
-    app.ports = om::enumerate_ports();
+    om::lever::rescan_serial_ports(om::lever::get_global_lever_system());
   }
 
   if (ImGui::Button("start the trial")) {
@@ -531,9 +676,27 @@ void render_gui(App& app) {
     app.dont_save_data = !save_data;
   }
 
-  ImGui::Checkbox("EnableAutomatedLever0", &app.automated_pulls_enabled[0]);
-  ImGui::SameLine();
-  ImGui::Checkbox("EnableAutomatedLever1", &app.automated_pulls_enabled[1]);
+  // settings below are those of one rig
+  if (app.rigs.size() > 1) {
+    const int max_rig_index = int(app.rigs.size()) - 1;
+    ImGui::SliderInt("Rig", &app.gui_rig_index, 0, max_rig_index);
+    app.gui_rig_index = std::max(0, std::min(app.gui_rig_index, max_rig_index));
+    ImGui::Text("%s: %s and %s", app.rigs[app.gui_rig_index].name.c_str(),
+                app.sessions[app.gui_rig_index].lever1_animal.c_str(),
+                app.sessions[app.gui_rig_index].lever2_animal.c_str());
+  }
+  auto& s = app.sessions[app.gui_rig_index];
+
+  for (int i = 0; i < int(s.automated_pulls_enabled.size()); i++) {
+    bool enabled = s.automated_pulls_enabled[i];
+    if (i > 0) {
+      ImGui::SameLine();
+    }
+    auto label = "EnableAutomatedLever" + std::to_string(i);
+    if (ImGui::Checkbox(label.c_str(), &enabled)) {
+      s.automated_pulls_enabled[i] = enabled;
+    }
+  }
 
 
   //if (auto m1_name = render_text_input_field("Lever1Animal")) {
@@ -561,17 +724,22 @@ void render_gui(App& app) {
 
   if (ImGui::TreeNode("PullDetect")) {
     //ImGui::InputFloat2("PositionLimits", app.lever_position_limits);
-    float lever_position_limits0[2]{app.lever_position_limits[0],app.lever_position_limits[1]};
-    float lever_position_limits1[2]{app.lever_position_limits[2],app.lever_position_limits[3]};
-    ImGui::InputFloat2("PositionLimits0", lever_position_limits0);
-    ImGui::InputFloat2("PositionLimits1", lever_position_limits1);
+    for (int i = 0; i < int(s.detect_pull.size()); i++) {
+      float lever_position_limits[2]{s.lever_position_limits[2 * i],s.lever_position_limits[2 * i + 1]};
+      auto label = "PositionLimits" + std::to_string(i);
+      ImGui::InputFloat2(label.c_str(), lever_position_limits);
+    }
 
-    auto& detect = app.detect_pull;
+    auto& detect = s.detect_pull;
     if (ImGui::InputFloat("RisingEdge", &detect[0].rising_edge, 0.0f, 0.0f, "%0.3f", enter_flag)) {
-      detect[1].rising_edge = detect[0].rising_edge;
+      for (int i = 1; i < int(detect.size()); i++) {
+        detect[i].rising_edge = detect[0].rising_edge;
+      }
     }
     if (ImGui::InputFloat("FallingEdge", &detect[0].falling_edge, 0.0f, 0.0f, "%0.3f", enter_flag)) {
-      detect[1].falling_edge = detect[1].rising_edge;
+      for (int i = 1; i < int(detect.size()); i++) {
+        detect[i].falling_edge = detect[0].falling_edge;
+      }
     }
 
     ImGui::TreePop();
@@ -579,19 +747,22 @@ void render_gui(App& app) {
 
 
   if (ImGui::TreeNode("AutomatedPull")) {
-    if (ImGui::Button("Trigger0")) {
-      app.need_trigger_automated_pulls[0] = true;
-    }
-    if (ImGui::Button("Trigger1")) {
-      app.need_trigger_automated_pulls[1] = true;
+    for (int i = 0; i < int(s.need_trigger_automated_pulls.size()); i++) {
+      auto label = "Trigger" + std::to_string(i);
+      if (ImGui::Button(label.c_str())) {
+        s.need_trigger_automated_pulls[i] = true;
+      }
     }
 
     auto render_auto_pull_lever_params = [&](int i) {
-      auto* p = &app.automated_pull_schedules[i];
+      auto* p = &s.automated_pull_schedules[i];
       auto exp_random_mu = float(p->exp_random_interval_mu);
       auto epoch_time = float(p->epoch_time);
+      bool enabled = s.automated_pulls_enabled[i];
 
-      ImGui::Checkbox("Enabled", &app.automated_pulls_enabled[i]);
+      if (ImGui::Checkbox("Enabled", &enabled)) {
+        s.automated_pulls_enabled[i] = enabled;
+      }
       ImGui::SliderFloat("MinInveral", &p->min_interval, 0.0f, 100.0f);
       ImGui::SliderFloat("MaxInterval", &p->max_interval, 0.0f, 100.0f);
       ImGui::SliderFloat("ExpRandomIntervalMean", &exp_random_mu, 0.0f, 100.0f);
@@ -603,15 +774,14 @@ void render_gui(App& app) {
 
     auto& common_p = app.automated_pull_params;
     ImGui::SliderFloat("HighTargetForceGrams", &common_p.force_target_high, 0.0f, 500.0f);
+    ImGui::Checkbox("RunOnDevice", &common_p.run_on_device);
 
-    if (ImGui::TreeNode("Lever0")) {
-      render_auto_pull_lever_params(0);
-      ImGui::TreePop();
-    }
-
-    if (ImGui::TreeNode("Lever1")) {
-      render_auto_pull_lever_params(1);
-      ImGui::TreePop();
+    for (int i = 0; i < int(s.automated_pull_schedules.size()); i++) {
+      auto label = "Lever" + std::to_string(i);
+      if (ImGui::TreeNode(label.c_str())) {
+        render_auto_pull_lever_params(i);
+        ImGui::TreePop();
+      }
     }
 
     ImGui::TreePop();
@@ -640,72 +810,130 @@ void render_gui(App& app) {
 }
 
 
-float to_normalized(float v, float min, float max, bool inv) {
-  if (min == max) {
-    v = 0.0f;
-  } else {
-    v = om::clamp(v, min, max);
-    v = (v - min) / (max - min);
-  }
-  return inv ? 1.0f - v : v;
+om::lever::PullDetectConfig make_pull_detect_config(const App& app, const RigSession& s, int i) {
+  om::lever::PullDetectConfig config{};
+  config.enabled = true;
+  config.position_min = s.lever_position_limits[2 * i];
+  config.position_max = s.lever_position_limits[2 * i + 1];
+  config.invert_position = s.invert_lever_position[i];
+  config.rising_edge = s.detect_pull[i].rising_edge;
+  config.falling_edge = s.detect_pull[i].falling_edge;
+  return config;
 }
 
-
-float get_normalized_lever_position(const App& app, const om::LeverState& lever_state, int i) {
-  return to_normalized(
-    lever_state.potentiometer_reading,
-    app.lever_position_limits[2 * i],
-    app.lever_position_limits[2 * i + 1],
-    app.invert_lever_position[i]);
+void gather_pull_events(App& app, int r) {
+  auto& s = app.sessions[r];
+  const auto& rig = app.rigs[r];
+  auto* lever_sys = om::lever::get_global_lever_system();
+  om::lever::PullEvent events[64];
+  for (int i = 0; i < int(rig.levers.size()); i++) {
+    om::lever::set_pull_detect_config(lever_sys, rig.levers[i], make_pull_detect_config(app, s, i));
+    int num_read{};
+    while ((num_read = om::lever::read_pull_events(lever_sys, rig.levers[i], events, 64)) > 0) {
+      s.pull_events.insert(s.pull_events.end(), events, events + num_read);
+    }
+  }
+  std::stable_sort(s.pull_events.begin(), s.pull_events.end(), [](const auto& a, const auto& b) {
+    return a.time < b.time;
+  });
 }
 
-void do_update_automated_pull(App& app) {
-  for (int i = 0; i < 2; i++) {
-    if (app.need_trigger_automated_pulls[i] &&
-        app.automated_pulls[i].state == om::lever::AutomatedPull::State::Idle) {
+void do_update_automated_pull(App& app, int r) {
+  auto& s = app.sessions[r];
+  const auto& rig = app.rigs[r];
+  for (int i = 0; i < int(rig.levers.size()); i++) {
+    if (s.need_trigger_automated_pulls[i] &&
+        s.automated_pulls[i].state == om::lever::AutomatedPull::State::Idle) {
       //
-      om::lever::start_automated_pull(&app.automated_pulls[i], app.normalforce);
-      app.need_trigger_automated_pulls[i] = false;
+      om::lever::start_automated_pull(&s.automated_pulls[i], app.normalforce);
+      s.need_trigger_automated_pulls[i] = false;
     }
   }
 
   auto* lever_sys = om::lever::get_global_lever_system();
 
-  for (int i = 0; i < 2; i++) {
-    auto res = om::lever::update_automated_pull(&app.automated_pulls[i], app.automated_pull_params);
+  for (int i = 0; i < int(rig.levers.size()); i++) {
+    auto& pull = s.automated_pulls[i];
+    if (pull.state == om::lever::AutomatedPull::State::DeviceProfile) {
+      auto status = om::lever::get_force_profile_status(lever_sys, rig.levers[i]);
+      if (status == om::lever::ForceProfileStatus::Completed) {
+        om::lever::finish_automated_pull_profile(&pull);
+      } else if (status == om::lever::ForceProfileStatus::Failed) {
+        om::lever::fall_back_from_automated_pull_profile(&pull);
+      }
+    }
+
+    auto res = om::lever::update_automated_pull(&pull, app.automated_pull_params);
+    if (res.run_profile) {
+      om::lever::run_force_profile(lever_sys, rig.levers[i], res.run_profile.value());
+    }
+
     if (res.set_direction) {
       auto dir = res.set_direction.value() ?
         om::SerialLeverDirection::Forward : om::SerialLeverDirection::Reverse;
-      om::lever::set_direction(lever_sys, app.levers[i], dir);
+      om::lever::set_direction(lever_sys, rig.levers[i], dir);
     }
 
     if (res.set_force) {
-      om::lever::set_force(lever_sys, app.levers[i], res.set_force.value());
+      om::lever::set_force(lever_sys, rig.levers[i], res.set_force.value());
     }
   }
 }
 
 
-void always_update_automated_pull(App& app) {
-  for (int i = 0; i < 2; i++) {
-    auto pull_sched_res = om::lever::update_pull_schedule(&app.automated_pull_schedules[i]);
-    if (pull_sched_res.do_pull && app.automated_pulls_enabled[i]) {
-      app.need_trigger_automated_pulls[i] = true;
+void always_update_automated_pull(App& app, int r) {
+  auto& s = app.sessions[r];
+  for (int i = 0; i < int(s.automated_pull_schedules.size()); i++) {
+    auto pull_sched_res = om::lever::update_pull_schedule(&s.automated_pull_schedules[i]);
+    if (pull_sched_res.do_pull && s.automated_pulls_enabled[i]) {
+      s.need_trigger_automated_pulls[i] = true;
     }
   }
 
-  do_update_automated_pull(app);
+  do_update_automated_pull(app, r);
 }
 
-int get_automated_lever_enabled_index(const App& app) {
-  for (int i = 0; i < 2; i++) {
-    if (app.automated_pulls_enabled[i]) {
+int get_automated_lever_enabled_index(const RigSession& s) {
+  for (int i = 0; i < int(s.automated_pulls_enabled.size()); i++) {
+    if (s.automated_pulls_enabled[i]) {
       return i + 1;
     }
   }
   return 0;
 }
 
+// juice is delivered `juice_delay_time` after the pull that earned it; the delivery is recorded when
+// the pump is run. Deliveries are queued rather than waited for so that the other rigs keep running.
+void schedule_reward(App& app, RigSession& s, int pump_index) {
+  PendingReward reward{};
+  reward.deliver_time = om::now() + std::chrono::milliseconds(app.juice_delay_time);
+  reward.trial_number = s.trialnumber;
+  reward.trial_start_time = s.trialstart_time;
+  reward.pump_index = pump_index;
+  s.pending_rewards.push_back(reward);
+}
+
+void deliver_pending_rewards(App& app, int r) {
+  auto& s = app.sessions[r];
+  const auto& rig = app.rigs[r];
+  const auto t = om::now();
+  int num_delivered{};
+  for (; num_delivered < int(s.pending_rewards.size()); num_delivered++) {
+    const auto& reward = s.pending_rewards[num_delivered];
+    if (reward.deliver_time > t) {
+      break;
+    }
+    om::pump::run_dispense_program(rig.pumps[reward.pump_index]);
+    //
+    BehaviorData time_stamps{};
+    time_stamps.trial_number = reward.trial_number;
+    time_stamps.time_points = om::elapsed_time(reward.trial_start_time, t);
+    time_stamps.behavior_events = reward.pump_index + 3; // pump 1 or 2 deliver
+    s.behavior_data.push_back(time_stamps);
+  }
+  s.pending_rewards.erase(s.pending_rewards.begin(), s.pending_rewards.begin() + num_delivered);
+}
+
 void always_update(App& app) {
   om::ni::update_ni();
   app.num_ni_sample_buffers = om::ni::read_sample_buffers(&app.ni_sample_buffers);
@@ -713,17 +941,15 @@ void always_update(App& app) {
   // om::led::update(&app.led_sync);
 }
 
-void task_update(App& app) {
+void task_update_rig(App& app, int r) {
   using namespace om;
 
-  static int state{};
-  static bool entry{true};
-  static NewTrialState new_trial{};
-  static DelayState delay{};
-  static InnerDelayState innerdelay{};
-  static bool start_session_sound{true};
-
-  om::led::update(&app.led_sync);
+  auto& s = app.sessions[r];
+  const auto& rig = app.rigs[r];
+  auto& state = s.state;
+  auto& entry = s.entry;
+  auto& new_trial = s.new_trial;
+  auto& start_session_sound = s.start_session_sound;
 
   //
   // renew for every new trial
@@ -734,327 +960,290 @@ void task_update(App& app) {
     // app.tasktype = rand()%2; // indicate the task type and different cue color (maybe beep sounds too): 0 no reward; 1 - self; 2 - altruistic (not built yet); 3 - cooperative (not built yet); 4  - for training (one reward for each animal in the cue on period)
     // app.tasktype = rand()%4; // indicate the task type and different cue color (maybe beep sounds too): 0 no reward; 1 - self; 2 - altruistic (not built yet); 3 - cooperative (not built yet); 4  - for training (one reward for each animal in the cue on period)
     //
-    app.rewarded[0] = 0;
-    app.rewarded[1] = 0;
-    app.leverpulled[0] = false;
-    app.leverpulled[1] = false;
-    app.leverpulledtime[0] = 0;
-    app.leverpulledtime[1] = 0;
+    std::fill(s.rewarded.begin(), s.rewarded.end(), 0);
+    std::fill(s.leverpulled.begin(), s.leverpulled.end(), false);
+    std::fill(s.leverpulledtime.begin(), s.leverpulledtime.end(), 0.0f);
 
     // sound to indicate the start of a session
-    if (app.trialnumber == 0 && start_session_sound) {
+    if (s.trialnumber == 0 && start_session_sound) {
       om::audio::play_buffer_both(app.start_trial_audio_buffer.value(), 0.5f);
-      app.session_start_time = now();
+      s.session_start_time = now();
       start_session_sound = false;
 
     }
 
     // end session when trialnumber or total sesison time reach the threshold
-    //if (app.trialnumber > app.total_trial_number || elapsed_time(app.session_start_time, now()) > app.new_total_time) {
+    //if (s.trialnumber > app.total_trial_number || elapsed_time(s.session_start_time, now()) > app.new_total_time) {
     //  abort;
     //}
 
     // push the lever force back to normal
     if (app.allow_auto_lever_force_set) {
-      om::lever::set_force(om::lever::get_global_lever_system(), app.levers[0], app.normalforce);
-      om::lever::set_force(om::lever::get_global_lever_system(), app.levers[1], app.normalforce);
+      for (auto& lever : rig.levers) {
+        om::lever::set_force(om::lever::get_global_lever_system(), lever, app.normalforce);
+      }
     }
   }
 
-  always_update_automated_pull(app);
+  always_update_automated_pull(app, r);
+  deliver_pending_rewards(app, r);
 
   // check the levers
-  for (int i = 0; i < 2; i++) {
-    const auto lh = app.levers[i];
-    auto& pd = app.detect_pull[i];
-    if (auto lever_state = om::lever::get_state(om::lever::get_global_lever_system(), lh)) {
-      om::lever::PullDetectParams params{};
-      params.current_position = get_normalized_lever_position(app, lever_state.value(), i);
-      auto pull_res = om::lever::detect_pull(&pd, params);
-      // if (pull_res.pulled_lever && app.tasktype != 0) {
-      // if (pull_res.pulled_lever && app.sucessful_pull_audio_buffer && state == 0) { // only pull during the trial, not the ITI (state == 1)  -WS
-      if (pull_res.pulled_lever && app.sucessful_pull_audio_buffer) {
-
-        if (app.tasktype != 3) {
-          om::audio::play_buffer_on_channel(app.sucessful_pull_audio_buffer.value(), abs(i-1), 0.5f);
+  // pull / release events are detected on every lever sample by the lever system; handle them in
+  // the order they occurred. Events after a `break` are left for the next update.
+  gather_pull_events(app, r);
+  int num_handled_pull_events{};
+  while (num_handled_pull_events < int(s.pull_events.size())) {
+    const auto event = s.pull_events[num_handled_pull_events++];
+    const auto lh = event.lever;
+    const int i = lh == rig.levers[0] ? 0 : 1;
+    om::lever::PullDetectResult pull_res{};
+    pull_res.pulled_lever = event.type == om::lever::PullEventType::Pull;
+    pull_res.released_lever = event.type == om::lever::PullEventType::Release;
+    // if (pull_res.pulled_lever && app.tasktype != 0) {
+    // if (pull_res.pulled_lever && app.sucessful_pull_audio_buffer && state == 0) { // only pull during the trial, not the ITI (state == 1)  -WS
+    if (pull_res.pulled_lever && app.sucessful_pull_audio_buffer) {
+
+      if (app.tasktype != 3) {
+        om::audio::play_buffer_on_channel(app.sucessful_pull_audio_buffer.value(), abs(i-1), 0.5f);
+      }
+
+      // trial starts # 1
+      // trial starts whenever one of the animal pulls
+      if (!s.leverpulled[0] && !s.leverpulled[1]) {
+        s.trialnumber = s.trialnumber + 1;
+        s.first_pull_id = i + 1;
+        s.timepoint = 0;
+        s.trialstart_time = event.time;
+        s.trial_start_time_forsave = elapsed_time(s.session_start_time, event.time);
+        s.first_pull_time = event.time;
+        s.behavior_event = 0; // start of a trial
+        BehaviorData time_stamps{};
+        time_stamps.trial_number = s.trialnumber;
+        time_stamps.time_points = s.timepoint;
+        time_stamps.behavior_events = s.behavior_event;
+        s.behavior_data.push_back(time_stamps);
+
+        // update session info
+        // save some task information into session_info
+        SessionInfo session_info{};
+        session_info.lever1_animal = s.lever1_animal;
+        session_info.lever2_animal = s.lever2_animal;
+        session_info.high_force = app.releaseforce;
+        session_info.init_force = app.normalforce;
+        session_info.experiment_date = app.experiment_date;
+        session_info.task_type = app.tasktype;
+        session_info.pulltime_thres = app.pulledtime_thres;
+        session_info.first_pull_time = s.trial_start_time_forsave;
+        s.session_info.push_back(session_info);
+      }
+
+      // save some behavioral events data
+      s.timepoint = elapsed_time(s.trialstart_time, event.time);
+      s.behavior_event = i + 1; // lever i+1 (1 or 2) is pulled
+      s.other_pull_time = elapsed_time(s.first_pull_time, event.time);
+      BehaviorData time_stamps2{};
+      time_stamps2.trial_number = s.trialnumber;
+      time_stamps2.time_points = s.timepoint;
+      time_stamps2.behavior_events = s.behavior_event;
+      s.behavior_data.push_back(time_stamps2);
+
+      // save some lever information data
+      LeverReadout lever_read{};
+      lever_read.trial_number = s.trialnumber;
+      lever_read.readout_timepoint = s.timepoint;
+      //lever_read.potentiometer_lever1 = lever_state.value().potentiometer_reading;
+      //lever_read.strain_gauge_lever1 = lever_state.value().strain_gauge;
+      //lever_read.potentiometer_lever2 = lever_state.value().potentiometer_reading;
+      //lever_read.strain_gauge_lever2 = lever_state.value().strain_gauge;
+      lever_read.strain_gauge_lever = event.state.strain_gauge;
+      lever_read.potentiometer_lever = event.state.potentiometer_reading;
+      lever_read.lever_id = i + 1;
+      lever_read.pull_or_release = int(pull_res.pulled_lever);
+      s.lever_readout.push_back(lever_read);
+
+      s.leverpulled[i] = true;
+
+
+      // high lever force to make the animal release the lever 
+      if (app.allow_auto_lever_force_set) {
+        om::lever::set_force(om::lever::get_global_lever_system(), lh, app.releaseforce);
+      }
+
+      // deliver juice accordingly
+      // self condition
+      if (app.tasktype == 1 || app.tasktype == 4) {
+        schedule_reward(app, s, abs(i)); // pump id: 0 - pump 1; 1 - pump 2  -WS
+        s.getreward[i] = true;
+        s.rewarded[i] = 1;
+      }
+
+      // altruistic condition
+      else if (app.tasktype == 2) {
+        schedule_reward(app, s, abs(i-1)); // pump id: 0 - pump 1; 1 - pump 2  -WS
+        s.getreward[abs(i - 1)] = true;
+        s.rewarded[abs(i - 1)] = 1;
+      }
+
+      // mutual cooperative condition (see below)
+      // examine the other animal to determine how the trial ends 
+      if (lever_read.lever_id == abs(s.first_pull_id - 2) + 1) {
+        if (s.other_pull_time < app.pulledtime_thres) {
+
+          // cooperative condition
+          if (app.tasktype == 3) {
+            if (s.leverpulled[0] && s.leverpulled[1]) {
+
+              om::audio::play_buffer_both(app.sucessful_pull_audio_buffer.value(), 0.5f);
+
+              // pump 0
+              schedule_reward(app, s, 0); // pump id: 0 - pump 1; 1 - pump 2  -WS
+              s.getreward[0] = true;
+              s.rewarded[0] = 1;
+              // pump 1
+              schedule_reward(app, s, 1); // pump id: 0 - pump 1; 1 - pump 2  -WS
+              s.getreward[1] = true;
+              s.rewarded[1] = 1;
+            }
+          }
+          state = 1;
+          entry = true;
+          break;
         }
+        else {             
+          // old edition
+          // cooperative condition
+          // if (app.tasktype == 3) {
+          //   om::audio::play_buffer_both(app.failed_pull_audio_buffer.value(), 0.5f);
+          // }
+
+          //state = 1;
+          //entry = true;
+          //break;
 
-        // trial starts # 1
-        // trial starts whenever one of the animal pulls
-        if (!app.leverpulled[0] && !app.leverpulled[1]) {
-          app.trialnumber = app.trialnumber + 1;
-          app.first_pull_id = i + 1;
-          app.timepoint = 0;
-          app.trialstart_time = now();
-          app.trial_start_time_forsave = elapsed_time(app.session_start_time, now());
-          app.first_pull_time = now();
-          app.behavior_event = 0; // start of a trial
+          // new edition
+          // end of a trial
+          s.timepoint = elapsed_time(s.trialstart_time, now());
+          s.behavior_event = 9; // end of a trial
           BehaviorData time_stamps{};
-          time_stamps.trial_number = app.trialnumber;
-          time_stamps.time_points = app.timepoint;
-          time_stamps.behavior_events = app.behavior_event;
-          app.behavior_data.push_back(time_stamps);
+          time_stamps.trial_number = s.trialnumber;
+          time_stamps.time_points = s.timepoint;
+          time_stamps.behavior_events = s.behavior_event;
+          s.behavior_data.push_back(time_stamps);
+          //
+          TrialRecord trial_record{};
+          trial_record.trial_number = s.trialnumber;
+          trial_record.first_pull_id = s.first_pull_id;
+          trial_record.rewarded = std::accumulate(s.rewarded.begin(), s.rewarded.end(), 0);
+          trial_record.task_type = app.tasktype;
+          trial_record.automated_lever_enabled_index = get_automated_lever_enabled_index(s);
+          trial_record.pulltime_thres = app.pulledtime_thres;
+          trial_record.trial_start_time_stamp = s.trial_start_time_forsave;
+          //  Add to the array of trials.
+          s.trial_records.push_back(trial_record);
+          // 
+          // 
+          // trial starts #2
+          s.trialnumber = s.trialnumber + 1;
+          s.first_pull_id = i + 1;
+          s.timepoint = 0;
+          s.trialstart_time = event.time;
+          s.trial_start_time_forsave = elapsed_time(s.session_start_time, event.time);
+          s.first_pull_time = event.time;
+          s.behavior_event = 0; // start of a trial
+          BehaviorData time_stamps2{};
+          time_stamps2.trial_number = s.trialnumber;
+          time_stamps2.time_points = s.timepoint;
+          time_stamps2.behavior_events = s.behavior_event;
+          s.behavior_data.push_back(time_stamps2);
+          //
+          //s.timepoint = elapsed_time(s.trialstart_time, now());
+          //s.behavior_event = i + 1; // lever i+1 (1 or 2) is pulled
+          //s.other_pull_time = elapsed_time(s.first_pull_time, now());
+          //BehaviorData time_stamps3{};
+          //time_stamps3.trial_number = s.trialnumber;
+          //time_stamps3.time_points = s.timepoint;
+          //time_stamps3.behavior_events = s.behavior_event;
+          //s.behavior_data.push_back(time_stamps3);
 
           // update session info
           // save some task information into session_info
           SessionInfo session_info{};
-          session_info.lever1_animal = app.lever1_animal;
-          session_info.lever2_animal = app.lever2_animal;
+          session_info.lever1_animal = s.lever1_animal;
+          session_info.lever2_animal = s.lever2_animal;
           session_info.high_force = app.releaseforce;
           session_info.init_force = app.normalforce;
           session_info.experiment_date = app.experiment_date;
           session_info.task_type = app.tasktype;
           session_info.pulltime_thres = app.pulledtime_thres;
-          session_info.first_pull_time = app.trial_start_time_forsave;
-          app.session_info.push_back(session_info);
-        }
+          session_info.first_pull_time = s.trial_start_time_forsave;
+          s.session_info.push_back(session_info);
 
-        // save some behavioral events data
-        app.timepoint = elapsed_time(app.trialstart_time, now());
-        app.behavior_event = i + 1; // lever i+1 (1 or 2) is pulled
-        app.other_pull_time = elapsed_time(app.first_pull_time, now());
-        BehaviorData time_stamps2{};
-        time_stamps2.trial_number = app.trialnumber;
-        time_stamps2.time_points = app.timepoint;
-        time_stamps2.behavior_events = app.behavior_event;
-        app.behavior_data.push_back(time_stamps2);
-
-        // save some lever information data
-        LeverReadout lever_read{};
-        lever_read.trial_number = app.trialnumber;
-        lever_read.readout_timepoint = app.timepoint;
-        //lever_read.potentiometer_lever1 = lever_state.value().potentiometer_reading;
-        //lever_read.strain_gauge_lever1 = lever_state.value().strain_gauge;
-        //lever_read.potentiometer_lever2 = lever_state.value().potentiometer_reading;
-        //lever_read.strain_gauge_lever2 = lever_state.value().strain_gauge;
-        lever_read.strain_gauge_lever = lever_state.value().strain_gauge;
-        lever_read.potentiometer_lever = lever_state.value().potentiometer_reading;
-        lever_read.lever_id = i + 1;
-        lever_read.pull_or_release = int(pull_res.pulled_lever);
-        app.lever_readout.push_back(lever_read);
-
-        app.leverpulled[i] = true;
-
-
-        // high lever force to make the animal release the lever 
-        if (app.allow_auto_lever_force_set) {
-          om::lever::set_force(om::lever::get_global_lever_system(), lh, app.releaseforce);
-        }
 
-        // deliver juice accordingly
-        // self condition
-        if (app.tasktype == 1 || app.tasktype == 4) {
-          auto pump_handle = om::pump::ith_pump(abs(i)); // pump id: 0 - pump 1; 1 - pump 2  -WS
-          std::this_thread::sleep_for(std::chrono::milliseconds(app.juice_delay_time));
-          om::pump::run_dispense_program(pump_handle);
-          app.getreward[i] = true;
-          app.rewarded[i] = 1;
-          //
-          app.timepoint = elapsed_time(app.trialstart_time, now());
-          app.behavior_event = abs(i) + 3; // pump 1 or 2 deliver  
-          BehaviorData time_stamps3{};
-          time_stamps3.trial_number = app.trialnumber;
-          time_stamps3.time_points = app.timepoint;
-          time_stamps3.behavior_events = app.behavior_event;
-          app.behavior_data.push_back(time_stamps3);
-        }
 
-        // altruistic condition
-        else if (app.tasktype == 2) {
-          auto pump_handle = om::pump::ith_pump(abs(i-1)); // pump id: 0 - pump 1; 1 - pump 2  -WS
-          std::this_thread::sleep_for(std::chrono::milliseconds(app.juice_delay_time));
-          om::pump::run_dispense_program(pump_handle);
-          app.getreward[abs(i - 1)] = true;
-          app.rewarded[abs(i - 1)] = 1;
-          //
-          app.timepoint = elapsed_time(app.trialstart_time, now());
-          app.behavior_event = abs(i-1) + 3; // pump 1 or 2 deliver  
-          BehaviorData time_stamps3{};
-          time_stamps3.trial_number = app.trialnumber;
-          time_stamps3.time_points = app.timepoint;
-          time_stamps3.behavior_events = app.behavior_event;
-          app.behavior_data.push_back(time_stamps3);
         }
-
-        // mutual cooperative condition (see below)
-        // examine the other animal to determine how the trial ends 
-        if (lever_read.lever_id == abs(app.first_pull_id - 2) + 1) {
-          if (app.other_pull_time < app.pulledtime_thres) {
-
-            // cooperative condition
-            if (app.tasktype == 3) {
-              if (app.leverpulled[0] && app.leverpulled[1]) {
-
-                om::audio::play_buffer_both(app.sucessful_pull_audio_buffer.value(), 0.5f);
-
-                // pump 0
-                auto pump_handle = om::pump::ith_pump(0); // pump id: 0 - pump 1; 1 - pump 2  -WS
-                std::this_thread::sleep_for(std::chrono::milliseconds(app.juice_delay_time));
-                om::pump::run_dispense_program(pump_handle);
-                app.getreward[0] = true;
-                app.rewarded[0] = 1;
-                //
-                app.timepoint = elapsed_time(app.trialstart_time, now());
-                app.behavior_event = 0 + 3; // pump 1 or 2 deliver  
-                BehaviorData time_stamps3{};
-                time_stamps3.trial_number = app.trialnumber;
-                time_stamps3.time_points = app.timepoint;
-                time_stamps3.behavior_events = app.behavior_event;
-                app.behavior_data.push_back(time_stamps3);
-                // pump 1
-                auto pump_handle2 = om::pump::ith_pump(1); // pump id: 0 - pump 1; 1 - pump 2  -WS
-                // std::this_thread::sleep_for(std::chrono::milliseconds(app.juice_delay_time));
-                om::pump::run_dispense_program(pump_handle2);
-                app.getreward[1] = true;
-                app.rewarded[1] = 1;
-                //
-                app.timepoint = elapsed_time(app.trialstart_time, now());
-                app.behavior_event = abs(1) + 3; // pump 1 or 2 deliver  
-                BehaviorData time_stamps4{};
-                time_stamps4.trial_number = app.trialnumber;
-                time_stamps4.time_points = app.timepoint;
-                time_stamps4.behavior_events = app.behavior_event;
-                app.behavior_data.push_back(time_stamps4);
-              }
-            }
-            state = 1;
-            entry = true;
-            break;
-          }
-          else {             
-            // old edition
-            // cooperative condition
-            // if (app.tasktype == 3) {
-            //   om::audio::play_buffer_both(app.failed_pull_audio_buffer.value(), 0.5f);
-            // }
-
-            //state = 1;
-            //entry = true;
-            //break;
-
-            // new edition
-            // end of a trial
-            app.timepoint = elapsed_time(app.trialstart_time, now());
-            app.behavior_event = 9; // end of a trial
-            BehaviorData time_stamps{};
-            time_stamps.trial_number = app.trialnumber;
-            time_stamps.time_points = app.timepoint;
-            time_stamps.behavior_events = app.behavior_event;
-            app.behavior_data.push_back(time_stamps);
-            //
-            TrialRecord trial_record{};
-            trial_record.trial_number = app.trialnumber;
-            trial_record.first_pull_id = app.first_pull_id;
-            trial_record.rewarded = app.rewarded[0] + app.rewarded[1];
-            trial_record.task_type = app.tasktype;
-            trial_record.automated_lever_enabled_index = get_automated_lever_enabled_index(app);
-            trial_record.pulltime_thres = app.pulledtime_thres;
-            trial_record.trial_start_time_stamp = app.trial_start_time_forsave;
-            //  Add to the array of trials.
-            app.trial_records.push_back(trial_record);
-            // 
-            // 
-            // trial starts #2
-            app.trialnumber = app.trialnumber + 1;
-            app.first_pull_id = i + 1;
-            app.timepoint = 0;
-            app.trialstart_time = now();
-            app.trial_start_time_forsave = elapsed_time(app.session_start_time, now());
-            app.first_pull_time = now();
-            app.behavior_event = 0; // start of a trial
-            BehaviorData time_stamps2{};
-            time_stamps2.trial_number = app.trialnumber;
-            time_stamps2.time_points = app.timepoint;
-            time_stamps2.behavior_events = app.behavior_event;
-            app.behavior_data.push_back(time_stamps2);
-            //
-            //app.timepoint = elapsed_time(app.trialstart_time, now());
-            //app.behavior_event = i + 1; // lever i+1 (1 or 2) is pulled
-            //app.other_pull_time = elapsed_time(app.first_pull_time, now());
-            //BehaviorData time_stamps3{};
-            //time_stamps3.trial_number = app.trialnumber;
-            //time_stamps3.time_points = app.timepoint;
-            //time_stamps3.behavior_events = app.behavior_event;
-            //app.behavior_data.push_back(time_stamps3);
-
-            // update session info
-            // save some task information into session_info
-            SessionInfo session_info{};
-            session_info.lever1_animal = app.lever1_animal;
-            session_info.lever2_animal = app.lever2_animal;
-            session_info.high_force = app.releaseforce;
-            session_info.init_force = app.normalforce;
-            session_info.experiment_date = app.experiment_date;
-            session_info.task_type = app.tasktype;
-            session_info.pulltime_thres = app.pulledtime_thres;
-            session_info.first_pull_time = app.trial_start_time_forsave;
-            app.session_info.push_back(session_info);
-
+      }
+      else if (lever_read.lever_id == s.first_pull_id) {
+        // if (s.other_pull_time >= app.pulledtime_thres) {
+        //  state = 1;
+        //  entry = true;
+        //  break;
+        //}
+        
+        // old edition
+        s.first_pull_time = event.time;
+
+        // new edition
+        // trial starts #3
+        //s.trialnumber = s.trialnumber + 1;
+        //s.first_pull_id = i + 1;
+        //s.timepoint = 0;
+        //s.trialstart_time = now();
+        //s.trial_start_time_forsave = elapsed_time(s.session_start_time, now());
+        //s.first_pull_time = now();
+        //s.behavior_event = 0; // start of a trial
+        //BehaviorData time_stamps{};
+        //time_stamps.trial_number = s.trialnumber;
+        //time_stamps.time_points = s.timepoint;
+        //time_stamps.behavior_events = s.behavior_event;
+        //s.behavior_data.push_back(time_stamps);
+       }
+      
+    }
 
 
-          }
-        }
-        else if (lever_read.lever_id == app.first_pull_id) {
-          // if (app.other_pull_time >= app.pulledtime_thres) {
-          //  state = 1;
-          //  entry = true;
-          //  break;
-          //}
-          
-          // old edition
-          app.first_pull_time = now();
+    else if (pull_res.released_lever && app.allow_auto_lever_force_set) {
+      om::lever::set_force(om::lever::get_global_lever_system(), lh, app.normalforce);
 
-          // new edition
-          // trial starts #3
-          //app.trialnumber = app.trialnumber + 1;
-          //app.first_pull_id = i + 1;
-          //app.timepoint = 0;
-          //app.trialstart_time = now();
-          //app.trial_start_time_forsave = elapsed_time(app.session_start_time, now());
-          //app.first_pull_time = now();
-          //app.behavior_event = 0; // start of a trial
-          //BehaviorData time_stamps{};
-          //time_stamps.trial_number = app.trialnumber;
-          //time_stamps.time_points = app.timepoint;
-          //time_stamps.behavior_events = app.behavior_event;
-          //app.behavior_data.push_back(time_stamps);
-         }
+      // om::audio::play_buffer_both(app.failed_pull_audio_buffer.value(), 0.5f);
         
-      }
-
+      // save some lever information data
+      LeverReadout lever_read{};
+      lever_read.trial_number = s.trialnumber;
+      lever_read.readout_timepoint = elapsed_time(s.trialstart_time, event.time);
+      //lever_read.potentiometer_lever1 = lever_state.value().potentiometer_reading;
+      //lever_read.strain_gauge_lever1 = lever_state.value().strain_gauge;
+      //lever_read.potentiometer_lever2 = lever_state.value().potentiometer_reading;
+      //lever_read.strain_gauge_lever2 = lever_state.value().strain_gauge;
+      lever_read.strain_gauge_lever = event.state.strain_gauge;
+      lever_read.potentiometer_lever = event.state.potentiometer_reading;
+      lever_read.lever_id = i + 1;
+      lever_read.pull_or_release = int(pull_res.pulled_lever);
+      s.lever_readout.push_back(lever_read);
 
-      else if (pull_res.released_lever && app.allow_auto_lever_force_set) {
-        om::lever::set_force(om::lever::get_global_lever_system(), lh, app.normalforce);
-
-        // om::audio::play_buffer_both(app.failed_pull_audio_buffer.value(), 0.5f);
-          
-        // save some lever information data
-        LeverReadout lever_read{};
-        lever_read.trial_number = app.trialnumber;
-        lever_read.readout_timepoint = elapsed_time(app.trialstart_time, now());;
-        //lever_read.potentiometer_lever1 = lever_state.value().potentiometer_reading;
-        //lever_read.strain_gauge_lever1 = lever_state.value().strain_gauge;
-        //lever_read.potentiometer_lever2 = lever_state.value().potentiometer_reading;
-        //lever_read.strain_gauge_lever2 = lever_state.value().strain_gauge;
-        lever_read.strain_gauge_lever = lever_state.value().strain_gauge;
-        lever_read.potentiometer_lever = lever_state.value().potentiometer_reading;
-        lever_read.lever_id = i + 1;
-        lever_read.pull_or_release = int(pull_res.pulled_lever);
-        app.lever_readout.push_back(lever_read);
-
-      }
     }
   }
+  s.pull_events.erase(s.pull_events.begin(), s.pull_events.begin() + num_handled_pull_events);
 
 
   switch (state) {
     case 0: {
       // new_trial.play_sound_on_entry = app.start_trial_audio_buffer;
       new_trial.total_time = app.new_total_time;
-      new_trial.stim0_offset = app.stim0_offset;
-      new_trial.stim0_size = app.stim0_size;
-      new_trial.stim1_offset = app.stim1_offset;
-      new_trial.stim1_size = app.stim1_size;
+      new_trial.stim0_offset = om::to_window_offset(om::stimulus_region(rig, 0), app.stim0_offset);
+      new_trial.stim0_size = om::to_window_size(om::stimulus_region(rig, 0), app.stim0_size);
+      new_trial.stim1_offset = om::to_window_offset(om::stimulus_region(rig, 1), app.stim1_offset);
+      new_trial.stim1_size = om::to_window_size(om::stimulus_region(rig, 1), app.stim1_size);
       if (app.tasktype == 0) {
         //auto buff_p = std::string{ OM_RES_DIR } + "/sounds/start_trial_beep.wav";
         //app.start_trial_audio_buffer = om::audio::read_buffer(buff_p.c_str());
@@ -1101,21 +1290,21 @@ void task_update(App& app) {
         new_trial.stim1_image = std::nullopt;
         new_trial.stim0_color = app.stim0_color;
         new_trial.stim1_color = app.stim1_color;
-        // if (app.leverpulled[0]) { new_trial.stim0_color = app.stim0_color_disappear; }
-        // if (app.leverpulled[1]) { new_trial.stim1_color = app.stim1_color_disappear; }
+        // if (s.leverpulled[0]) { new_trial.stim0_color = app.stim0_color_disappear; }
+        // if (s.leverpulled[1]) { new_trial.stim1_color = app.stim1_color_disappear; }
         if (0) {
           //  Optionally specify an image handle - when this is set, the stim0_color parameter
           //  is ignored and the image is presented instead.
-          // if (!app.leverpulled[0]) { new_trial.stim0_image = app.debug_image; }
-          // else if (app.leverpulled[0]) { new_trial.stim0_image = {}; new_trial.stim0_color = app.stim0_color_disappear; }
-          // if (!app.leverpulled[1]) { new_trial.stim1_image = app.debug_image; } //  works analogously for the other image. 
-          // else if (app.leverpulled[1]) { new_trial.stim1_image = {}; new_trial.stim1_color = app.stim1_color_disappear; }  
+          // if (!s.leverpulled[0]) { new_trial.stim0_image = app.debug_image; }
+          // else if (s.leverpulled[0]) { new_trial.stim0_image = {}; new_trial.stim0_color = app.stim0_color_disappear; }
+          // if (!s.leverpulled[1]) { new_trial.stim1_image = app.debug_image; } //  works analogously for the other image. 
+          // else if (s.leverpulled[1]) { new_trial.stim1_image = {}; new_trial.stim1_color = app.stim1_color_disappear; }  
         }
       }
 
 
       if (entry && app.allow_automated_juice_delivery) {
-        auto pump_handle = om::pump::ith_pump(1); // pump id: 0 - pump 1; 1 - pump 2
+        auto pump_handle = rig.pumps[1]; // pump id: 0 - pump 1; 1 - pump 2
         om::pump::run_dispense_program(pump_handle);
       }
 
@@ -1131,15 +1320,14 @@ void task_update(App& app) {
     case 1: {
         state = 2;
         entry = true;
-        app.timepoint = elapsed_time(app.trialstart_time, now());
-        app.behavior_event = 9; // end of a trial
+        s.timepoint = elapsed_time(s.trialstart_time, now());
+        s.behavior_event = 9; // end of a trial
         BehaviorData time_stamps{};
-        time_stamps.trial_number = app.trialnumber;
-        time_stamps.time_points = app.timepoint;
-        time_stamps.behavior_events = app.behavior_event;
-        app.behavior_data.push_back(time_stamps);
-        app.getreward[0] = false;
-        app.getreward[1] = false;
+        time_stamps.trial_number = s.trialnumber;
+        time_stamps.time_points = s.timepoint;
+        time_stamps.behavior_events = s.behavior_event;
+        s.behavior_data.push_back(time_stamps);
+        std::fill(s.getreward.begin(), s.getreward.end(), false);
       break;
     }
 
@@ -1147,15 +1335,15 @@ void task_update(App& app) {
     case 2: {
 
       TrialRecord trial_record{};
-      trial_record.trial_number = app.trialnumber;
-      trial_record.first_pull_id = app.first_pull_id;
-      trial_record.rewarded = app.rewarded[0] + app.rewarded[1];
+      trial_record.trial_number = s.trialnumber;
+      trial_record.first_pull_id = s.first_pull_id;
+      trial_record.rewarded = std::accumulate(s.rewarded.begin(), s.rewarded.end(), 0);
       trial_record.task_type = app.tasktype;
-      trial_record.automated_lever_enabled_index = get_automated_lever_enabled_index(app);
-      trial_record.trial_start_time_stamp = app.trial_start_time_forsave;
+      trial_record.automated_lever_enabled_index = get_automated_lever_enabled_index(s);
+      trial_record.trial_start_time_stamp = s.trial_start_time_forsave;
       trial_record.pulltime_thres = app.pulledtime_thres;
       //  Add to the array of trials.
-      app.trial_records.push_back(trial_record);
+      s.trial_records.push_back(trial_record);
       state = 0;
       entry = true;
       break;
@@ -1167,18 +1355,27 @@ void task_update(App& app) {
   }
 }
 
-void ensure_some_trial_records_are_stored(App& app) {
-  if (app.trial_records.empty()) {
+void task_update(App& app) {
+  om::led::update(&app.led_sync);
+
+  for (int r = 0; r < int(app.rigs.size()); r++) {
+    task_update_rig(app, r);
+  }
+}
+
+void ensure_some_trial_records_are_stored(App& app, int r) {
+  auto& s = app.sessions[r];
+  if (s.trial_records.empty()) {
     TrialRecord trial_record{};
-    trial_record.trial_number = app.trialnumber;
-    trial_record.first_pull_id = app.first_pull_id;
-    trial_record.rewarded = app.rewarded[0] + app.rewarded[1];
+    trial_record.trial_number = s.trialnumber;
+    trial_record.first_pull_id = s.first_pull_id;
+    trial_record.rewarded = std::accumulate(s.rewarded.begin(), s.rewarded.end(), 0);
     trial_record.task_type = app.tasktype;
-    trial_record.automated_lever_enabled_index = get_automated_lever_enabled_index(app);
-    trial_record.trial_start_time_stamp = app.trial_start_time_forsave;
+    trial_record.automated_lever_enabled_index = get_automated_lever_enabled_index(s);
+    trial_record.trial_start_time_stamp = s.trial_start_time_forsave;
     trial_record.pulltime_thres = app.pulledtime_thres;
     //  Add to the array of trials.
-    app.trial_records.push_back(trial_record);
+    s.trial_records.push_back(trial_record);
   }
 }
 
@@ -0,0 +1,885 @@
+/*
+ * Virtual levers - Emulates the cooperative_pulling sketch on pseudo-terminals, so that the lever
+ * system, the serial lever protocol and the task can be run without hardware. Each lever gets a
+ * PTY whose slave path is printed on startup; open it like the port of a real lever.
+ *
+ * The emulated device handles the sketch's command set as the sketch does, including the binary
+ * state stream, pull edge frames, force profiles, the clock read and baud rate negotiation. Bytes
+ * pass only while the port's rate, as set by whoever opened the slave, matches the device's rate,
+ * so that negotiation is exercised as on a real link. Responses and frames can be delayed by a
+ * fixed latency plus uniform jitter, and dropped at random. The potentiometer follows a scripted
+ * trajectory, offset in time by `lever_phase_offset_s` per lever; the strain gauge follows the
+ * commanded force.
+ *
+ * Usage: virtual_lever [options]
+ *   --levers <n>           number of levers (default 2)
+ *   --latency-ms <ms>      delay of each response and frame (default 0)
+ *   --jitter-ms <ms>       additional delay, uniform in [0, ms] (default 0)
+ *   --drop <p>             probability of dropping each response line or frame (default 0)
+ *   --max-baud <rate>      fastest rate the device accepts (default 2000000)
+ *   --pot-range <lo> <hi>  potentiometer readings of the released and pulled lever
+ *   --trajectory <spec>    potentiometer trajectory (default sine:4), one of
+ *                            constant:<fraction of range>
+ *                            sine:<period s>
+ *                            pulls:<period s>:<fraction of period pulled>
+ *                            file:<path> - lines of "<time s> <reading>", interpolated and looped
+ *   --link <prefix>        also create symlinks <prefix>0, <prefix>1, ... to the slave devices
+ *   --duration <s>         exit after this long (default: run until interrupted)
+ *   --seed <n>             seed for the jitter and drops
+ */
+
+#include "common/random.hpp"
+#include "common/serial_lever.hpp"
+#include "common/time.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+struct Config {
+  static constexpr int default_num_levers = 2;
+  static constexpr uint32_t supported_baud_rates[] = {
+    2000000, 1000000, 500000, 230400, 115200, 57600, 38400, 19200, 9600};
+  //  As in the sketch.
+  static constexpr double read_interval_s = 2e-3;
+  static constexpr double profile_step_s = 1e-3;
+  static constexpr int running_average_size = 30;
+  static constexpr double parse_timeout_s = 1.0;
+  static constexpr float pwm_coef[2] = {18.793f, 32.662f};
+  static constexpr float strain_coef[7] = {
+    -3.1578e-19f, 1.265e-14f, -2.0307e-10f, 1.6669e-6f, -7.3641e-3f, 1.7537e1f, -1.3234e4f};
+  //  Roughly what the levers read; the emulated strain gauge is linear in the commanded force.
+  static constexpr float strain_baseline = 29000.0f;
+  static constexpr float strain_per_gram = 18.0f;
+  static constexpr float default_pot_range[2] = {44.1e3f, 49.7e3f};
+  static constexpr double lever_phase_offset_s = 0.5;
+  //  Time the lever takes to travel between its released and pulled positions.
+  static constexpr double pull_travel_s = 0.1;
+  static constexpr double tick_interval_s = 1e-3;
+  static constexpr int read_size = 256;
+  static constexpr double pi = 3.14159265358979323846;
+};
+
+enum class TrajectoryType {
+  Constant = 0,
+  Sine,
+  Pulls,
+  File,
+};
+
+struct Trajectory {
+  TrajectoryType type{TrajectoryType::Sine};
+  double value{};
+  double period_s{4.0};
+  double duty{0.3};
+  //  (time, reading), sorted by time.
+  std::vector<std::pair<double, double>> points;
+};
+
+struct Options {
+  int num_levers{Config::default_num_levers};
+  double latency_s{};
+  double jitter_s{};
+  double drop_probability{};
+  uint32_t max_baud_rate{Config::supported_baud_rates[0]};
+  float pot_range[2]{Config::default_pot_range[0], Config::default_pot_range[1]};
+  Trajectory trajectory;
+  std::string link_prefix;
+  double duration_s{};
+  std::optional<unsigned int> seed;
+};
+
+struct PendingOutput {
+  om::TimePoint due;
+  //  Rate of the device when the bytes were sent.
+  uint32_t baud_rate;
+  std::string bytes;
+};
+
+struct ProfileSegment {
+  long reverse;
+  long grams;
+  long ramp_ms;
+  long hold_ms;
+};
+
+struct VirtualLever {
+  int index{};
+  int master_fd{-1};
+  int slave_fd{-1};
+  std::string slave_path;
+  std::string link_path;
+  om::TimePoint start_time{};
+
+  std::string input;
+  om::TimePoint input_time{};
+  std::deque<PendingOutput> output;
+  om::TimePoint last_output_due{};
+
+  //  Sketch state, named as in the sketch.
+  int command_grams{};
+  int pwm_value{};
+  float pwm_offset{};
+  int direction{1};
+  int enable{};
+  int measured_grams{};
+  float strain_average{Config::strain_baseline};
+  om::TimePoint next_read_time{};
+
+  int stream_rate{};
+  om::TimePoint next_frame_time{};
+  uint16_t frame_sequence{};
+
+  long edge_rising{};
+  long edge_falling{};
+  bool edge_is_high{};
+  uint16_t edge_sequence{};
+
+  ProfileSegment profile[om::max_lever_force_profile_segments()]{};
+  int profile_size{};
+  int profile_segment{-1};
+  float profile_start_grams{};
+  om::TimePoint segment_start{};
+  om::TimePoint next_profile_step_time{};
+  uint16_t profile_sequence{};
+
+  uint32_t baud_rate{om::default_baud_rate()};
+  bool baud_confirmed{true};
+  om::TimePoint baud_switch_time{};
+  om::TimePoint last_command_time{};
+
+  uint64_t num_commands{};
+  uint64_t num_sent{};
+  uint64_t num_dropped{};
+  uint64_t num_garbled{};
+};
+
+#if defined(__linux__)
+
+volatile sig_atomic_t keep_running = 1;
+
+void handle_signal(int) {
+  keep_running = 0;
+}
+
+om::TimePoint::duration to_duration(double s) {
+  return std::chrono::duration_cast<om::TimePoint::duration>(om::Duration(s));
+}
+
+std::optional<speed_t> to_speed(uint32_t baud) {
+  switch (baud) {
+    case 9600:
+      return B9600;
+    case 19200:
+      return B19200;
+    case 38400:
+      return B38400;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    case 230400:
+      return B230400;
+    case 500000:
+      return B500000;
+    case 1000000:
+      return B1000000;
+    case 2000000:
+      return B2000000;
+    default:
+      return std::nullopt;
+  }
+}
+
+//  True if the rate the slave side is configured with matches `baud`.
+bool link_matches(const VirtualLever& lever, uint32_t baud) {
+  termios tty{};
+  if (tcgetattr(lever.master_fd, &tty) != 0) {
+    return false;
+  }
+  return to_speed(baud) == cfgetospeed(&tty);
+}
+
+bool supports_baud(const Options& options, uint32_t baud) {
+  for (uint32_t rate : Config::supported_baud_rates) {
+    if (rate == baud && rate <= options.max_baud_rate) {
+      return true;
+    }
+  }
+  return false;
+}
+
+double trajectory_reading(const Options& options, double t) {
+  const auto& traj = options.trajectory;
+  const double lo = options.pot_range[0];
+  const double hi = options.pot_range[1];
+  switch (traj.type) {
+    case TrajectoryType::Constant:
+      return lo + traj.value * (hi - lo);
+    case TrajectoryType::Sine: {
+      const double f = 0.5 - 0.5 * std::cos(2.0 * Config::pi * t / traj.period_s);
+      return lo + f * (hi - lo);
+    }
+    case TrajectoryType::Pulls: {
+      //  Pulled for the first `duty` of each period, moving at a constant speed in between.
+      const double phase = std::fmod(t, traj.period_s);
+      const double pull_end = traj.duty * traj.period_s;
+      double f;
+      if (phase < pull_end) {
+        f = std::min(1.0, phase / Config::pull_travel_s);
+      } else {
+        f = std::max(0.0, 1.0 - (phase - pull_end) / Config::pull_travel_s);
+      }
+      return lo + f * (hi - lo);
+    }
+    case TrajectoryType::File: {
+      auto& points = traj.points;
+      const double end = points.back().first;
+      const double s = end > 0.0 ? std::fmod(t, end) : 0.0;
+      auto it = std::lower_bound(points.begin(), points.end(), s, [](auto& p, double v) {
+        return p.first < v;
+      });
+      if (it == points.begin()) {
+        return it->second;
+      } else if (it == points.end()) {
+        return points.back().second;
+      }
+      auto& a = *(it - 1);
+      auto& b = *it;
+      const double f = b.first > a.first ? (s - a.first) / (b.first - a.first) : 1.0;
+      return a.second + f * (b.second - a.second);
+    }
+    default:
+      return lo;
+  }
+}
+
+int read_pot(const Options& options, const VirtualLever& lever, const om::TimePoint& t) {
+  const double s = om::elapsed_time(lever.start_time, t) +
+                   double(lever.index) * Config::lever_phase_offset_s;
+  return int(std::lround(trajectory_reading(options, s)));
+}
+
+uint32_t device_micros(const VirtualLever& lever, const om::TimePoint& t) {
+  return uint32_t(uint64_t(om::elapsed_time(lever.start_time, t) * 1e6));
+}
+
+float calculate_pwm_from_strain(float strain) {
+  auto& c = Config::strain_coef;
+  return c[0] * std::pow(strain, 6.0f) + c[1] * std::pow(strain, 5.0f) +
+         c[2] * std::pow(strain, 4.0f) + c[3] * std::pow(strain, 3.0f) +
+         c[4] * std::pow(strain, 2.0f) + c[5] * strain + c[6];
+}
+
+om::LeverState make_state(const VirtualLever& lever, int pot) {
+  om::LeverState result{};
+  result.strain_gauge = lever.strain_average;
+  result.calculated_pwm = calculate_pwm_from_strain(lever.strain_average);
+  result.actual_pwm = float(lever.pwm_value);
+  result.potentiometer_reading = float(pot);
+  return result;
+}
+
+void send(const Options& options, VirtualLever& lever, const om::TimePoint& t, std::string bytes) {
+  if (om::urand() < options.drop_probability) {
+    lever.num_dropped++;
+    return;
+  }
+  //  Delayed bytes still arrive in the order they were sent.
+  const auto delay = options.latency_s + om::urand() * options.jitter_s;
+  const auto due = std::max(lever.last_output_due, t + to_duration(delay));
+  lever.last_output_due = due;
+  lever.output.push_back({due, lever.baud_rate, std::move(bytes)});
+}
+
+//  Serial.println
+void respond(const Options& options, VirtualLever& lever, const om::TimePoint& t,
+             const std::string& line) {
+  send(options, lever, t, line + "\r\n");
+}
+
+void send_frame(const Options& options, VirtualLever& lever, const om::TimePoint& t,
+                uint8_t type, bool flag, uint16_t sequence, int pot) {
+  uint8_t frame[om::LeverFrameFormat::size];
+  const auto state = make_state(lever, pot);
+  const uint32_t micros = device_micros(lever, t);
+  if (type == om::LeverFrameFormat::state_type) {
+    om::encode_lever_state_frame({sequence, micros, state}, frame);
+  } else if (type == om::LeverFrameFormat::edge_type) {
+    om::encode_lever_edge_frame({sequence, micros, flag, state}, frame);
+  } else {
+    om::encode_lever_profile_frame({sequence, micros, flag, state}, frame);
+  }
+  send(options, lever, t, std::string{reinterpret_cast<const char*>(frame), sizeof(frame)});
+}
+
+/*
+ * Argument parsing in the manner of Arduino's Stream::parseInt and parseFloat: characters that
+ * cannot start a number are skipped, and the number ends at the first character that cannot
+ * continue it. Running out of input before then leaves the command incomplete, unless the sketch
+ * would have given up waiting for more.
+ */
+
+struct Cursor {
+  const std::string* s;
+  size_t pos;
+  bool timed_out;
+  bool incomplete;
+};
+
+template <typename IsNumberChar>
+std::string parse_number_chars(Cursor* cursor, IsNumberChar&& is_number_char) {
+  auto& s = *cursor->s;
+  while (cursor->pos < s.size() && s[cursor->pos] != '-' && !std::isdigit((unsigned char) s[cursor->pos])) {
+    cursor->pos++;
+  }
+  std::string result;
+  while (cursor->pos < s.size() && is_number_char(s[cursor->pos], result.empty())) {
+    result += s[cursor->pos++];
+  }
+  if (cursor->pos == s.size() && !cursor->timed_out) {
+    cursor->incomplete = true;
+  }
+  return result;
+}
+
+long parse_int(Cursor* cursor) {
+  auto chars = parse_number_chars(cursor, [](char c, bool first) {
+    return std::isdigit((unsigned char) c) || (first && c == '-');
+  });
+  return std::strtol(chars.c_str(), nullptr, 10);
+}
+
+float parse_float(Cursor* cursor) {
+  auto chars = parse_number_chars(cursor, [](char c, bool first) {
+    return std::isdigit((unsigned char) c) || c == '.' || (first && c == '-');
+  });
+  return std::strtof(chars.c_str(), nullptr);
+}
+
+void set_profile_grams(VirtualLever& lever, float grams) {
+  lever.command_grams = int(grams);
+  lever.pwm_value = int(Config::pwm_coef[0] * grams + Config::pwm_coef[1] + lever.pwm_offset);
+}
+
+void start_profile_segment(VirtualLever& lever, int i, const om::TimePoint& t) {
+  lever.profile_segment = i;
+  lever.profile_start_grams = float(lever.command_grams);
+  lever.segment_start = t;
+  lever.direction = lever.profile[i].reverse ? 0 : 1;
+}
+
+void finish_profile(const Options& options, VirtualLever& lever, const om::TimePoint& t,
+                    bool completed) {
+  lever.profile_segment = -1;
+  send_frame(options, lever, t, om::LeverFrameFormat::profile_type, completed,
+             lever.profile_sequence++, read_pot(options, lever, t));
+}
+
+void switch_baud(VirtualLever& lever, uint32_t baud, const om::TimePoint& t) {
+  lever.baud_rate = baud;
+  lever.baud_confirmed = baud == om::default_baud_rate();
+  lever.baud_switch_time = t;
+  lever.last_command_time = t;
+}
+
+//  Handles the command at the start of `lever.input`. Returns the number of bytes it spans, or 0
+//  if it is incomplete.
+size_t process_command(const Options& options, VirtualLever& lever, const om::TimePoint& t) {
+  Cursor cursor{&lever.input, 1, om::elapsed_time(lever.input_time, t) >= Config::parse_timeout_s, false};
+  auto respond_line = [&](const std::string& line) {
+    respond(options, lever, t, line);
+  };
+
+  const char command = lever.input[0];
+  switch (command) {
+    case 'x':
+      lever.enable = 1;
+      respond_line("enabled");
+      break;
+    case 'o':
+      lever.enable = 0;
+      respond_line("disabled");
+      break;
+    case 'P':
+      respond_line(std::to_string(read_pot(options, lever, t)));
+      break;
+    case 'f':
+      lever.direction = 1;
+      respond_line("forward");
+      break;
+    case 'z':
+      lever.direction = 0;
+      respond_line("reverse");
+      break;
+    case 'p': {
+      const long pwm = parse_int(&cursor);
+      if (cursor.incomplete) {
+        return 0;
+      }
+      lever.pwm_value = int(pwm);
+      break;
+    }
+    case 'g': {
+      const long grams = parse_int(&cursor);
+      if (cursor.incomplete) {
+        return 0;
+      }
+      lever.command_grams = int(grams);
+      lever.pwm_value = int(Config::pwm_coef[0] * float(grams) + Config::pwm_coef[1] + lever.pwm_offset);
+      respond_line("target grams: " + std::to_string(lever.command_grams) +
+                   "\tcalculated PWM value: " + std::to_string(lever.pwm_value));
+      lever.direction = lever.pwm_value >= 0 ? 1 : 0;
+      break;
+    }
+    case 'b': {
+      const long rate = parse_int(&cursor);
+      if (cursor.incomplete) {
+        return 0;
+      }
+      lever.stream_rate = int(std::max(rate, 0L));
+      lever.next_frame_time = t;
+      respond_line("stream rate: " + std::to_string(lever.stream_rate));
+      break;
+    }
+    case 'e': {
+      const long rising = parse_int(&cursor);
+      const long falling = parse_int(&cursor);
+      if (cursor.incomplete) {
+        return 0;
+      }
+      if (rising != lever.edge_rising || falling != lever.edge_falling) {
+        lever.edge_rising = rising;
+        lever.edge_falling = falling;
+        lever.edge_is_high = false;
+      }
+      respond_line("edge thresholds: " + std::to_string(lever.edge_rising) + " " +
+                   std::to_string(lever.edge_falling));
+      break;
+    }
+    case 't':
+      respond_line("clock: " + std::to_string(device_micros(lever, t)));
+      break;
+    case 'h': {
+      const long rate = parse_int(&cursor);
+      if (cursor.incomplete) {
+        return 0;
+      }
+      if (uint32_t(rate) == lever.baud_rate) {
+        lever.baud_confirmed = true;
+        respond_line("baud: " + std::to_string(lever.baud_rate));
+      } else if (rate > 0 && supports_baud(options, uint32_t(rate))) {
+        respond_line("baud: " + std::to_string(rate));
+        switch_baud(lever, uint32_t(rate), t);
+      } else {
+        respond_line("baud: " + std::to_string(lever.baud_rate));
+      }
+      break;
+    }
+    case 'c':
+      if (lever.profile_segment >= 0) {
+        finish_profile(options, lever, t, false);
+      }
+      lever.profile_size = 0;
+      respond_line("profile segments: 0");
+      break;
+    case 'l': {
+      ProfileSegment seg{};
+      seg.reverse = parse_int(&cursor);
+      seg.grams = parse_int(&cursor);
+      seg.ramp_ms = parse_int(&cursor);
+      seg.hold_ms = parse_int(&cursor);
+      if (cursor.incomplete) {
+        return 0;
+      }
+      if (lever.profile_segment < 0 && lever.profile_size < om::max_lever_force_profile_segments()) {
+        lever.profile[lever.profile_size++] = seg;
+      }
+      respond_line("profile segments: " + std::to_string(lever.profile_size));
+      break;
+    }
+    case 'm':
+      if (lever.profile_size > 0) {
+        start_profile_segment(lever, 0, t);
+        lever.next_profile_step_time = t + to_duration(Config::profile_step_s);
+      }
+      respond_line("profile started: " + std::to_string(lever.profile_size));
+      break;
+    case 'u': {
+      const float offset = parse_float(&cursor);
+      if (cursor.incomplete) {
+        return 0;
+      }
+      lever.pwm_offset = offset;
+      break;
+    }
+    case 's': {
+      char buff[128];
+      std::snprintf(buff, sizeof(buff),
+                    "strain gauge reading: %0.2f\tcalculated PWM: %0.2f\tacutal PWM: %dP: %d",
+                    lever.strain_average, calculate_pwm_from_strain(lever.strain_average),
+                    lever.pwm_value, read_pot(options, lever, t));
+      respond_line(buff);
+      break;
+    }
+    case 'a': {
+      const long grams = parse_int(&cursor);
+      if (cursor.incomplete) {
+        return 0;
+      }
+      lever.measured_grams = int(grams);
+      break;
+    }
+    case 'r':
+      respond_line(std::to_string(lever.pwm_value) + "\t" + std::to_string(int(lever.strain_average)) +
+                   "\t" + std::to_string(lever.measured_grams));
+      break;
+    default:
+      //  Includes the '\n' that terminates commands.
+      break;
+  }
+
+  //  The sketch consumes a '\n' that directly follows a command.
+  if (cursor.pos < lever.input.size() && lever.input[cursor.pos] == '\n') {
+    cursor.pos++;
+  }
+  if (command != '\n') {
+    lever.num_commands++;
+    lever.last_command_time = t;
+  }
+  return cursor.pos;
+}
+
+void receive(const Options& options, VirtualLever& lever, const om::TimePoint& t) {
+  char buff[Config::read_size];
+  while (true) {
+    const auto num_read = ::read(lever.master_fd, buff, sizeof(buff));
+    if (num_read <= 0) {
+      break;
+    }
+    if (link_matches(lever, lever.baud_rate)) {
+      if (lever.input.empty()) {
+        lever.input_time = t;
+      }
+      lever.input.append(buff, size_t(num_read));
+    } else {
+      lever.num_garbled += uint64_t(num_read);
+    }
+  }
+
+  while (!lever.input.empty()) {
+    const size_t consumed = process_command(options, lever, t);
+    if (consumed == 0) {
+      break;
+    }
+    lever.input.erase(0, consumed);
+    lever.input_time = t;
+  }
+}
+
+void detect_edge(const Options& options, VirtualLever& lever, const om::TimePoint& t, int pot) {
+  const bool rising_above = lever.edge_rising > lever.edge_falling;
+  const bool above_rising = rising_above ? pot > lever.edge_rising : pot < lever.edge_rising;
+  const bool below_falling = rising_above ? pot < lever.edge_falling : pot > lever.edge_falling;
+  if (lever.edge_is_high && below_falling) {
+    lever.edge_is_high = false;
+    send_frame(options, lever, t, om::LeverFrameFormat::edge_type, false, lever.edge_sequence++, pot);
+  } else if (!lever.edge_is_high && above_rising) {
+    lever.edge_is_high = true;
+    send_frame(options, lever, t, om::LeverFrameFormat::edge_type, true, lever.edge_sequence++, pot);
+  }
+}
+
+void step_profile(const Options& options, VirtualLever& lever, const om::TimePoint& t) {
+  auto& seg = lever.profile[lever.profile_segment];
+  const double elapsed_ms = om::elapsed_time(lever.segment_start, t) * 1e3;
+  const float f = seg.ramp_ms > 0 ? std::min(1.0f, float(elapsed_ms / double(seg.ramp_ms))) : 1.0f;
+  set_profile_grams(lever, lever.profile_start_grams + (float(seg.grams) - lever.profile_start_grams) * f);
+  if (elapsed_ms >= double(seg.ramp_ms + seg.hold_ms)) {
+    if (lever.profile_segment + 1 < lever.profile_size) {
+      start_profile_segment(lever, lever.profile_segment + 1, t);
+    } else {
+      finish_profile(options, lever, t, true);
+    }
+  }
+}
+
+//  One pass of the sketch's loop.
+void step(const Options& options, VirtualLever& lever, const om::TimePoint& t) {
+  if (!lever.baud_confirmed &&
+      om::elapsed_time(lever.baud_switch_time, t) * 1e3 >= double(om::baud_confirm_window_ms())) {
+    switch_baud(lever, om::default_baud_rate(), t);
+  }
+  if (lever.baud_rate != om::default_baud_rate() &&
+      om::elapsed_time(lever.last_command_time, t) * 1e3 >= double(om::baud_idle_timeout_ms())) {
+    switch_baud(lever, om::default_baud_rate(), t);
+  }
+
+  while (t >= lever.next_read_time) {
+    //  The strain gauge's running average approaches the reading for the commanded force.
+    const float target = Config::strain_baseline + Config::strain_per_gram * float(lever.command_grams);
+    lever.strain_average += (target - lever.strain_average) / float(Config::running_average_size);
+    if (lever.edge_rising != lever.edge_falling) {
+      detect_edge(options, lever, t, read_pot(options, lever, t));
+    }
+    lever.next_read_time += to_duration(Config::read_interval_s);
+  }
+
+  while (lever.profile_segment >= 0 && t >= lever.next_profile_step_time) {
+    step_profile(options, lever, t);
+    lever.next_profile_step_time += to_duration(Config::profile_step_s);
+  }
+
+  if (lever.stream_rate > 0 && t >= lever.next_frame_time) {
+    send_frame(options, lever, t, om::LeverFrameFormat::state_type, false,
+               lever.frame_sequence++, read_pot(options, lever, t));
+    lever.next_frame_time = t + to_duration(1.0 / double(lever.stream_rate));
+  }
+}
+
+void flush_output(VirtualLever& lever, const om::TimePoint& t) {
+  while (!lever.output.empty() && lever.output.front().due <= t) {
+    auto& pending = lever.output.front();
+    if (!link_matches(lever, pending.baud_rate)) {
+      lever.num_garbled += pending.bytes.size();
+    } else if (::write(lever.master_fd, pending.bytes.data(), pending.bytes.size()) ==
+               ssize_t(pending.bytes.size())) {
+      lever.num_sent++;
+    } else {
+      //  Nobody is reading the slave and its buffer is full.
+      lever.num_dropped++;
+    }
+    lever.output.pop_front();
+  }
+}
+
+bool open_pty(VirtualLever* lever) {
+  lever->master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (lever->master_fd < 0 || grantpt(lever->master_fd) != 0 || unlockpt(lever->master_fd) != 0) {
+    return false;
+  }
+  const char* name = ptsname(lever->master_fd);
+  if (!name) {
+    return false;
+  }
+  lever->slave_path = name;
+  //  Holding the slave open keeps the master readable while no client has it open.
+  lever->slave_fd = ::open(name, O_RDWR | O_NOCTTY);
+  if (lever->slave_fd < 0) {
+    return false;
+  }
+  termios tty{};
+  if (tcgetattr(lever->slave_fd, &tty) != 0) {
+    return false;
+  }
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, B9600);
+  cfsetospeed(&tty, B9600);
+  return tcsetattr(lever->slave_fd, TCSANOW, &tty) == 0;
+}
+
+void close_pty(VirtualLever* lever) {
+  if (!lever->link_path.empty()) {
+    ::unlink(lever->link_path.c_str());
+  }
+  if (lever->slave_fd >= 0) {
+    ::close(lever->slave_fd);
+  }
+  if (lever->master_fd >= 0) {
+    ::close(lever->master_fd);
+  }
+}
+
+#endif
+
+std::optional<Trajectory> parse_trajectory(const std::string& spec) {
+  Trajectory result;
+  const auto sep = spec.find(':');
+  const auto kind = spec.substr(0, sep);
+  const auto args = sep == std::string::npos ? std::string{} : spec.substr(sep + 1);
+  if (kind == "constant") {
+    result.type = TrajectoryType::Constant;
+    result.value = std::atof(args.c_str());
+  } else if (kind == "sine") {
+    result.type = TrajectoryType::Sine;
+    result.period_s = std::atof(args.c_str());
+  } else if (kind == "pulls") {
+    result.type = TrajectoryType::Pulls;
+    result.period_s = std::atof(args.c_str());
+    const auto duty_sep = args.find(':');
+    if (duty_sep != std::string::npos) {
+      result.duty = std::atof(args.c_str() + duty_sep + 1);
+    }
+  } else if (kind == "file") {
+    result.type = TrajectoryType::File;
+    std::ifstream file(args);
+    double time;
+    double reading;
+    while (file >> time >> reading) {
+      result.points.emplace_back(time, reading);
+    }
+    std::sort(result.points.begin(), result.points.end());
+    if (result.points.empty()) {
+      return std::nullopt;
+    }
+  } else {
+    return std::nullopt;
+  }
+  if (result.type != TrajectoryType::Constant && result.type != TrajectoryType::File &&
+      result.period_s <= 0.0) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+std::optional<Options> parse_options(int argc, char** argv) {
+  Options result;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg{argv[i]};
+    auto next = [&]() -> const char* {
+      return i + 1 < argc ? argv[++i] : nullptr;
+    };
+    const char* value = next();
+    if (!value) {
+      return std::nullopt;
+    }
+    if (arg == "--levers") {
+      result.num_levers = std::atoi(value);
+    } else if (arg == "--latency-ms") {
+      result.latency_s = std::atof(value) * 1e-3;
+    } else if (arg == "--jitter-ms") {
+      result.jitter_s = std::atof(value) * 1e-3;
+    } else if (arg == "--drop") {
+      result.drop_probability = std::atof(value);
+    } else if (arg == "--max-baud") {
+      result.max_baud_rate = uint32_t(std::atol(value));
+    } else if (arg == "--pot-range") {
+      const char* hi = next();
+      if (!hi) {
+        return std::nullopt;
+      }
+      result.pot_range[0] = float(std::atof(value));
+      result.pot_range[1] = float(std::atof(hi));
+    } else if (arg == "--trajectory") {
+      if (auto traj = parse_trajectory(value)) {
+        result.trajectory = std::move(traj.value());
+      } else {
+        return std::nullopt;
+      }
+    } else if (arg == "--link") {
+      result.link_prefix = value;
+    } else if (arg == "--duration") {
+      result.duration_s = std::atof(value);
+    } else if (arg == "--seed") {
+      result.seed = (unsigned int) std::atol(value);
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (result.num_levers <= 0) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+} //  anon
+
+int main(int argc, char** argv) {
+  auto options = parse_options(argc, argv);
+  if (!options) {
+    printf("Usage: %s [--levers n] [--latency-ms ms] [--jitter-ms ms] [--drop p] [--max-baud rate]\n"
+           "  [--pot-range lo hi] [--trajectory constant:f|sine:s|pulls:s:f|file:path]\n"
+           "  [--link prefix] [--duration s] [--seed n]\n", argv[0]);
+    return 1;
+  }
+
+#if defined(__linux__)
+  if (options->seed) {
+    om::seed_urand(options->seed.value());
+  }
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  const auto t0 = om::now();
+  std::vector<std::unique_ptr<VirtualLever>> levers;
+  for (int i = 0; i < options->num_levers; i++) {
+    auto lever = std::make_unique<VirtualLever>();
+    lever->index = i;
+    lever->start_time = t0;
+    lever->next_read_time = t0;
+    if (!open_pty(lever.get())) {
+      printf("Failed to create a pseudo-terminal: %s\n", std::strerror(errno));
+      close_pty(lever.get());
+      return 1;
+    }
+    if (!options->link_prefix.empty()) {
+      lever->link_path = options->link_prefix + std::to_string(i);
+      ::unlink(lever->link_path.c_str());
+      if (::symlink(lever->slave_path.c_str(), lever->link_path.c_str()) != 0) {
+        printf("Failed to link %s.\n", lever->link_path.c_str());
+        lever->link_path.clear();
+      }
+    }
+    printf("lever %d: %s\n", i, lever->link_path.empty() ?
+      lever->slave_path.c_str() : lever->link_path.c_str());
+    levers.push_back(std::move(lever));
+  }
+  fflush(stdout);
+
+  std::vector<pollfd> fds(levers.size());
+  while (keep_running) {
+    const auto t = om::now();
+    if (options->duration_s > 0.0 && om::elapsed_time(t0, t) >= options->duration_s) {
+      break;
+    }
+
+    double timeout = Config::tick_interval_s;
+    for (auto& lever : levers) {
+      receive(options.value(), *lever, t);
+      step(options.value(), *lever, t);
+      flush_output(*lever, t);
+      if (!lever->output.empty()) {
+        timeout = std::min(timeout, om::elapsed_time(t, lever->output.front().due));
+      }
+    }
+
+    for (int i = 0; i < int(levers.size()); i++) {
+      fds[i].fd = levers[i]->master_fd;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    //  A tick is due every millisecond regardless, for the edge detection and profile steps.
+    (void) ::poll(fds.data(), nfds_t(fds.size()), std::max(0, int(std::ceil(timeout * 1e3))));
+  }
+
+  for (auto& lever : levers) {
+    printf("lever %d: %d commands | %d sent | %d dropped | %d bytes at mismatched rate\n",
+           lever->index, int(lever->num_commands), int(lever->num_sent), int(lever->num_dropped),
+           int(lever->num_garbled));
+    close_pty(lever.get());
+  }
+  return 0;
+#else
+  printf("Virtual levers require pseudo-terminals, which are only supported on Linux.\n");
+  return 1;
+#endif
+}